@@ -0,0 +1,349 @@
+// hybirt_bench.cpp
+//
+// Microbenchmarks of the kernels of the time loop, swept over grid size,
+// particles per cell and threads. Results go out as JSON, one entry per
+// kernel and configuration, to compare versions.
+//
+//   hybirt-bench [--grid 100,1000] [--nppc 10,100] [--threads 1,2]
+//                [--reps 20] [--out results.json]
+#include "ampere.hpp"
+#include "boundary_condition.hpp"
+#include "faraday.hpp"
+#include "field.hpp"
+#include "fused_fields.hpp"
+#include "gridlayout.hpp"
+#include "moments.hpp"
+#include "ohm.hpp"
+#include "population.hpp"
+#include "pusher.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr std::size_t dim = 1;
+
+
+struct Config
+{
+    std::vector<std::size_t> grids   = {100, 1000, 10000};
+    std::vector<std::size_t> nppcs   = {10, 100};
+    std::vector<std::size_t> threads = {1, std::max(1u, std::thread::hardware_concurrency())};
+    std::size_t reps                 = 20;
+    std::string out;
+};
+
+struct Result
+{
+    std::string kernel;
+    std::size_t grid    = 0;
+    std::size_t nppc    = 0;
+    std::size_t threads = 1;
+    std::size_t items   = 0; // particles or nodes per call
+    double bytes        = 0; // memory traffic per call, estimated
+    std::vector<double> seconds;
+};
+
+
+// times reps calls of kernel, after one warmup call. setup runs before each
+// call and is not timed.
+Result measure(std::size_t reps, std::function<void()> const& kernel,
+               std::function<void()> const& setup = [] {})
+{
+    Result result;
+    setup();
+    kernel();
+    for (std::size_t r = 0; r < reps; ++r)
+    {
+        setup();
+        auto const start = std::chrono::steady_clock::now();
+        kernel();
+        auto const stop = std::chrono::steady_clock::now();
+        result.seconds.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+    return result;
+}
+
+
+void to_json(std::ostream& out, Result const& r)
+{
+    auto const n    = static_cast<double>(r.seconds.size());
+    double mean     = 0;
+    double variance = 0;
+    for (auto s : r.seconds)
+        mean += s / n;
+    for (auto s : r.seconds)
+        variance += (s - mean) * (s - mean) / std::max(n - 1, 1.0);
+    auto const min = *std::min_element(r.seconds.begin(), r.seconds.end());
+
+    out << "    {\"kernel\": \"" << r.kernel << "\", \"grid\": " << r.grid
+        << ", \"nppc\": " << r.nppc << ", \"threads\": " << r.threads
+        << ", \"items\": " << r.items << ", \"reps\": " << r.seconds.size()
+        << ", \"mean_s\": " << mean << ", \"min_s\": " << min
+        << ", \"variance_s2\": " << variance
+        << ", \"stddev_rel\": " << (mean > 0 ? std::sqrt(variance) / mean : 0.)
+        << ", \"ns_per_item\": " << 1e9 * mean / std::max<std::size_t>(r.items, 1)
+        << ", \"gb_per_s\": " << (mean > 0 ? 1e-9 * r.bytes / mean : 0.) << "}";
+}
+
+
+std::vector<std::size_t> parse_list(std::string const& arg)
+{
+    std::vector<std::size_t> values;
+    std::stringstream in{arg};
+    std::string item;
+    while (std::getline(in, item, ','))
+        values.push_back(std::stoul(item));
+    return values;
+}
+
+
+Config parse(int argc, char** argv)
+{
+    Config config;
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string const flag = argv[i];
+        if (i + 1 == argc)
+            throw std::runtime_error("Missing value for " + flag);
+        std::string const arg = argv[i + 1];
+        if (flag == "--grid")
+            config.grids = parse_list(arg);
+        else if (flag == "--nppc")
+            config.nppcs = parse_list(arg);
+        else if (flag == "--threads")
+            config.threads = parse_list(arg);
+        else if (flag == "--reps")
+            config.reps = std::stoul(arg);
+        else if (flag == "--out")
+            config.out = arg;
+        else
+            throw std::runtime_error("Unknown option " + flag);
+    }
+    return config;
+}
+
+
+// smooth fields so that the particles see non trivial values
+void init_fields(VecField<dim>& F, GridLayout<dim> const& layout, double amplitude)
+{
+    for (auto* field : {&F.x, &F.y, &F.z})
+        for (std::size_t ix = 0; ix < field->size(); ++ix)
+        {
+            auto const x = layout.coordinate(Direction::X, field->quantity(), ix);
+            (*field)(ix) = amplitude * (1.0 + 0.1 * std::sin(0.3 * x + field->size()));
+        }
+}
+
+
+// nppc particles per cell, uniformly spread, with a fixed seed so that
+// every run sees the same particles
+ParticleArray<dim> make_particles(GridLayout<dim> const& layout, std::size_t nppc)
+{
+    std::mt19937_64 gen{1234};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    std::normal_distribution<double> maxwell{0.0, 0.2};
+
+    ParticleArray<dim> particles;
+    auto const nbr_cells = layout.nbr_cells(Direction::X);
+    auto const dx        = layout.cell_size(Direction::X);
+    particles.reserve(nbr_cells * nppc);
+    for (std::size_t cell = 0; cell < nbr_cells; ++cell)
+        for (std::size_t i = 0; i < nppc; ++i)
+        {
+            Particle<dim> p;
+            p.position[0] = (cell + uniform(gen)) * dx;
+            p.v           = {maxwell(gen), maxwell(gen), maxwell(gen)};
+            p.weight      = 1.0 / nppc;
+            particles.push_back(p);
+        }
+    return particles;
+}
+
+
+void bench_particles(Config const& config, std::size_t grid, std::size_t nppc,
+                     std::size_t nbr_threads, std::vector<Result>& results)
+{
+    double const dt = 0.001;
+    auto layout     = std::make_shared<GridLayout<dim>>(std::array<std::size_t, dim>{grid},
+                                                    std::array<double, dim>{0.2}, 1);
+    ThreadPool pool{nbr_threads};
+
+    VecField<dim> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    init_fields(E, *layout, 0.01);
+    init_fields(B, *layout, 1.0);
+
+    std::vector<Population<dim>> populations;
+    populations.emplace_back("bench", layout);
+    auto& pop       = populations[0];
+    pop.particles() = make_particles(*layout, nppc);
+    pop.rebin();
+    auto& particles   = pop.particles();
+    auto const n      = particles.size();
+    auto const cells  = layout->nbr_cells(Direction::X);
+    auto add          = [&](Result r, std::string kernel, std::size_t items, double bytes) {
+        r.kernel  = kernel;
+        r.grid    = grid;
+        r.nppc    = nppc;
+        r.threads = nbr_threads;
+        r.items   = items;
+        r.bytes   = bytes;
+        results.push_back(r);
+    };
+
+    // Boris::operator() on one share of the particles per thread, each share
+    // with its own pusher, like the time loop does with one patch per thread
+    std::vector<ParticleArray<dim>> shares;
+    std::vector<Boris<dim>> pushers;
+    pushers.reserve(pool.size());
+    for (std::size_t share = 0; share < pool.size(); ++share)
+    {
+        auto const [first, last] = ThreadPool::chunk_range(n, pool.size(), share);
+        shares.push_back(particles.empty_like());
+        for (auto i = first; i < last; ++i)
+            shares.back().push_back(particles, i);
+        pushers.emplace_back(layout, dt);
+    }
+    PeriodicBoundaryCondition<dim> periodic{layout};
+    auto push = [&] {
+        pool.parallel_for(pool.size(),
+                          [&](std::size_t share) { pushers[share](shares[share], E, B); });
+    };
+    auto wrap = [&] {
+        for (auto& share : shares)
+            periodic.particles(share);
+    };
+    // x and v read and written
+    add(measure(config.reps, push, wrap), "boris_push", n, 8.0 * 8 * n);
+
+    // same with the fields packed node by node first, by every pusher, the
+    // packing included
+    for (auto& pusher : pushers)
+        pusher.gather_grid(true);
+    add(measure(config.reps, push, wrap), "boris_push_gather_grid", n,
+        8.0 * 8 * n + 14.0 * 8 * (cells + 3) * nbr_threads);
+
+    add(measure(config.reps, [&] { periodic.particles(particles); }), "periodic_particles", n,
+        2.0 * 8 * n);
+
+    // x, v and weight read, density and flux written for each particle
+    if (nbr_threads == 1)
+        add(measure(config.reps, [&] { pop.deposit(); }), "deposit", n, 5.0 * 8 * n);
+    else
+        add(measure(config.reps, [&] { pop.deposit(pool); }), "deposit", n,
+            5.0 * 8 * n + 4.0 * 8 * (cells + 3) * nbr_threads);
+
+    Field<dim> N{layout->allocate(Quantity::N), Quantity::N};
+    VecField<dim> V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}};
+    add(measure(config.reps, [&] { total_density(populations, N); }), "total_density", N.size(),
+        2.0 * 8 * N.size());
+    add(measure(config.reps, [&] { bulk_velocity<dim>(populations, N, V); }), "bulk_velocity",
+        N.size(), 7.0 * 8 * N.size());
+}
+
+
+void bench_fields(Config const& config, std::size_t grid, std::vector<Result>& results)
+{
+    double const dt = 0.001;
+    auto layout     = std::make_shared<GridLayout<dim>>(std::array<std::size_t, dim>{grid},
+                                                    std::array<double, dim>{0.2}, 1);
+
+    VecField<dim> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> Bnew{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> J{layout, {Quantity::Jx, Quantity::Jy, Quantity::Jz}};
+    VecField<dim> V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}};
+    VecField<dim> Enew{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    Field<dim> N{layout->allocate(Quantity::N), Quantity::N};
+    init_fields(E, *layout, 0.01);
+    init_fields(B, *layout, 1.0);
+    init_fields(V, *layout, 0.1);
+    for (auto& n : N)
+        n = 1.0;
+
+    Faraday<dim> faraday{layout, dt};
+    Ampere<dim> ampere{layout};
+    Ohm<dim> ohm{layout};
+    PeriodicBoundaryCondition<dim> periodic{layout};
+    ampere(B, J);
+
+    auto const nodes = E.x.size();
+    auto add         = [&](Result r, std::string kernel, std::size_t items, double bytes) {
+        r.kernel = kernel;
+        r.grid   = grid;
+        r.items  = items;
+        r.bytes  = bytes;
+        results.push_back(r);
+    };
+
+    // bytes: field arrays read and written, once each
+    add(measure(config.reps, [&] { faraday(E, B, Bnew); }), "faraday", nodes, 9.0 * 8 * nodes);
+    add(measure(config.reps, [&] { ampere(B, J); }), "ampere", nodes, 6.0 * 8 * nodes);
+    add(measure(config.reps, [&] { ohm(B, J, N, V, Enew); }), "ohm", nodes, 13.0 * 8 * nodes);
+    // the three above in one sweep: E, B, N, V read, Bnew, J, Enew written
+    FusedFieldSolver<dim> fused{layout, dt};
+    add(measure(config.reps, [&] { fused(E, B, N, V, Bnew, J, Enew); }), "fused_fields", nodes,
+        19.0 * 8 * nodes);
+    // only the ghost nodes of the three components are touched, each
+    // written from one domain node
+    auto fill = [&] {
+        periodic.fill(E.x);
+        periodic.fill(E.y);
+        periodic.fill(E.z);
+    };
+    std::size_t ghosts = 0;
+    for (auto const* component : {&E.x, &E.y, &E.z})
+    {
+        auto const qty = component->quantity();
+        ghosts += layout->dom_start(qty, Direction::X) - layout->ghost_start(qty, Direction::X)
+                  + layout->ghost_end(qty, Direction::X) - layout->dom_end(qty, Direction::X);
+    }
+    add(measure(config.reps, fill), "periodic_fill", ghosts, 2.0 * 8 * ghosts);
+}
+
+
+int main(int argc, char** argv)
+{
+    auto const config = parse(argc, argv);
+    std::vector<Result> results;
+
+    for (auto grid : config.grids)
+    {
+        std::cerr << "grid " << grid << "\n";
+        bench_fields(config, grid, results);
+        for (auto nppc : config.nppcs)
+            for (auto threads : config.threads)
+                bench_particles(config, grid, nppc, threads, results);
+    }
+
+    std::ofstream file;
+    if (!config.out.empty())
+        file.open(config.out);
+    std::ostream& out = config.out.empty() ? std::cout : file;
+
+    out << "{\n  \"simd\": \"" << to_string(simd_level()) << "\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        to_json(out, results[i]);
+        out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
@@ -2,6 +2,8 @@
 #define HYBRIDIR_AMPERE_HPP
 
 #include "vecfield.hpp"
+#include "tiling.hpp"
+#include "utils.hpp"
 
 #include <cstddef>
 #include <iostream>
@@ -47,12 +49,76 @@ public:
                 Jz(ix) = (By(ix)- By(ix - 1))/(dx);
             }
         }
+        else if constexpr (dimension == 2)
+        {
+            // Jx (dual, primal), Jy (primal, dual), Jz (primal, primal)
+            auto const dy = m_grid->cell_size(Direction::Y);
+
+            for (auto ix = m_grid->dom_start(Quantity::Jx, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Jx, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Jx, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Jx, Direction::Y); iy <= iy_end; ++iy)
+                    J.x(ix, iy) = (B.z(ix, iy) - B.z(ix, iy - 1)) / dy;
+            }
+
+            for (auto ix = m_grid->dom_start(Quantity::Jy, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Jy, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Jy, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Jy, Direction::Y); iy <= iy_end; ++iy)
+                    J.y(ix, iy) = -(B.z(ix, iy) - B.z(ix - 1, iy)) / dx;
+            }
+
+            for (auto ix = m_grid->dom_start(Quantity::Jz, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Jz, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Jz, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Jz, Direction::Y); iy <= iy_end; ++iy)
+                    J.z(ix, iy) = (B.y(ix, iy) - B.y(ix - 1, iy)) / dx
+                                  - (B.x(ix, iy) - B.x(ix, iy - 1)) / dy;
+            }
+        }
+        else if constexpr (dimension == 3)
+        {
+            // Jx (dual, primal, primal), Jy (primal, dual, primal), Jz (primal,
+            // primal, dual), the three computed tile by tile
+            auto const dy = m_grid->cell_size(Direction::Y);
+            auto const dz = m_grid->cell_size(Direction::Z);
+
+            auto const jx = dom_box<Quantity::Jx>(*m_grid);
+            auto const jy = dom_box<Quantity::Jy>(*m_grid);
+            auto const jz = dom_box<Quantity::Jz>(*m_grid);
+
+            for_each_tile(hull(hull(jx, jy), jz), m_tiles, [&](IndexBox const& tile) {
+                sweep(jx, tile, [&](auto ix, auto iy, auto iz) {
+                    J.x(ix, iy, iz) = (B.z(ix, iy, iz) - B.z(ix, iy - 1, iz)) / dy
+                                      - (B.y(ix, iy, iz) - B.y(ix, iy, iz - 1)) / dz;
+                });
+                sweep(jy, tile, [&](auto ix, auto iy, auto iz) {
+                    J.y(ix, iy, iz) = (B.x(ix, iy, iz) - B.x(ix, iy, iz - 1)) / dz
+                                      - (B.z(ix, iy, iz) - B.z(ix - 1, iy, iz)) / dx;
+                });
+                sweep(jz, tile, [&](auto ix, auto iy, auto iz) {
+                    J.z(ix, iy, iz) = (B.y(ix, iy, iz) - B.y(ix - 1, iy, iz)) / dx
+                                      - (B.x(ix, iy, iz) - B.x(ix, iy - 1, iz)) / dy;
+                });
+            });
+        }
         else
             throw std::runtime_error("Ampere not implemented for this dimension");
     }
 
+    // cache blocking of the 3D sweeps
+    Tiles const& tiles() const { return m_tiles; }
+    void tiles(Tiles tiles) { m_tiles = tiles; }
+
 private:
     std::shared_ptr<GridLayout<dimension>> m_grid;
+    Tiles m_tiles;
 };
 
 #endif // HYBRIDIR_AMPERE_HPP
@@ -0,0 +1,238 @@
+#ifndef HYBIRT_ASYNC_DIAGNOSTICS_HPP
+#define HYBIRT_ASYNC_DIAGNOSTICS_HPP
+
+#include "diagnostics.hpp"
+#include "field.hpp"
+#include "gridlayout.hpp"
+#include "particle_array.hpp"
+#include "trace.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// copy of the state written by one diagnostics snapshot, on the whole layout
+template<std::size_t dimension>
+struct Snapshot
+{
+    struct Particles
+    {
+        std::string name;
+        ParticleArray<dimension> particles;
+    };
+
+    explicit Snapshot(std::shared_ptr<GridLayout<dimension>> const& layout)
+        : B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}}
+        , E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}}
+        , V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}}
+        , N{layout->allocate(Quantity::N), Quantity::N}
+    {
+    }
+
+    // particle buffer of population ipop, keeps its capacity between
+    // snapshots
+    ParticleArray<dimension>& particles(std::size_t ipop, std::string const& name)
+    {
+        if (populations.size() <= ipop)
+            populations.resize(ipop + 1);
+        populations[ipop].name = name;
+        return populations[ipop].particles;
+    }
+
+    double time = 0.;
+    VecField<dimension> B;
+    VecField<dimension> E;
+    VecField<dimension> V;
+    Field<dimension> N;
+    std::vector<Particles> populations;
+};
+
+
+
+// Runs a DiagnosticsWriter on a dedicated thread. The time loop copies the
+// state into one of nbr_buffers rotating snapshots and goes on while the
+// writer thread serializes it. When all the buffers are waiting to be
+// written, taking a new snapshot blocks until the writer frees one.
+//
+// Only the writer thread touches HDF5 once constructed. Errors raised while
+// writing are rethrown to the time loop by the next snapshot or flush, or
+// printed to std::cerr at destruction when neither came. A fill that throws
+// gives its buffer back before its exception reaches the caller.
+template<std::size_t dimension>
+class AsyncDiagnostics
+{
+public:
+    AsyncDiagnostics(std::shared_ptr<GridLayout<dimension>> layout, std::size_t every = 1,
+                     std::string suffix = "", std::size_t nbr_buffers = 2,
+                     std::optional<double> resume_time = std::nullopt)
+        : m_writer{layout, every, suffix, resume_time}
+    {
+        for (std::size_t i = 0; i < std::max<std::size_t>(nbr_buffers, 1); ++i)
+        {
+            m_buffers.push_back(std::make_unique<Snapshot<dimension>>(layout));
+            m_free.push_back(m_buffers.back().get());
+        }
+        m_thread = std::thread{[this] { work(); }};
+    }
+
+    ~AsyncDiagnostics()
+    {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_stop = true;
+        }
+        m_ready_cv.notify_one();
+        m_thread.join();
+
+        // a failed snapshot no flush() reported still leaves a trace
+        if (m_error)
+        {
+            try
+            {
+                std::rethrow_exception(m_error);
+            }
+            catch (std::exception const& e)
+            {
+                std::cerr << "Diagnostics snapshot not written: " << e.what() << "\n";
+            }
+            catch (...)
+            {
+                std::cerr << "Diagnostics snapshot not written\n";
+            }
+        }
+    }
+
+    AsyncDiagnostics(AsyncDiagnostics const&)            = delete;
+    AsyncDiagnostics& operator=(AsyncDiagnostics const&) = delete;
+
+    bool due(std::size_t step) const { return m_writer.due(step); }
+
+    // number of snapshots that had to wait for a free buffer
+    std::size_t nbr_stalls() const { return m_nbr_stalls; }
+
+    // fill(snapshot) copies the state to write at time into a free buffer,
+    // which is then queued for the writer thread
+    template<typename Fill>
+    void snapshot(double time, Fill&& fill)
+    {
+        Snapshot<dimension>* buffer = nullptr;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            rethrow();
+            if (m_free.empty())
+                ++m_nbr_stalls;
+            m_free_cv.wait(lock, [this] { return !m_free.empty(); });
+            buffer = m_free.front();
+            m_free.pop_front();
+        }
+
+        buffer->time = time;
+        try
+        {
+            fill(*buffer);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                m_free.push_back(buffer);
+            }
+            m_free_cv.notify_one();
+            throw;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_ready.push_back(buffer);
+        }
+        m_ready_cv.notify_one();
+    }
+
+    // waits until every queued snapshot is written
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_free_cv.wait(lock, [this] { return m_free.size() == m_buffers.size(); });
+        rethrow();
+    }
+
+private:
+    void rethrow()
+    {
+        if (m_error)
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+    void write(Snapshot<dimension> const& snapshot)
+    {
+        m_writer.begin_snapshot(snapshot.time);
+        m_writer.write_fields(snapshot.B, snapshot.E, snapshot.V, snapshot.N);
+        for (auto const& pop : snapshot.populations)
+            m_writer.write_particles(pop.name, pop.particles);
+        m_writer.end_snapshot();
+    }
+
+    void work()
+    {
+        Tracer::instance().name_this_thread("diagnostics writer");
+        while (true)
+        {
+            Snapshot<dimension>* buffer = nullptr;
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_ready_cv.wait(lock, [this] { return m_stop or !m_ready.empty(); });
+                if (m_ready.empty())
+                    return;
+                buffer = m_ready.front();
+                m_ready.pop_front();
+            }
+
+            std::exception_ptr error;
+            try
+            {
+                write(*buffer);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                if (error and !m_error)
+                    m_error = error;
+                m_free.push_back(buffer);
+            }
+            m_free_cv.notify_one();
+        }
+    }
+
+    DiagnosticsWriter<dimension> m_writer;
+    std::vector<std::unique_ptr<Snapshot<dimension>>> m_buffers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_free_cv;
+    std::condition_variable m_ready_cv;
+    std::deque<Snapshot<dimension>*> m_free;
+    std::deque<Snapshot<dimension>*> m_ready;
+    std::exception_ptr m_error;
+    std::size_t m_nbr_stalls = 0;
+    bool m_stop              = false;
+
+    std::thread m_thread;
+};
+
+
+#endif // HYBIRT_ASYNC_DIAGNOSTICS_HPP
@@ -0,0 +1,72 @@
+#ifndef HYBIRT_BLENDED_FIELD_HPP
+#define HYBIRT_BLENDED_FIELD_HPP
+
+#include "field.hpp"
+#include "gridlayout.hpp"
+#include "vecfield.hpp"
+
+#include <cstddef>
+
+
+// Field at a time between two stored states, (1 - weight) * now + weight *
+// next, evaluated node by node when read instead of stored. For weight 0.5
+// the values are bit for bit 0.5 * (now + next).
+template<std::size_t dimension>
+class BlendedField
+{
+public:
+    BlendedField(Field<dimension> const& now, Field<dimension> const& next, double weight)
+        : m_now{&now}
+        , m_next{&next}
+        , m_weight{weight}
+    {
+    }
+
+    template<typename... Indexes>
+    double operator()(Indexes... ijk) const
+    {
+        return (1.0 - m_weight) * (*m_now)(ijk...) + m_weight * (*m_next)(ijk...);
+    }
+
+    auto quantity() const { return m_now->quantity(); }
+
+    Field<dimension> const& now() const { return *m_now; }
+    Field<dimension> const& next() const { return *m_next; }
+    double weight() const { return m_weight; }
+
+private:
+    Field<dimension> const* m_now;
+    Field<dimension> const* m_next;
+    double m_weight;
+};
+
+
+// same for the three components of a vector field
+template<std::size_t dimension>
+class BlendedVecField
+{
+public:
+    BlendedVecField(VecField<dimension> const& now, VecField<dimension> const& next, double weight)
+        : x{now.x, next.x, weight}
+        , y{now.y, next.y, weight}
+        , z{now.z, next.z, weight}
+        , m_now{&now}
+        , m_next{&next}
+    {
+    }
+
+    VecField<dimension> const& now() const { return *m_now; }
+    VecField<dimension> const& next() const { return *m_next; }
+    double weight() const { return x.weight(); }
+
+    BlendedField<dimension> x;
+    BlendedField<dimension> y;
+    BlendedField<dimension> z;
+
+private:
+    VecField<dimension> const* m_now;
+    VecField<dimension> const* m_next;
+};
+
+
+#endif // HYBIRT_BLENDED_FIELD_HPP
@@ -0,0 +1,735 @@
+#ifndef HYBIRT_BORIS_KERNELS_HPP
+#define HYBIRT_BORIS_KERNELS_HPP
+
+#include "gridlayout.hpp"
+#include "simd.hpp"
+#include "utils.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Everything a 1D Boris kernel needs, resolved once per push so that the
+// per-particle loop has no layout lookups and no primal/dual branches.
+struct BorisKernelArgs
+{
+    double* x;
+    double* vx;
+    double* vy;
+    double* vz;
+    std::size_t size;
+
+    // cell relative positions, used instead of x when not null
+    std::int32_t* icell = nullptr;
+    double* delta       = nullptr;
+
+    // particles the push starts from, the arrays above for a push in place.
+    // Otherwise the pushed particles are written to the arrays above and
+    // these ones are left unchanged.
+    double const* x_from;
+    double const* vx_from;
+    double const* vy_from;
+    double const* vz_from;
+    std::int32_t const* icell_from = nullptr;
+    double const* delta_from       = nullptr;
+
+    // field storage in the order Ex, Ey, Ez, Bx, By, Bz
+    double const* fields[6];
+    // 1 if the component is dual in x, 0 if primal
+    int dual[6];
+    // second field state, when not null the particles are pushed in
+    // (1 - weight) * fields + weight * fields_next, blended node by node
+    double const* fields_next[6] = {};
+    double weight                = 0.0;
+    // gather grid, when not null read instead of the fields, see
+    // boris_pack_nodes
+    double const* nodes = nullptr;
+
+    double half_dt;  // dt/2
+    double dx;       // cell size
+    double qdt2m;    // charge * dt / (2 * mass)
+    int ghost_start; // first domain cell index
+
+    double half_dt_over_dx; // dt/(2 dx), cell relative displacement per unit velocity
+};
+
+
+// dual flags of Ex, Ey, Ez, Bx, By, Bz as the bits of a mask, bit
+// c * dimension + d set when component c is dual in direction d. Kernels
+// instantiated with a mask have the centerings compiled in, runtime_duals
+// reads them from the arguments.
+inline constexpr int runtime_duals = -1;
+
+// mask of the Yee staggering, the one the time loop pushes with
+template<std::size_t dimension>
+constexpr int yee_duals()
+{
+    constexpr Quantity components[6]
+        = {Quantity::Ex, Quantity::Ey, Quantity::Ez, Quantity::Bx, Quantity::By, Quantity::Bz};
+    int mask = 0;
+    for (std::size_t c = 0; c < 6; ++c)
+        for (std::size_t d = 0; d < dimension; ++d)
+            if (GridLayout<dimension>::centerings(components[c])[d] == GridLayout<dimension>::dual)
+                mask |= 1 << (c * dimension + d);
+    return mask;
+}
+
+
+// same arguments restricted to the particles [first, last)
+inline BorisKernelArgs boris_slice(BorisKernelArgs args, std::size_t first, std::size_t last)
+{
+    args.x += first;
+    args.vx += first;
+    args.vy += first;
+    args.vz += first;
+    args.x_from += first;
+    args.vx_from += first;
+    args.vy_from += first;
+    args.vz_from += first;
+    if (args.icell)
+    {
+        args.icell += first;
+        args.delta += first;
+        args.icell_from += first;
+        args.delta_from += first;
+    }
+    args.size = last - first;
+    return args;
+}
+
+
+// linear interpolation of a 1D field at iCell + reminder, in primal index
+// units. Dual nodes sit half a cell further, a dual field takes the left node
+// pair when the particle sits in the first half of the cell and its weight is
+// shifted accordingly, as in boris_gather_2d. With next, the two nodes are
+// first blended in time with the given weight.
+inline double boris_gather(double const* field, double const* next, double weight, int dual,
+                           int iCell, double reminder)
+{
+    int lo   = iCell;
+    double w = reminder;
+    if (dual)
+    {
+        int const left = w < 0.5 ? 1 : 0;
+        lo -= left;
+        w += left ? 0.5 : -0.5;
+    }
+    double f_lo = field[lo];
+    double f_hi = field[lo + 1];
+    if (next)
+    {
+        f_lo = (1.0 - weight) * f_lo + weight * next[lo];
+        f_hi = (1.0 - weight) * f_hi + weight * next[lo + 1];
+    }
+    return f_lo * (1.0 - w) + f_hi * w;
+}
+
+
+inline int dual_mask(BorisKernelArgs const& a)
+{
+    int mask = 0;
+    for (int c = 0; c < 6; ++c)
+        mask |= a.dual[c] << c;
+    return mask;
+}
+
+template<int duals>
+inline int dual_of(BorisKernelArgs const& a, int c)
+{
+    if constexpr (duals == runtime_duals)
+        return a.dual[c];
+    else
+        return (duals >> c) & 1;
+}
+
+// doubles per node of the gather grid, the six components padded to a
+// cache line
+inline constexpr int boris_node_stride = 8;
+
+// Gather grid of a push: the six components of primal node i at
+// nodes[i * boris_node_stride + c], the dual ones averaged from the two dual
+// nodes on either side and both states already blended. The two nodes
+// around a particle are then two consecutive cache lines, and the gather has
+// no primal/dual branch. Dual components are interpolated from the averages,
+// which differs from the direct gather by O(dx^2) and not at all on a linear
+// field.
+inline void boris_pack_nodes(BorisKernelArgs const& a, std::size_t nbr_nodes, double* nodes)
+{
+    for (int c = 0; c < 6; ++c)
+    {
+        double const* field = a.fields[c];
+        double const* next  = a.fields_next[c];
+        auto value          = [&](std::size_t i) {
+            return next ? (1.0 - a.weight) * field[i] + a.weight * next[i] : field[i];
+        };
+
+        if (!a.dual[c])
+        {
+            for (std::size_t i = 0; i < nbr_nodes; ++i)
+                nodes[i * boris_node_stride + c] = value(i);
+            continue;
+        }
+
+        // one dual node less than primal ones, the end nodes only have one
+        // dual neighbour
+        nodes[c] = value(0);
+        for (std::size_t i = 1; i + 1 < nbr_nodes; ++i)
+            nodes[i * boris_node_stride + c] = 0.5 * (value(i - 1) + value(i));
+        nodes[(nbr_nodes - 1) * boris_node_stride + c] = value(nbr_nodes - 2);
+    }
+}
+
+
+// component c of the fields at iCell + reminder
+template<int duals>
+inline double boris_gather(BorisKernelArgs const& a, int c, int iCell, double reminder)
+{
+    if (a.nodes)
+    {
+        double const* node = a.nodes + iCell * boris_node_stride + c;
+        return node[0] * (1.0 - reminder) + node[boris_node_stride] * reminder;
+    }
+    return boris_gather(a.fields[c], a.fields_next[c], a.weight, dual_of<duals>(a, c), iCell,
+                        reminder);
+}
+
+
+// pushes particle ip, in place or out of place
+template<int duals = runtime_duals>
+inline void boris_push_particle(BorisKernelArgs const& a, std::size_t ip)
+{
+    double const x_half = a.x_from[ip] + a.vx_from[ip] * a.half_dt;
+
+    double const iCell_float = x_half / a.dx + a.ghost_start;
+    int const iCell          = static_cast<int>(iCell_float);
+    double const reminder    = iCell_float - iCell;
+
+    double const Ex = boris_gather<duals>(a, 0, iCell, reminder);
+    double const Ey = boris_gather<duals>(a, 1, iCell, reminder);
+    double const Ez = boris_gather<duals>(a, 2, iCell, reminder);
+    double const Bx = boris_gather<duals>(a, 3, iCell, reminder);
+    double const By = boris_gather<duals>(a, 4, iCell, reminder);
+    double const Bz = boris_gather<duals>(a, 5, iCell, reminder);
+
+    double const vx_minus = a.vx_from[ip] + a.qdt2m * Ex;
+    double const vy_minus = a.vy_from[ip] + a.qdt2m * Ey;
+    double const vz_minus = a.vz_from[ip] + a.qdt2m * Ez;
+
+    double const tx = a.qdt2m * Bx;
+    double const ty = a.qdt2m * By;
+    double const tz = a.qdt2m * Bz;
+
+    double const vx_prime = vx_minus + vy_minus * tz - vz_minus * ty;
+    double const vy_prime = vy_minus + vz_minus * tx - vx_minus * tz;
+    double const vz_prime = vz_minus + vx_minus * ty - vy_minus * tx;
+
+    double const s_factor = 2.0 / (1.0 + (tx * tx + ty * ty + tz * tz));
+    double const sx       = tx * s_factor;
+    double const sy       = ty * s_factor;
+    double const sz       = tz * s_factor;
+
+    double const vx_plus = vx_minus + vy_prime * sz - vz_prime * sy;
+    double const vy_plus = vy_minus + vz_prime * sx - vx_prime * sz;
+    double const vz_plus = vz_minus + vx_prime * sy - vy_prime * sx;
+
+    a.vx[ip] = vx_plus + a.qdt2m * Ex;
+    a.vy[ip] = vy_plus + a.qdt2m * Ey;
+    a.vz[ip] = vz_plus + a.qdt2m * Ez;
+    a.x[ip]  = x_half + a.vx[ip] * a.half_dt;
+}
+
+
+// same as boris_push_particle on cell relative positions: the cell index is
+// moved by whole cells and the offset stays in [0,1), no divide needed
+template<int duals = runtime_duals>
+inline void boris_push_particle_cell_relative(BorisKernelArgs const& a, std::size_t ip)
+{
+    double const delta_half = a.delta_from[ip] + a.vx_from[ip] * a.half_dt_over_dx;
+    int const shift_half    = floor_to_int(delta_half);
+    int const cell_half     = a.icell_from[ip] + shift_half;
+    double const reminder   = delta_half - shift_half;
+    int const iCell         = cell_half + a.ghost_start;
+
+    double const Ex = boris_gather<duals>(a, 0, iCell, reminder);
+    double const Ey = boris_gather<duals>(a, 1, iCell, reminder);
+    double const Ez = boris_gather<duals>(a, 2, iCell, reminder);
+    double const Bx = boris_gather<duals>(a, 3, iCell, reminder);
+    double const By = boris_gather<duals>(a, 4, iCell, reminder);
+    double const Bz = boris_gather<duals>(a, 5, iCell, reminder);
+
+    double const vx_minus = a.vx_from[ip] + a.qdt2m * Ex;
+    double const vy_minus = a.vy_from[ip] + a.qdt2m * Ey;
+    double const vz_minus = a.vz_from[ip] + a.qdt2m * Ez;
+
+    double const tx = a.qdt2m * Bx;
+    double const ty = a.qdt2m * By;
+    double const tz = a.qdt2m * Bz;
+
+    double const vx_prime = vx_minus + vy_minus * tz - vz_minus * ty;
+    double const vy_prime = vy_minus + vz_minus * tx - vx_minus * tz;
+    double const vz_prime = vz_minus + vx_minus * ty - vy_minus * tx;
+
+    double const s_factor = 2.0 / (1.0 + (tx * tx + ty * ty + tz * tz));
+    double const sx       = tx * s_factor;
+    double const sy       = ty * s_factor;
+    double const sz       = tz * s_factor;
+
+    double const vx_plus = vx_minus + vy_prime * sz - vz_prime * sy;
+    double const vy_plus = vy_minus + vz_prime * sx - vx_prime * sz;
+    double const vz_plus = vz_minus + vx_prime * sy - vy_prime * sx;
+
+    a.vx[ip] = vx_plus + a.qdt2m * Ex;
+    a.vy[ip] = vy_plus + a.qdt2m * Ey;
+    a.vz[ip] = vz_plus + a.qdt2m * Ez;
+
+    double const delta_new = reminder + a.vx[ip] * a.half_dt_over_dx;
+    a.icell[ip]            = cell_half + split_offset(delta_new, a.delta[ip]);
+}
+
+
+template<int duals>
+inline void boris_push_scalar(BorisKernelArgs const& a)
+{
+    if (a.icell)
+    {
+        for (std::size_t ip = 0; ip < a.size; ++ip)
+            boris_push_particle_cell_relative<duals>(a, ip);
+        return;
+    }
+    for (std::size_t ip = 0; ip < a.size; ++ip)
+        boris_push_particle<duals>(a, ip);
+}
+
+inline void boris_push_scalar(BorisKernelArgs const& a)
+{
+    if (dual_mask(a) == yee_duals<1>())
+        boris_push_scalar<yee_duals<1>()>(a);
+    else
+        boris_push_scalar<runtime_duals>(a);
+}
+
+
+#if HYBIRT_X86_SIMD
+
+// 4 particles per iteration, the tail is handled with masked loads,
+// gathers and stores
+__attribute__((target("avx2"))) inline void boris_push_avx2(BorisKernelArgs const& a)
+{
+    auto const half_dt = _mm256_set1_pd(a.half_dt);
+    auto const dx      = _mm256_set1_pd(a.dx);
+    auto const ghost   = _mm256_set1_pd(static_cast<double>(a.ghost_start));
+    auto const qdt2m   = _mm256_set1_pd(a.qdt2m);
+    auto const one     = _mm256_set1_pd(1.0);
+    auto const two     = _mm256_set1_pd(2.0);
+    auto const half    = _mm256_set1_pd(0.5);
+    auto const lanes   = _mm256_set_epi64x(3, 2, 1, 0);
+    auto const w_now   = _mm256_set1_pd(1.0 - a.weight);
+    auto const w_next  = _mm256_set1_pd(a.weight);
+
+    for (std::size_t ip = 0; ip < a.size; ip += 4)
+    {
+        auto const remaining = static_cast<long long>(a.size - ip);
+        auto const imask     = _mm256_cmpgt_epi64(_mm256_set1_epi64x(remaining), lanes);
+        auto const mask      = _mm256_castsi256_pd(imask);
+
+        auto const x  = _mm256_maskload_pd(a.x_from + ip, imask);
+        auto const vx = _mm256_maskload_pd(a.vx_from + ip, imask);
+        auto const vy = _mm256_maskload_pd(a.vy_from + ip, imask);
+        auto const vz = _mm256_maskload_pd(a.vz_from + ip, imask);
+
+        auto const x_half      = _mm256_add_pd(x, _mm256_mul_pd(vx, half_dt));
+        auto const iCell_float = _mm256_add_pd(_mm256_div_pd(x_half, dx), ghost);
+        auto const iCell       = _mm256_cvttpd_epi32(iCell_float);
+        auto const reminder    = _mm256_sub_pd(iCell_float, _mm256_cvtepi32_pd(iCell));
+        auto const w0          = _mm256_sub_pd(one, reminder);
+
+        // 1 for the lanes that take the left node on a dual field, whose
+        // weights are shifted by half a cell
+        auto const left       = _mm256_and_pd(_mm256_cmp_pd(reminder, half, _CMP_LT_OQ), one);
+        auto const left_shift = _mm256_cvttpd_epi32(left);
+        auto const iCell_dual = _mm_sub_epi32(iCell, left_shift);
+        auto const w1_dual    = _mm256_add_pd(_mm256_sub_pd(reminder, half), left);
+        auto const w0_dual    = _mm256_sub_pd(one, w1_dual);
+
+        __m256d field[6];
+        auto const zero = _mm256_setzero_pd();
+        auto const node = _mm_mullo_epi32(iCell, _mm_set1_epi32(boris_node_stride));
+        for (int c = 0; c < 6; ++c)
+        {
+            if (a.nodes)
+            {
+                auto const lo   = _mm_add_epi32(node, _mm_set1_epi32(c));
+                auto const hi   = _mm_add_epi32(lo, _mm_set1_epi32(boris_node_stride));
+                auto const f_lo = _mm256_mask_i32gather_pd(zero, a.nodes, lo, mask, 8);
+                auto const f_hi = _mm256_mask_i32gather_pd(zero, a.nodes, hi, mask, 8);
+                field[c] = _mm256_add_pd(_mm256_mul_pd(f_lo, w0), _mm256_mul_pd(f_hi, reminder));
+                continue;
+            }
+
+            auto const lo   = a.dual[c] ? iCell_dual : iCell;
+            auto const hi   = _mm_add_epi32(lo, _mm_set1_epi32(1));
+            auto const wlo  = a.dual[c] ? w0_dual : w0;
+            auto const whi  = a.dual[c] ? w1_dual : reminder;
+            auto f_lo       = _mm256_mask_i32gather_pd(zero, a.fields[c], lo, mask, 8);
+            auto f_hi       = _mm256_mask_i32gather_pd(zero, a.fields[c], hi, mask, 8);
+            if (a.fields_next[c])
+            {
+                auto const n_lo = _mm256_mask_i32gather_pd(zero, a.fields_next[c], lo, mask, 8);
+                auto const n_hi = _mm256_mask_i32gather_pd(zero, a.fields_next[c], hi, mask, 8);
+                f_lo = _mm256_add_pd(_mm256_mul_pd(w_now, f_lo), _mm256_mul_pd(w_next, n_lo));
+                f_hi = _mm256_add_pd(_mm256_mul_pd(w_now, f_hi), _mm256_mul_pd(w_next, n_hi));
+            }
+            field[c] = _mm256_add_pd(_mm256_mul_pd(f_lo, wlo), _mm256_mul_pd(f_hi, whi));
+        }
+
+        auto const vx_minus = _mm256_add_pd(vx, _mm256_mul_pd(qdt2m, field[0]));
+        auto const vy_minus = _mm256_add_pd(vy, _mm256_mul_pd(qdt2m, field[1]));
+        auto const vz_minus = _mm256_add_pd(vz, _mm256_mul_pd(qdt2m, field[2]));
+
+        auto const tx = _mm256_mul_pd(qdt2m, field[3]);
+        auto const ty = _mm256_mul_pd(qdt2m, field[4]);
+        auto const tz = _mm256_mul_pd(qdt2m, field[5]);
+
+        auto const vx_prime = _mm256_sub_pd(_mm256_add_pd(vx_minus, _mm256_mul_pd(vy_minus, tz)),
+                                            _mm256_mul_pd(vz_minus, ty));
+        auto const vy_prime = _mm256_sub_pd(_mm256_add_pd(vy_minus, _mm256_mul_pd(vz_minus, tx)),
+                                            _mm256_mul_pd(vx_minus, tz));
+        auto const vz_prime = _mm256_sub_pd(_mm256_add_pd(vz_minus, _mm256_mul_pd(vx_minus, ty)),
+                                            _mm256_mul_pd(vy_minus, tx));
+
+        auto const t2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx, tx), _mm256_mul_pd(ty, ty)),
+                                      _mm256_mul_pd(tz, tz));
+        auto const s_factor = _mm256_div_pd(two, _mm256_add_pd(one, t2));
+        auto const sx       = _mm256_mul_pd(tx, s_factor);
+        auto const sy       = _mm256_mul_pd(ty, s_factor);
+        auto const sz       = _mm256_mul_pd(tz, s_factor);
+
+        auto const vx_plus = _mm256_sub_pd(_mm256_add_pd(vx_minus, _mm256_mul_pd(vy_prime, sz)),
+                                           _mm256_mul_pd(vz_prime, sy));
+        auto const vy_plus = _mm256_sub_pd(_mm256_add_pd(vy_minus, _mm256_mul_pd(vz_prime, sx)),
+                                           _mm256_mul_pd(vx_prime, sz));
+        auto const vz_plus = _mm256_sub_pd(_mm256_add_pd(vz_minus, _mm256_mul_pd(vx_prime, sy)),
+                                           _mm256_mul_pd(vy_prime, sx));
+
+        auto const vx_new = _mm256_add_pd(vx_plus, _mm256_mul_pd(qdt2m, field[0]));
+        auto const vy_new = _mm256_add_pd(vy_plus, _mm256_mul_pd(qdt2m, field[1]));
+        auto const vz_new = _mm256_add_pd(vz_plus, _mm256_mul_pd(qdt2m, field[2]));
+        auto const x_new  = _mm256_add_pd(x_half, _mm256_mul_pd(vx_new, half_dt));
+
+        _mm256_maskstore_pd(a.x + ip, imask, x_new);
+        _mm256_maskstore_pd(a.vx + ip, imask, vx_new);
+        _mm256_maskstore_pd(a.vy + ip, imask, vy_new);
+        _mm256_maskstore_pd(a.vz + ip, imask, vz_new);
+    }
+}
+
+
+// 8 particles per iteration, the tail is handled with mask registers
+__attribute__((target("avx512f,avx2"))) inline void boris_push_avx512(BorisKernelArgs const& a)
+{
+    auto const half_dt = _mm512_set1_pd(a.half_dt);
+    auto const dx      = _mm512_set1_pd(a.dx);
+    auto const ghost   = _mm512_set1_pd(static_cast<double>(a.ghost_start));
+    auto const qdt2m   = _mm512_set1_pd(a.qdt2m);
+    auto const one     = _mm512_set1_pd(1.0);
+    auto const two     = _mm512_set1_pd(2.0);
+    auto const half    = _mm512_set1_pd(0.5);
+    auto const zero    = _mm512_setzero_pd();
+    auto const w_now   = _mm512_set1_pd(1.0 - a.weight);
+    auto const w_next  = _mm512_set1_pd(a.weight);
+
+    for (std::size_t ip = 0; ip < a.size; ip += 8)
+    {
+        auto const remaining = a.size - ip;
+        __mmask8 const mask
+            = remaining >= 8 ? __mmask8{0xFF} : static_cast<__mmask8>((1u << remaining) - 1u);
+
+        auto const x  = _mm512_maskz_loadu_pd(mask, a.x_from + ip);
+        auto const vx = _mm512_maskz_loadu_pd(mask, a.vx_from + ip);
+        auto const vy = _mm512_maskz_loadu_pd(mask, a.vy_from + ip);
+        auto const vz = _mm512_maskz_loadu_pd(mask, a.vz_from + ip);
+
+        auto const x_half      = _mm512_add_pd(x, _mm512_mul_pd(vx, half_dt));
+        auto const iCell_float = _mm512_add_pd(_mm512_div_pd(x_half, dx), ghost);
+        auto const iCell       = _mm512_cvttpd_epi32(iCell_float);
+        auto const reminder    = _mm512_sub_pd(iCell_float, _mm512_cvtepi32_pd(iCell));
+        auto const w0          = _mm512_sub_pd(one, reminder);
+
+        auto const below      = _mm512_cmp_pd_mask(reminder, half, _CMP_LT_OQ);
+        auto const left       = _mm512_mask_blend_pd(below, zero, one);
+        auto const left_shift = _mm512_cvttpd_epi32(left);
+        auto const iCell_dual = _mm256_sub_epi32(iCell, left_shift);
+        auto const w1_dual    = _mm512_add_pd(_mm512_sub_pd(reminder, half), left);
+        auto const w0_dual    = _mm512_sub_pd(one, w1_dual);
+
+        __m512d field[6];
+        auto const node = _mm256_mullo_epi32(iCell, _mm256_set1_epi32(boris_node_stride));
+        for (int c = 0; c < 6; ++c)
+        {
+            if (a.nodes)
+            {
+                auto const lo   = _mm256_add_epi32(node, _mm256_set1_epi32(c));
+                auto const hi   = _mm256_add_epi32(lo, _mm256_set1_epi32(boris_node_stride));
+                auto const f_lo = _mm512_mask_i32gather_pd(zero, mask, lo, a.nodes, 8);
+                auto const f_hi = _mm512_mask_i32gather_pd(zero, mask, hi, a.nodes, 8);
+                field[c] = _mm512_add_pd(_mm512_mul_pd(f_lo, w0), _mm512_mul_pd(f_hi, reminder));
+                continue;
+            }
+
+            auto const lo   = a.dual[c] ? iCell_dual : iCell;
+            auto const hi   = _mm256_add_epi32(lo, _mm256_set1_epi32(1));
+            auto const wlo  = a.dual[c] ? w0_dual : w0;
+            auto const whi  = a.dual[c] ? w1_dual : reminder;
+            auto f_lo       = _mm512_mask_i32gather_pd(zero, mask, lo, a.fields[c], 8);
+            auto f_hi       = _mm512_mask_i32gather_pd(zero, mask, hi, a.fields[c], 8);
+            if (a.fields_next[c])
+            {
+                auto const n_lo = _mm512_mask_i32gather_pd(zero, mask, lo, a.fields_next[c], 8);
+                auto const n_hi = _mm512_mask_i32gather_pd(zero, mask, hi, a.fields_next[c], 8);
+                f_lo = _mm512_add_pd(_mm512_mul_pd(w_now, f_lo), _mm512_mul_pd(w_next, n_lo));
+                f_hi = _mm512_add_pd(_mm512_mul_pd(w_now, f_hi), _mm512_mul_pd(w_next, n_hi));
+            }
+            field[c] = _mm512_add_pd(_mm512_mul_pd(f_lo, wlo), _mm512_mul_pd(f_hi, whi));
+        }
+
+        auto const vx_minus = _mm512_add_pd(vx, _mm512_mul_pd(qdt2m, field[0]));
+        auto const vy_minus = _mm512_add_pd(vy, _mm512_mul_pd(qdt2m, field[1]));
+        auto const vz_minus = _mm512_add_pd(vz, _mm512_mul_pd(qdt2m, field[2]));
+
+        auto const tx = _mm512_mul_pd(qdt2m, field[3]);
+        auto const ty = _mm512_mul_pd(qdt2m, field[4]);
+        auto const tz = _mm512_mul_pd(qdt2m, field[5]);
+
+        auto const vx_prime = _mm512_sub_pd(_mm512_add_pd(vx_minus, _mm512_mul_pd(vy_minus, tz)),
+                                            _mm512_mul_pd(vz_minus, ty));
+        auto const vy_prime = _mm512_sub_pd(_mm512_add_pd(vy_minus, _mm512_mul_pd(vz_minus, tx)),
+                                            _mm512_mul_pd(vx_minus, tz));
+        auto const vz_prime = _mm512_sub_pd(_mm512_add_pd(vz_minus, _mm512_mul_pd(vx_minus, ty)),
+                                            _mm512_mul_pd(vy_minus, tx));
+
+        auto const t2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(tx, tx), _mm512_mul_pd(ty, ty)),
+                                      _mm512_mul_pd(tz, tz));
+        auto const s_factor = _mm512_div_pd(two, _mm512_add_pd(one, t2));
+        auto const sx       = _mm512_mul_pd(tx, s_factor);
+        auto const sy       = _mm512_mul_pd(ty, s_factor);
+        auto const sz       = _mm512_mul_pd(tz, s_factor);
+
+        auto const vx_plus = _mm512_sub_pd(_mm512_add_pd(vx_minus, _mm512_mul_pd(vy_prime, sz)),
+                                           _mm512_mul_pd(vz_prime, sy));
+        auto const vy_plus = _mm512_sub_pd(_mm512_add_pd(vy_minus, _mm512_mul_pd(vz_prime, sx)),
+                                           _mm512_mul_pd(vx_prime, sz));
+        auto const vz_plus = _mm512_sub_pd(_mm512_add_pd(vz_minus, _mm512_mul_pd(vx_prime, sy)),
+                                           _mm512_mul_pd(vy_prime, sx));
+
+        auto const vx_new = _mm512_add_pd(vx_plus, _mm512_mul_pd(qdt2m, field[0]));
+        auto const vy_new = _mm512_add_pd(vy_plus, _mm512_mul_pd(qdt2m, field[1]));
+        auto const vz_new = _mm512_add_pd(vz_plus, _mm512_mul_pd(qdt2m, field[2]));
+        auto const x_new  = _mm512_add_pd(x_half, _mm512_mul_pd(vx_new, half_dt));
+
+        _mm512_mask_storeu_pd(a.x + ip, mask, x_new);
+        _mm512_mask_storeu_pd(a.vx + ip, mask, vx_new);
+        _mm512_mask_storeu_pd(a.vy + ip, mask, vy_new);
+        _mm512_mask_storeu_pd(a.vz + ip, mask, vz_new);
+    }
+}
+
+#endif // HYBIRT_X86_SIMD
+
+
+// the vectorized kernels only handle absolute positions
+inline void boris_push(BorisKernelArgs const& args, SimdLevel level)
+{
+#if HYBIRT_X86_SIMD
+    if (args.icell)
+        return boris_push_scalar(args);
+    if (level == SimdLevel::avx512)
+        return boris_push_avx512(args);
+    if (level == SimdLevel::avx2)
+        return boris_push_avx2(args);
+#endif
+    boris_push_scalar(args);
+}
+
+
+// Everything the 2D Boris kernel needs. Fields are stored row-major, y
+// varying fastest, with stride values between two consecutive x indexes.
+struct BorisKernelArgs2D
+{
+    double* position[2]; // x, y
+    double* vx;
+    double* vy;
+    double* vz;
+    std::size_t size;
+
+    // cell relative positions, used instead of position when not null
+    std::int32_t* icell[2] = {nullptr, nullptr};
+    double* delta[2]       = {nullptr, nullptr};
+
+    // field storage in the order Ex, Ey, Ez, Bx, By, Bz
+    double const* fields[6];
+    std::size_t stride[6];
+    // 1 if the component is dual in x, resp. y, 0 if primal
+    int dual[6][2];
+    // second field state and its weight, as in BorisKernelArgs
+    double const* fields_next[6] = {};
+    double weight                = 0.0;
+
+    double half_dt;      // dt/2
+    double cell_size[2]; // dx, dy
+    double qdt2m;        // charge * dt / (2 * mass)
+    int ghost_start;     // first domain cell index, in both directions
+
+    double half_dt_over_d[2]; // dt/(2 dx), dt/(2 dy)
+};
+
+
+// bilinear interpolation of a 2D field at (ix + rx, iy + ry), in primal
+// index units. Dual nodes sit half a cell further, their weights are
+// shifted accordingly. With next, the four nodes are first blended in time
+// with the given weight.
+inline double boris_gather_2d(double const* field, double const* next, double weight,
+                              std::size_t stride, int dual_x, int dual_y, int ix, int iy,
+                              double rx, double ry)
+{
+    int const dual[2] = {dual_x, dual_y};
+    int lo[2]         = {ix, iy};
+    double w[2]       = {rx, ry};
+    for (int d = 0; d < 2; ++d)
+        if (dual[d])
+        {
+            int const left = w[d] < 0.5 ? 1 : 0;
+            lo[d] -= left;
+            w[d] += left ? 0.5 : -0.5;
+        }
+
+    auto const i00 = lo[0] * stride + lo[1];
+    auto const i10 = i00 + stride;
+    auto node      = [&](std::size_t i) {
+        return next ? (1.0 - weight) * field[i] + weight * next[i] : field[i];
+    };
+    return (1.0 - w[0]) * ((1.0 - w[1]) * node(i00) + w[1] * node(i00 + 1))
+           + w[0] * ((1.0 - w[1]) * node(i10) + w[1] * node(i10 + 1));
+}
+
+inline double boris_gather_2d(double const* field, std::size_t stride, int dual_x, int dual_y,
+                              int ix, int iy, double rx, double ry)
+{
+    return boris_gather_2d(field, nullptr, 0.0, stride, dual_x, dual_y, ix, iy, rx, ry);
+}
+
+inline double boris_gather_2d(double const* field, std::size_t stride, int const* dual, int ix,
+                              int iy, double rx, double ry)
+{
+    return boris_gather_2d(field, stride, dual[0], dual[1], ix, iy, rx, ry);
+}
+
+
+inline int dual_mask(BorisKernelArgs2D const& a)
+{
+    int mask = 0;
+    for (int c = 0; c < 6; ++c)
+        for (int d = 0; d < 2; ++d)
+            mask |= a.dual[c][d] << (c * 2 + d);
+    return mask;
+}
+
+template<int duals>
+inline int dual_of(BorisKernelArgs2D const& a, int c, int d)
+{
+    if constexpr (duals == runtime_duals)
+        return a.dual[c][d];
+    else
+        return (duals >> (c * 2 + d)) & 1;
+}
+
+
+// pushes particle ip in place, from absolute or cell relative positions
+template<int duals = runtime_duals>
+inline void boris_push_particle_2d(BorisKernelArgs2D const& a, std::size_t ip)
+{
+    double* const v[2] = {a.vx, a.vy};
+
+    // half step position, as a cell and an offset in [0,1)
+    int cell[2];
+    double reminder[2];
+    double position_half[2];
+    for (int d = 0; d < 2; ++d)
+    {
+        if (a.icell[0])
+        {
+            double const delta_half = a.delta[d][ip] + v[d][ip] * a.half_dt_over_d[d];
+            int const shift         = floor_to_int(delta_half);
+            cell[d]                 = a.icell[d][ip] + shift;
+            reminder[d]             = delta_half - shift;
+        }
+        else
+        {
+            position_half[d] = a.position[d][ip] + v[d][ip] * a.half_dt;
+            double const s   = position_half[d] / a.cell_size[d];
+            cell[d]          = floor_to_int(s);
+            reminder[d]      = s - cell[d];
+        }
+    }
+
+    double field[6];
+    for (int c = 0; c < 6; ++c)
+        field[c] = boris_gather_2d(a.fields[c], a.fields_next[c], a.weight, a.stride[c],
+                                   dual_of<duals>(a, c, 0), dual_of<duals>(a, c, 1),
+                                   cell[0] + a.ghost_start, cell[1] + a.ghost_start, reminder[0],
+                                   reminder[1]);
+
+    double const vx_minus = a.vx[ip] + a.qdt2m * field[0];
+    double const vy_minus = a.vy[ip] + a.qdt2m * field[1];
+    double const vz_minus = a.vz[ip] + a.qdt2m * field[2];
+
+    double const tx = a.qdt2m * field[3];
+    double const ty = a.qdt2m * field[4];
+    double const tz = a.qdt2m * field[5];
+
+    double const vx_prime = vx_minus + vy_minus * tz - vz_minus * ty;
+    double const vy_prime = vy_minus + vz_minus * tx - vx_minus * tz;
+    double const vz_prime = vz_minus + vx_minus * ty - vy_minus * tx;
+
+    double const s_factor = 2.0 / (1.0 + (tx * tx + ty * ty + tz * tz));
+    double const sx       = tx * s_factor;
+    double const sy       = ty * s_factor;
+    double const sz       = tz * s_factor;
+
+    double const vx_plus = vx_minus + vy_prime * sz - vz_prime * sy;
+    double const vy_plus = vy_minus + vz_prime * sx - vx_prime * sz;
+    double const vz_plus = vz_minus + vx_prime * sy - vy_prime * sx;
+
+    a.vx[ip] = vx_plus + a.qdt2m * field[0];
+    a.vy[ip] = vy_plus + a.qdt2m * field[1];
+    a.vz[ip] = vz_plus + a.qdt2m * field[2];
+
+    for (int d = 0; d < 2; ++d)
+    {
+        if (a.icell[0])
+        {
+            double const delta_new = reminder[d] + v[d][ip] * a.half_dt_over_d[d];
+            a.icell[d][ip]         = cell[d] + split_offset(delta_new, a.delta[d][ip]);
+        }
+        else
+            a.position[d][ip] = position_half[d] + v[d][ip] * a.half_dt;
+    }
+}
+
+
+template<int duals>
+inline void boris_push_2d(BorisKernelArgs2D const& a)
+{
+    for (std::size_t ip = 0; ip < a.size; ++ip)
+        boris_push_particle_2d<duals>(a, ip);
+}
+
+inline void boris_push_2d(BorisKernelArgs2D const& a)
+{
+    if (dual_mask(a) == yee_duals<2>())
+        boris_push_2d<yee_duals<2>()>(a);
+    else
+        boris_push_2d<runtime_duals>(a);
+}
+
+
+#endif // HYBIRT_BORIS_KERNELS_HPP
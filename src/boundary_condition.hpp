@@ -10,6 +10,45 @@
 #include <string>
 #include <stdexcept>
 #include <cmath>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#if HYBIRT_HAVE_MPI
+#include "mpi_decomposition.hpp"
+
+#include <mpi.h>
+#endif
+
+
+// -1 if particle i is left of the domain of grid, 1 if right of it, 0 inside
+template<std::size_t dimension>
+int exit_side(GridLayout<dimension> const& grid, ParticleArray<dimension> const& particles,
+              std::size_t i)
+{
+    if (particles.cell_relative())
+    {
+        auto const cell = particles.icell(Direction::X)[i];
+        if (cell < 0)
+            return -1;
+        return cell >= static_cast<std::int32_t>(grid.nbr_cells(Direction::X)) ? 1 : 0;
+    }
+    auto const x = particles.position(Direction::X)[i];
+    if (x < 0.0)
+        return -1;
+    return x >= grid.dom_size(Direction::X) ? 1 : 0;
+}
+
+// moves particle i by nbr_cells cells along x
+template<std::size_t dimension>
+void shift_particle(GridLayout<dimension> const& grid, ParticleArray<dimension>& particles,
+                    std::size_t i, int nbr_cells)
+{
+    if (particles.cell_relative())
+        particles.icell(Direction::X)[i] += nbr_cells;
+    else
+        particles.position(Direction::X)[i] += nbr_cells * grid.cell_size(Direction::X);
+}
 
 
 template<std::size_t dimension>
@@ -25,14 +64,14 @@ public:
 
     virtual void fill(Field<dimension>& field) = 0;
 
-    void fill(VecField<dimension>& vecfield)
+    virtual void fill(VecField<dimension>& vecfield)
     {
         fill(vecfield.x);
         fill(vecfield.y);
         fill(vecfield.z);
     }
 
-    virtual void particles(std::vector<Particle<dimension>>& particles) = 0;
+    virtual void particles(ParticleArray<dimension>& particles) = 0;
 
 protected:
     std::shared_ptr<GridLayout<dimension>> m_grid;
@@ -48,81 +87,79 @@ public:
     {
     }
 
+    // the quantity of a field is only known at run time: it picks the fill
+    // of that quantity once, whose bounds are then compile time centerings
     void fill(Field<dimension>& field) override
     {
         if constexpr (dimension == 1)
         {
-            // left side
-            auto gsi = this->m_grid->ghost_start(field.quantity(), Direction::X);
-            auto dsi = this->m_grid->dom_start(field.quantity(), Direction::X);
-            auto dei = this->m_grid->dom_end(field.quantity(), Direction::X);
-            auto gei = this->m_grid->ghost_end(field.quantity(), Direction::X);
-
-            auto const nbr_nodes = this->m_grid->nbr_cells(Direction::X);
-
-            if (field.quantity() == Quantity::N or field.quantity() == Quantity::Vx
-                or field.quantity() == Quantity::Vy or field.quantity() == Quantity::Vz)
-            {
-                for (auto ix_left = gsi; ix_left <= dsi; ++ix_left)
-                {
-                    auto const ix_right = ix_left + nbr_nodes;
-                    field(ix_left) += field(ix_right);
-                }
-
-                for (auto ix_right = gei; ix_right > dei; --ix_right)
-                {
-                    auto const ix_left = ix_right - nbr_nodes;
-                    field(ix_right) += field(ix_left);
-                }
-                field(dei) = field(dsi);
-            }
-            else
+            switch (field.quantity())
             {
-                for (auto ix_left = gsi; ix_left < dsi; ++ix_left)
-                {
-                    auto const ix_right = ix_left + nbr_nodes;
-                    field(ix_left)      = field(ix_right);
-                }
-
-                // std::cout << "Filling right side\n";
-                for (auto ix_right = gei; ix_right > dei; --ix_right)
-                {
-                    auto const ix_left = ix_right - nbr_nodes;
-                    field(ix_right)    = field(ix_left);
-                }
+                case Quantity::Ex: fill_1d<Quantity::Ex>(field); break;
+                case Quantity::Ey: fill_1d<Quantity::Ey>(field); break;
+                case Quantity::Ez: fill_1d<Quantity::Ez>(field); break;
+                case Quantity::Bx: fill_1d<Quantity::Bx>(field); break;
+                case Quantity::By: fill_1d<Quantity::By>(field); break;
+                case Quantity::Bz: fill_1d<Quantity::Bz>(field); break;
+                case Quantity::Jx: fill_1d<Quantity::Jx>(field); break;
+                case Quantity::Jy: fill_1d<Quantity::Jy>(field); break;
+                case Quantity::Jz: fill_1d<Quantity::Jz>(field); break;
+                case Quantity::N: fill_1d<Quantity::N>(field); break;
+                case Quantity::V: fill_1d<Quantity::V>(field); break;
+                case Quantity::Vx: fill_1d<Quantity::Vx>(field); break;
+                case Quantity::Vy: fill_1d<Quantity::Vy>(field); break;
+                case Quantity::Vz: fill_1d<Quantity::Vz>(field); break;
+                default: throw std::runtime_error{"Unknown quantity"};
             }
         }
     }
 
-    void particles(std::vector<Particle<dimension>>& particles) override
+    void particles(ParticleArray<dimension>& particles) override
     {
         if constexpr (dimension == 1)
         {
-            for (auto& particle : particles)
+            if (particles.cell_relative())
+            {
+                auto const nbr_cells
+                    = static_cast<std::int32_t>(this->m_grid->nbr_cells(Direction::X));
+                for (auto& cell : particles.icell(Direction::X))
+                {
+                    if (cell >= nbr_cells)
+                        cell -= nbr_cells;
+                    else if (cell < 0)
+                        cell += nbr_cells;
+
+                    if (cell < 0 or cell >= nbr_cells)
+                        throw std::runtime_error(
+                            "Particle cell out of bounds after periodic BC");
+                }
+                return;
+            }
+
+            auto& xs = particles.position(Direction::X);
+            for (auto& x : xs)
             {
-                double cell
-                    = std::floor(particle.position[0] / this->m_grid->cell_size(Direction::X))
-                      + this->m_grid->dual_dom_start(Direction::X);
+                double cell = std::floor(x / this->m_grid->cell_size(Direction::X))
+                              + this->m_grid->dual_dom_start(Direction::X);
                 auto cell_save     = cell;
-                auto position_save = particle.position[0];
+                auto position_save = x;
 
                 // particles left the right border injected on left side
                 if (cell > this->m_grid->dual_dom_end(Direction::X))
                 {
-                    particle.position[0] -= this->m_grid->dom_size(Direction::X);
+                    x -= this->m_grid->dom_size(Direction::X);
                 }
                 // particles left the left border injected on right side
                 else if (cell < this->m_grid->dual_dom_start(Direction::X))
                 {
                     // Wrap around to the right side
-                    particle.position[0] += this->m_grid->dom_size(Direction::X);
+                    x += this->m_grid->dom_size(Direction::X);
                 }
 
-                if (particle.position[0] < 0.0
-                    or particle.position[0] >= this->m_grid->dom_size(Direction::X))
+                if (x < 0.0 or x >= this->m_grid->dom_size(Direction::X))
                 {
                     std::cout << "Particle position out of bounds after periodic BC: "
-                              << particle.position[0] << " cell: " << cell
+                              << x << " cell: " << cell
                               << " cell_save: " << cell_save << " position_save: " << position_save
                               << " dom_size: " << this->m_grid->dom_size(Direction::X) << "\n";
                     throw std::runtime_error("Particle position out of bounds after periodic BC");
@@ -130,8 +167,283 @@ public:
             }
         }
     }
+
+private:
+    template<Quantity qty>
+    void fill_1d(Field<dimension>& field)
+    {
+        auto const& grid = *this->m_grid;
+
+        // left side
+        std::size_t const gsi = 0;
+        auto const dsi        = grid.template dom_start<qty>();
+        auto const dei        = grid.template dom_end<qty>(Direction::X);
+        auto const gei        = grid.template ghost_end<qty>(Direction::X);
+
+        auto const nbr_nodes = grid.nbr_cells(Direction::X);
+
+        if constexpr (qty == Quantity::N or qty == Quantity::Vx or qty == Quantity::Vy
+                      or qty == Quantity::Vz)
+        {
+            for (auto ix_left = gsi; ix_left <= dsi; ++ix_left)
+            {
+                auto const ix_right = ix_left + nbr_nodes;
+                field(ix_left) += field(ix_right);
+            }
+
+            for (auto ix_right = gei; ix_right > dei; --ix_right)
+            {
+                auto const ix_left = ix_right - nbr_nodes;
+                field(ix_right) += field(ix_left);
+            }
+            field(dei) = field(dsi);
+        }
+        else
+        {
+            for (auto ix_left = gsi; ix_left < dsi; ++ix_left)
+            {
+                auto const ix_right = ix_left + nbr_nodes;
+                field(ix_left)      = field(ix_right);
+            }
+
+            for (auto ix_right = gei; ix_right > dei; --ix_right)
+            {
+                auto const ix_left = ix_right - nbr_nodes;
+                field(ix_right)    = field(ix_left);
+            }
+        }
+    }
+};
+
+
+#if HYBIRT_HAVE_MPI
+
+// Fills the ghosts and moves the particles at the edges of the subdomain of
+// an MpiDecomposition rank by exchanging with the neighbouring ranks. The
+// ghost exchange is non-blocking: begin_fill() posts it and end_fill()
+// completes all those in flight, so that other work can run in between.
+template<std::size_t dimension>
+class RemoteBoundaryCondition : public BoundaryCondition<dimension>
+{
+public:
+    RemoteBoundaryCondition(std::shared_ptr<GridLayout<dimension>> const& grid,
+                            MpiDecomposition const& decomposition)
+        : BoundaryCondition<dimension>(grid)
+        , m_decomposition{decomposition}
+    {
+        static_assert(dimension == 1, "RemoteBoundaryCondition only implemented for 1D");
+    }
+
+    void fill(Field<dimension>& field) override
+    {
+        begin_fill(field, field);
+        end_fill();
+    }
+
+    void fill(VecField<dimension>& vecfield) override
+    {
+        begin_fill(vecfield.x, vecfield.x);
+        begin_fill(vecfield.y, vecfield.y);
+        begin_fill(vecfield.z, vecfield.z);
+        end_fill();
+    }
+
+    // posts the exchange of a field of the subdomain, whose left edge is in
+    // first and right edge in last: the fields of the leftmost and rightmost
+    // patches, or twice the same field. Moments (N, Vx, Vy, Vz) also send
+    // their shared edge node, which both sides sum.
+    void begin_fill(Field<dimension>& first, Field<dimension>& last)
+    {
+        auto const g        = this->m_grid->nbr_ghosts();
+        auto const quantity = first.quantity();
+        int const primal
+            = this->m_grid->centerings(quantity)[0] == GridLayout<dimension>::primal ? 1 : 0;
+        auto const dsi = g;
+        auto const dei = last.size() - 1 - g;
+
+        auto& exchange  = m_exchanges.emplace_back();
+        exchange.first  = &first;
+        exchange.last   = &last;
+        exchange.moment = quantity == Quantity::N or quantity == Quantity::Vx
+                          or quantity == Quantity::Vy or quantity == Quantity::Vz;
+        for (auto* buffer : {&exchange.to_left, &exchange.to_right, &exchange.from_left,
+                             &exchange.from_right})
+            buffer->resize(g + 1);
+
+        // what the neighbours copy into their ghosts, then the shared node
+        for (std::size_t k = 0; k < g; ++k)
+        {
+            exchange.to_left[k]  = first(dsi + primal + k);
+            exchange.to_right[k] = last(dei - g + 1 - primal + k);
+        }
+        exchange.to_left[g]  = first(dsi);
+        exchange.to_right[g] = last(dei);
+
+        // a message travelling right has an even tag, left an odd one
+        int const tag   = 2 * static_cast<int>(m_exchanges.size() - 1);
+        int const count = static_cast<int>(g + 1);
+        auto const comm = m_decomposition.comm();
+        auto* requests  = exchange.requests.data();
+        MPI_Irecv(exchange.from_left.data(), count, MPI_DOUBLE, m_decomposition.left(), tag, comm,
+                  &requests[0]);
+        MPI_Irecv(exchange.from_right.data(), count, MPI_DOUBLE, m_decomposition.right(), tag + 1,
+                  comm, &requests[1]);
+        MPI_Isend(exchange.to_right.data(), count, MPI_DOUBLE, m_decomposition.right(), tag, comm,
+                  &requests[2]);
+        MPI_Isend(exchange.to_left.data(), count, MPI_DOUBLE, m_decomposition.left(), tag + 1,
+                  comm, &requests[3]);
+    }
+
+    void end_fill()
+    {
+        auto const g = this->m_grid->nbr_ghosts();
+        for (auto& exchange : m_exchanges)
+        {
+            MPI_Waitall(4, exchange.requests.data(), MPI_STATUSES_IGNORE);
+
+            auto& first    = *exchange.first;
+            auto& last     = *exchange.last;
+            auto const dei = last.size() - 1 - g;
+            for (std::size_t k = 0; k < g; ++k)
+            {
+                first(k)          = exchange.from_left[k];
+                last(dei + 1 + k) = exchange.from_right[k];
+            }
+            // own + neighbour on both sides, the same sum
+            if (exchange.moment)
+            {
+                first(g) += exchange.from_left[g];
+                last(dei) += exchange.from_right[g];
+            }
+        }
+        m_exchanges.clear();
+    }
+
+    void particles(ParticleArray<dimension>& particles) override
+    {
+        auto const& grid     = *this->m_grid;
+        auto const nbr_cells = static_cast<int>(grid.nbr_cells(Direction::X));
+        if (m_to_left.cell_relative() != particles.cell_relative())
+        {
+            m_to_left    = particles.empty_like();
+            m_to_right   = particles.empty_like();
+            m_from_left  = particles.empty_like();
+            m_from_right = particles.empty_like();
+        }
+        m_to_left.clear();
+        m_to_right.clear();
+        m_from_left.clear();
+        m_from_right.clear();
+
+        for (auto i = particles.size(); i-- > 0;)
+        {
+            auto const side = exit_side(grid, particles, i);
+            if (side < 0)
+                m_to_left.push_back(particles, i);
+            else if (side > 0)
+            {
+                m_to_right.push_back(particles, i);
+                shift_particle(grid, m_to_right, m_to_right.size() - 1, -nbr_cells);
+            }
+            if (side != 0)
+                particles.swap_remove(i);
+        }
+
+        exchange_particles(m_to_left, m_to_right, m_from_left, m_from_right);
+
+        for (auto const* incoming : {&m_from_left, &m_from_right})
+        {
+            for (std::size_t i = 0; i < incoming->size(); ++i)
+            {
+                particles.push_back(*incoming, i);
+                if (incoming == &m_from_right)
+                    shift_particle(grid, particles, particles.size() - 1, nbr_cells);
+                if (exit_side(grid, particles, particles.size() - 1) != 0)
+                    throw std::runtime_error("Particle crossed more than one subdomain in a step");
+            }
+        }
+    }
+
+    // sends to_left and to_right to the neighbouring ranks and appends what
+    // they sent to from_left and from_right. Particles sent right are
+    // relative to the origin of the right subdomain, particles sent left to
+    // the end of the left subdomain, i.e. negative.
+    void exchange_particles(ParticleArray<dimension> const& to_left,
+                            ParticleArray<dimension> const& to_right,
+                            ParticleArray<dimension>& from_left, ParticleArray<dimension>& from_right)
+    {
+        auto const comm   = m_decomposition.comm();
+        auto const left   = m_decomposition.left();
+        auto const right  = m_decomposition.right();
+        auto const stride = to_left.packed_size();
+
+        auto pack = [stride](ParticleArray<dimension> const& particles, std::vector<double>& buffer) {
+            buffer.resize(particles.size() * stride);
+            for (std::size_t i = 0; i < particles.size(); ++i)
+                particles.pack(i, buffer.data() + i * stride);
+        };
+        pack(to_left, m_send_left);
+        pack(to_right, m_send_right);
+
+        std::array<unsigned long, 2> send_counts{m_send_left.size(), m_send_right.size()};
+        std::array<unsigned long, 2> recv_counts{0, 0};
+        std::array<MPI_Request, 4> requests;
+        MPI_Irecv(&recv_counts[0], 1, MPI_UNSIGNED_LONG, left, particle_tag, comm, &requests[0]);
+        MPI_Irecv(&recv_counts[1], 1, MPI_UNSIGNED_LONG, right, particle_tag + 1, comm,
+                  &requests[1]);
+        MPI_Isend(&send_counts[1], 1, MPI_UNSIGNED_LONG, right, particle_tag, comm, &requests[2]);
+        MPI_Isend(&send_counts[0], 1, MPI_UNSIGNED_LONG, left, particle_tag + 1, comm,
+                  &requests[3]);
+        MPI_Waitall(4, requests.data(), MPI_STATUSES_IGNORE);
+
+        m_recv_left.resize(recv_counts[0]);
+        m_recv_right.resize(recv_counts[1]);
+        MPI_Irecv(m_recv_left.data(), static_cast<int>(m_recv_left.size()), MPI_DOUBLE, left,
+                  particle_tag + 2, comm, &requests[0]);
+        MPI_Irecv(m_recv_right.data(), static_cast<int>(m_recv_right.size()), MPI_DOUBLE, right,
+                  particle_tag + 3, comm, &requests[1]);
+        MPI_Isend(m_send_right.data(), static_cast<int>(m_send_right.size()), MPI_DOUBLE, right,
+                  particle_tag + 2, comm, &requests[2]);
+        MPI_Isend(m_send_left.data(), static_cast<int>(m_send_left.size()), MPI_DOUBLE, left,
+                  particle_tag + 3, comm, &requests[3]);
+        MPI_Waitall(4, requests.data(), MPI_STATUSES_IGNORE);
+
+        for (std::size_t k = 0; k < m_recv_left.size(); k += stride)
+            from_left.push_back_packed(m_recv_left.data() + k);
+        for (std::size_t k = 0; k < m_recv_right.size(); k += stride)
+            from_right.push_back_packed(m_recv_right.data() + k);
+    }
+
+    // smallest value over all the ranks
+    double reduce_min(double value) const
+    {
+        MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_MIN, m_decomposition.comm());
+        return value;
+    }
+
+private:
+    // ghost exchanges start at tag 0, particles use tags above
+    static constexpr int particle_tag = 30000;
+
+    struct Exchange
+    {
+        Field<dimension>* first = nullptr;
+        Field<dimension>* last  = nullptr;
+        bool moment             = false;
+        std::vector<double> to_left, to_right, from_left, from_right;
+        std::array<MPI_Request, 4> requests;
+    };
+
+    MpiDecomposition m_decomposition;
+    std::deque<Exchange> m_exchanges; // stable addresses for MPI buffers
+
+    ParticleArray<dimension> m_to_left, m_to_right, m_from_left, m_from_right;
+    std::vector<double> m_send_left, m_send_right, m_recv_left, m_recv_right;
 };
 
+#endif // HYBIRT_HAVE_MPI
+
+
 
 
 template<std::size_t dimension>
@@ -0,0 +1,327 @@
+#ifndef HYBIRT_CHECKPOINT_HPP
+#define HYBIRT_CHECKPOINT_HPP
+
+#include "field.hpp"
+#include "particle_array.hpp"
+#include "patches.hpp"
+#include "timers.hpp"
+#include "vecfield.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+// Flat binary checkpoint of a PatchedDomain: a CheckpointHeader, then for
+// each patch its E, B, N, V and J fields and, for each population, its
+// particle generator state and particle arrays.
+//
+// Every array is preceded by its number of elements and starts on a 64 bytes
+// boundary. Restarts map the file and copy the arrays straight into the
+// patches, the file is never parsed element by element.
+//
+// Restarts need the same number of patches and populations, and the same
+// subdomain per rank, as the run that wrote the checkpoint.
+
+struct CheckpointHeader
+{
+    static constexpr char magic_value[8] = {'H', 'Y', 'B', 'I', 'R', 'T', 'C', 'K'};
+    static constexpr std::uint32_t current_version = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dimension;
+    std::uint64_t nbr_patches;
+    std::uint64_t nbr_populations;
+    std::uint64_t step;
+    double time;
+    double dt;
+};
+
+
+// time loop state stored along with the domain
+struct CheckpointTime
+{
+    double time      = 0.;
+    double dt        = 0.;
+    std::size_t step = 0;
+};
+
+
+
+class CheckpointWriter
+{
+public:
+    static constexpr std::size_t alignment = 64;
+
+    explicit CheckpointWriter(std::string const& filename)
+        : m_out{filename, std::ios::binary | std::ios::trunc}
+    {
+        if (!m_out)
+            throw std::runtime_error("Cannot write checkpoint " + filename);
+    }
+
+    template<typename T>
+    void write(T const& value)
+    {
+        write_bytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void write_array(T const* data, std::size_t size)
+    {
+        write(static_cast<std::uint64_t>(size));
+        pad();
+        write_bytes(data, size * sizeof(T));
+    }
+
+    std::size_t bytes() const { return m_offset; }
+
+    void close()
+    {
+        m_out.close();
+        if (!m_out)
+            throw std::runtime_error("Failed writing checkpoint");
+    }
+
+private:
+    void write_bytes(void const* data, std::size_t bytes)
+    {
+        m_out.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+        m_offset += bytes;
+    }
+
+    void pad()
+    {
+        static constexpr char zeros[alignment] = {};
+        write_bytes(zeros, (alignment - m_offset % alignment) % alignment);
+    }
+
+    std::ofstream m_out;
+    std::size_t m_offset = 0;
+};
+
+
+
+// reads a file written by CheckpointWriter through a read-only mapping
+class CheckpointReader
+{
+public:
+    static constexpr std::size_t alignment = CheckpointWriter::alignment;
+
+    explicit CheckpointReader(std::string const& filename)
+    {
+        int const fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open checkpoint " + filename);
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+            m_size = static_cast<std::size_t>(st.st_size);
+        if (m_size > 0)
+            m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m_size == 0 or m_data == MAP_FAILED)
+            throw std::runtime_error("Cannot map checkpoint " + filename);
+        ::madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+
+    ~CheckpointReader() { ::munmap(m_data, m_size); }
+
+    CheckpointReader(CheckpointReader const&)            = delete;
+    CheckpointReader& operator=(CheckpointReader const&) = delete;
+
+    template<typename T>
+    T read()
+    {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // number of elements of the next array
+    std::size_t array_size()
+    {
+        auto const offset = m_offset;
+        auto const size   = read<std::uint64_t>();
+        m_offset          = offset;
+        return size;
+    }
+
+    // copies the next array, which must hold size elements, into data
+    template<typename T>
+    void read_array(T* data, std::size_t size)
+    {
+        if (read<std::uint64_t>() != size)
+            throw std::runtime_error("Checkpoint array does not match the simulation");
+        m_offset += (alignment - m_offset % alignment) % alignment;
+        std::memcpy(data, take(size * sizeof(T)), size * sizeof(T));
+    }
+
+private:
+    char const* take(std::size_t bytes)
+    {
+        if (m_offset + bytes > m_size)
+            throw std::runtime_error("Truncated checkpoint");
+        auto const* data = static_cast<char const*>(m_data) + m_offset;
+        m_offset += bytes;
+        return data;
+    }
+
+    void* m_data         = MAP_FAILED;
+    std::size_t m_size   = 0;
+    std::size_t m_offset = 0;
+};
+
+
+
+
+template<std::size_t dimension>
+void write_checkpoint_field(CheckpointWriter& out, Field<dimension> const& field)
+{
+    auto const view = field.view();
+    out.write_array(view.data(), view.size());
+}
+
+template<std::size_t dimension>
+void read_checkpoint_field(CheckpointReader& in, Field<dimension>& field)
+{
+    auto const view = field.view();
+    in.read_array(view.data(), view.size());
+}
+
+
+// writes the state of domain to filename. The file is written under a
+// temporary name and renamed once complete, so that being killed while
+// writing leaves the previous checkpoint intact.
+template<std::size_t dimension>
+void write_checkpoint(std::string const& filename, PatchedDomain<dimension> const& domain,
+                      CheckpointTime const& state)
+{
+    HYBIRT_TIME_SCOPE(Stage::Checkpoint);
+    auto const tmp = filename + ".tmp";
+    CheckpointWriter out{tmp};
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, CheckpointHeader::magic_value, sizeof(header.magic));
+    header.version         = CheckpointHeader::current_version;
+    header.dimension       = dimension;
+    header.nbr_patches     = domain.size();
+    header.nbr_populations = domain.nbr_populations();
+    header.step            = state.step;
+    header.time            = state.time;
+    header.dt              = state.dt;
+    out.write(header);
+
+    for (std::size_t ip = 0; ip < domain.size(); ++ip)
+    {
+        auto const& patch = domain[ip];
+        for (auto const* v : {&patch.E, &patch.B, &patch.V, &patch.J})
+        {
+            write_checkpoint_field(out, v->x);
+            write_checkpoint_field(out, v->y);
+            write_checkpoint_field(out, v->z);
+        }
+        write_checkpoint_field(out, patch.N);
+
+        for (auto const& pop : patch.populations)
+        {
+            std::ostringstream rng;
+            rng << pop.rng();
+            auto const rng_state = rng.str();
+            out.write_array(rng_state.data(), rng_state.size());
+
+            auto const& particles = pop.particles();
+            out.write(static_cast<std::uint32_t>(particles.cell_relative()));
+            out.write(static_cast<std::uint64_t>(particles.size()));
+            particles.for_each_array(
+                [&](auto const& array) { out.write_array(array.data(), array.size()); });
+        }
+    }
+    out.close();
+    HYBIRT_COUNT(Counter::BytesWritten, out.bytes());
+
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Cannot rename checkpoint " + tmp);
+}
+
+
+// restores into domain the state written by write_checkpoint
+template<std::size_t dimension>
+CheckpointTime read_checkpoint(std::string const& filename, PatchedDomain<dimension>& domain)
+{
+    CheckpointReader in{filename};
+
+    auto const header = in.read<CheckpointHeader>();
+    if (std::memcmp(header.magic, CheckpointHeader::magic_value, sizeof(header.magic)) != 0
+        or header.version != CheckpointHeader::current_version)
+        throw std::runtime_error(filename + " is not a checkpoint of this version");
+    if (header.dimension != dimension or header.nbr_patches != domain.size()
+        or header.nbr_populations != domain.nbr_populations())
+        throw std::runtime_error(filename + " does not match the simulation decomposition");
+
+    for (std::size_t ip = 0; ip < domain.size(); ++ip)
+    {
+        auto& patch = domain[ip];
+        for (auto* v : {&patch.E, &patch.B, &patch.V, &patch.J})
+        {
+            read_checkpoint_field(in, v->x);
+            read_checkpoint_field(in, v->y);
+            read_checkpoint_field(in, v->z);
+        }
+        read_checkpoint_field(in, patch.N);
+
+        for (auto& pop : patch.populations)
+        {
+            std::string rng_state(in.array_size(), '\0');
+            in.read_array(rng_state.data(), rng_state.size());
+            std::istringstream{rng_state} >> pop.rng();
+
+            auto& particles          = pop.particles();
+            bool const cell_relative = in.read<std::uint32_t>() != 0;
+            auto const size          = in.read<std::uint64_t>();
+
+            particles.clear();
+            if (cell_relative)
+                pop.use_cell_relative_positions();
+            else
+                particles.to_absolute();
+            particles.resize(size);
+            particles.for_each_array([&](auto& array) { in.read_array(array.data(), size); });
+            pop.rebin();
+        }
+    }
+
+    return {header.time, header.dt, static_cast<std::size_t>(header.step)};
+}
+
+
+
+
+// Set by the SIGTERM handler installed by checkpoint_on_sigterm(), the time
+// loop checks it between steps to checkpoint and stop.
+inline volatile std::sig_atomic_t sigterm_received = 0;
+
+extern "C" inline void hybirt_sigterm_handler(int)
+{
+    sigterm_received = 1;
+}
+
+inline void checkpoint_on_sigterm()
+{
+    std::signal(SIGTERM, hybirt_sigterm_handler);
+}
+
+
+#endif // HYBIRT_CHECKPOINT_HPP
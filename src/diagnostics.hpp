@@ -3,14 +3,22 @@
 
 #include "field.hpp"
 #include "vecfield.hpp"
-#include "particle.hpp"
-#include "population.hpp"
+#include "gridlayout.hpp"
+#include "particle_array.hpp"
+#include "timers.hpp"
 
 #include "highfive/highfive.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
 #include <iomanip>
-#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <vector>
 
 template<typename T>
 auto to_string_fixed_width(T const& value, std::size_t const& precision, std::size_t const& width,
@@ -26,56 +34,306 @@ auto to_string_fixed_width(T const& value, std::size_t const& precision, std::si
 
 
 
-template<std::size_t dim>
-void diags_write_fields(VecField<dim> const& B, VecField<dim> const& E, VecField<dim> const& V,
-                        Field<dim> const& N, double time,
-                        HighFive::File::AccessMode mode = HighFive::File::ReadWrite)
+// Keeps the diagnostics files open for the whole run and appends each
+// snapshot to chunked datasets whose first dimension is time and unlimited.
+//
+// fields<suffix>.h5 holds "time" and one dataset per field, with one row per
+// snapshot covering every node of the field on layout, ghosts included.
+// particles_<name><suffix>.h5 holds "x", "vx", "vy", "vz" with the particles
+// of all snapshots one after the other, "time" and "offset", the index of the
+// first particle of each snapshot.
+//
+// Fields are written straight from their storage, a snapshot can be written
+// piecewise, e.g. one patch at a time.
+//
+// A writer given a resume time, when restarting, appends to the files of the
+// previous run, dropping the snapshots it wrote after that time.
+template<std::size_t dimension>
+class DiagnosticsWriter
 {
-    std::string filename = "fields.h5";
-    HighFive::File file(filename, mode);
-    auto const time_str = to_string_fixed_width(time, 10, 0);
-    file.createDataSet("/t/" + time_str + "/Bx", B.x.data());
-    file.createDataSet("/t/" + time_str + "/By", B.y.data());
-    file.createDataSet("/t/" + time_str + "/Bz", B.z.data());
-    file.createDataSet("/t/" + time_str + "/Ex", E.x.data());
-    file.createDataSet("/t/" + time_str + "/Ey", E.y.data());
-    file.createDataSet("/t/" + time_str + "/Ez", E.z.data());
-    file.createDataSet("/t/" + time_str + "/Vx", V.x.data());
-    file.createDataSet("/t/" + time_str + "/Vy", V.y.data());
-    file.createDataSet("/t/" + time_str + "/Vz", V.z.data());
-    file.createDataSet("/t/" + time_str + "/N", N.data());
-}
+public:
+    // chunks hold about that many bytes
+    static constexpr std::size_t chunk_bytes = 64 * 1024;
 
+    DiagnosticsWriter(std::shared_ptr<GridLayout<dimension>> layout, std::size_t every = 1,
+                      std::string suffix = "", std::optional<double> resume_time = std::nullopt)
+        : m_layout{layout}
+        , m_every{std::max<std::size_t>(every, 1)}
+        , m_suffix{suffix}
+        , m_resume_time{resume_time}
+        , m_fields{open_file("fields" + suffix + ".h5")}
+        , m_time{m_fields.exist("time") ? m_fields.getDataSet("time")
+                                        : create_dataset<double>(m_fields, "time", {})}
+    {
+        m_nbr_snapshots = truncate(m_time);
+    }
 
+    // whether a snapshot is taken at that step
+    bool due(std::size_t step) const { return step % m_every == 0; }
 
-template<std::size_t dim>
-void diags_write_particles(std::vector<Population<dim>> const& populations, double time,
-                           HighFive::File::AccessMode mode = HighFive::File::ReadWrite)
-{
-    for (auto const& pop : populations)
+    std::size_t nbr_snapshots() const { return m_nbr_snapshots; }
+
+    // starts a new snapshot, the writes that follow go to its row
+    void begin_snapshot(double time)
+    {
+        m_current_time = time;
+        append(m_time, &time);
+        ++m_nbr_snapshots;
+    }
+
+    // flushes the snapshot so the files are readable while the run goes on
+    void end_snapshot()
     {
-        std::string filename = "particles_" + pop.name() + ".h5";
-        HighFive::File file(filename, mode);
-
-        std::vector<double> x, y, z, vx, vy, vz;
-        x.reserve(pop.particles().size());
-        vx.reserve(pop.particles().size());
-        vy.reserve(pop.particles().size());
-        vz.reserve(pop.particles().size());
-        for (auto const& particle : pop.particles())
+        HYBIRT_TIME_SCOPE(Stage::Write);
+        m_fields.flush();
+        for (auto& [name, particles] : m_particles)
+            particles.file.flush();
+    }
+
+    // writes nodes [first, last] along x of field, full along the other
+    // directions, at node offset along x of the current row
+    void write_field(std::string const& name, Field<dimension> const& field, std::size_t first,
+                     std::size_t last, std::size_t offset)
+    {
+        HYBIRT_TIME_SCOPE(Stage::Write);
+        auto& dataset    = field_dataset(name, field.quantity());
+        auto const view  = field.view();
+        auto const count = last - first + 1;
+
+        std::size_t stride = 1;
+        for (std::size_t d = 1; d < dimension; ++d)
+            stride *= view.extent(d);
+
+        std::vector<std::size_t> start{m_nbr_snapshots - 1, offset};
+        std::vector<std::size_t> extent{1, count};
+        for (std::size_t d = 1; d < dimension; ++d)
         {
-            x.push_back(particle.position[0]);
-            vx.push_back(particle.v[0]);
-            vy.push_back(particle.v[1]);
-            vz.push_back(particle.v[2]);
+            start.push_back(0);
+            extent.push_back(view.extent(d));
         }
-        auto const time_str = to_string_fixed_width(time, 10, 0);
-        file.createDataSet("/t/" + time_str + "/x", x);
-        file.createDataSet("/t/" + time_str + "/vx", vx);
-        file.createDataSet("/t/" + time_str + "/vy", vy);
-        file.createDataSet("/t/" + time_str + "/vz", vz);
+        dataset.select(start, extent).write_raw(view.data() + first * stride);
+        HYBIRT_COUNT(Counter::BytesWritten, count * stride * sizeof(double));
     }
-}
+
+    // writes all the nodes of a field defined on layout
+    void write_field(std::string const& name, Field<dimension> const& field)
+    {
+        write_field(name, field, 0, field.view().extent(0) - 1, 0);
+    }
+
+    void write_fields(VecField<dimension> const& B, VecField<dimension> const& E,
+                      VecField<dimension> const& V, Field<dimension> const& N)
+    {
+        write_field("Bx", B.x);
+        write_field("By", B.y);
+        write_field("Bz", B.z);
+        write_field("Ex", E.x);
+        write_field("Ey", E.y);
+        write_field("Ez", E.z);
+        write_field("Vx", V.x);
+        write_field("Vy", V.y);
+        write_field("Vz", V.z);
+        write_field("N", N);
+    }
+
+    // appends particles to the current snapshot of population name, position
+    // is added to their x coordinate
+    void write_particles(std::string const& name, ParticleArray<dimension> const& particles,
+                         double position = 0.)
+    {
+        HYBIRT_TIME_SCOPE(Stage::Write);
+        auto& pop = particle_datasets(name);
+        if (pop.nbr_snapshots < m_nbr_snapshots)
+        {
+            unsigned long long offset = pop.size;
+            append(pop.time, &m_current_time);
+            append(pop.offset, &offset);
+            pop.nbr_snapshots = m_nbr_snapshots;
+        }
+
+        auto const count = particles.size();
+        if (count == 0)
+            return;
+        auto const new_size = pop.size + count;
+        auto write = [&](HighFive::DataSet& dataset, double const* data) {
+            dataset.resize({new_size});
+            dataset.select({pop.size}, {count}).write_raw(data);
+        };
+
+        // x is the only component that may need converting
+        if (particles.cell_relative() or position != 0.)
+        {
+            m_scratch.resize(count);
+            for (std::size_t ip = 0; ip < count; ++ip)
+                m_scratch[ip] = particles.absolute_position(Direction::X, ip) + position;
+            write(pop.x, m_scratch.data());
+        }
+        else
+            write(pop.x, particles.position(Direction::X).data());
+        write(pop.vx, particles.v(0).data());
+        write(pop.vy, particles.v(1).data());
+        write(pop.vz, particles.v(2).data());
+        pop.size = new_size;
+        HYBIRT_COUNT(Counter::BytesWritten, 4 * count * sizeof(double));
+    }
+
+private:
+    struct Dataset
+    {
+        HighFive::DataSet dataset;
+        std::size_t rows = 0;
+    };
+
+    struct ParticleDatasets
+    {
+        HighFive::File file;
+        HighFive::DataSet x, vx, vy, vz, time, offset;
+        std::size_t size          = 0;
+        std::size_t nbr_snapshots = 0;
+    };
+
+    // dataset of shape {0, shape...} growing along its first dimension
+    template<typename T>
+    static HighFive::DataSet create_dataset(HighFive::File& file, std::string const& name,
+                                            std::vector<std::size_t> const& shape)
+    {
+        std::size_t row_size = 1;
+        for (auto n : shape)
+            row_size *= n;
+
+        std::vector<std::size_t> dims{0}, max_dims{HighFive::DataSpace::UNLIMITED};
+        std::vector<hsize_t> chunk{std::max<hsize_t>(chunk_bytes / (row_size * sizeof(T)), 1)};
+        for (auto n : shape)
+        {
+            dims.push_back(n);
+            max_dims.push_back(n);
+            chunk.push_back(n);
+        }
+
+        HighFive::DataSetCreateProps props;
+        props.add(HighFive::Chunking(chunk));
+        return file.createDataSet<T>(name, HighFive::DataSpace(dims, max_dims), props);
+    }
+
+    // appends one element to a 1D dataset
+    template<typename T>
+    static void append(HighFive::DataSet& dataset, T const* value)
+    {
+        auto const size = dataset.getDimensions()[0];
+        dataset.resize({size + 1});
+        dataset.select({size}, {1}).write_raw(value);
+    }
+
+    // files are created, unless resuming from existing ones
+    HighFive::File open_file(std::string const& filename) const
+    {
+        if (m_resume_time and std::filesystem::exists(filename))
+            return HighFive::File{filename, HighFive::File::ReadWrite};
+        return HighFive::File{filename, HighFive::File::Truncate};
+    }
+
+    // drops the rows of a time dataset after the resume time, returns the
+    // number of rows left
+    std::size_t truncate(HighFive::DataSet& time) const
+    {
+        std::vector<double> times;
+        time.read(times);
+        if (!m_resume_time)
+            return times.size();
+        auto const nbr_rows = static_cast<std::size_t>(
+            std::upper_bound(times.begin(), times.end(), *m_resume_time) - times.begin());
+        time.resize({nbr_rows});
+        return nbr_rows;
+    }
+
+    // dataset of the field, grown to the current snapshot
+    HighFive::DataSet& field_dataset(std::string const& name, Quantity qty)
+    {
+        auto it = m_datasets.find(name);
+        if (it == m_datasets.end() and m_fields.exist(name))
+        {
+            auto dataset = m_fields.getDataSet(name);
+            auto dims    = dataset.getDimensions();
+            dims[0]      = m_nbr_snapshots;
+            dataset.resize(dims);
+            it = m_datasets.emplace(name, Dataset{dataset, m_nbr_snapshots}).first;
+        }
+        else if (it == m_datasets.end())
+        {
+            auto const shape = m_layout->allocate(qty);
+            auto dataset     = create_dataset<double>(
+                m_fields, name, std::vector<std::size_t>(shape.begin(), shape.end()));
+            it = m_datasets.emplace(name, Dataset{dataset, 0}).first;
+        }
+
+        auto& [dataset, rows] = it->second;
+        if (rows < m_nbr_snapshots)
+        {
+            auto dims = dataset.getDimensions();
+            dims[0]   = m_nbr_snapshots;
+            dataset.resize(dims);
+            rows = m_nbr_snapshots;
+        }
+        return dataset;
+    }
+
+    ParticleDatasets& particle_datasets(std::string const& name)
+    {
+        auto it = m_particles.find(name);
+        if (it == m_particles.end() and m_resume_time)
+        {
+            auto file = open_file("particles_" + name + m_suffix + ".h5");
+            if (file.exist("time"))
+            {
+                ParticleDatasets pop{file,
+                                     file.getDataSet("x"),
+                                     file.getDataSet("vx"),
+                                     file.getDataSet("vy"),
+                                     file.getDataSet("vz"),
+                                     file.getDataSet("time"),
+                                     file.getDataSet("offset")};
+                auto const nbr_snapshots = truncate(pop.time);
+                std::vector<unsigned long long> offsets;
+                pop.offset.read(offsets);
+                pop.size = nbr_snapshots < offsets.size() ? offsets[nbr_snapshots]
+                                                          : pop.x.getDimensions()[0];
+                pop.offset.resize({nbr_snapshots});
+                for (auto* dataset : {&pop.x, &pop.vx, &pop.vy, &pop.vz})
+                    dataset->resize({pop.size});
+                pop.nbr_snapshots = nbr_snapshots;
+                it                = m_particles.emplace(name, pop).first;
+            }
+        }
+        if (it == m_particles.end())
+        {
+            HighFive::File file{"particles_" + name + m_suffix + ".h5", HighFive::File::Truncate};
+            auto x      = create_dataset<double>(file, "x", {});
+            auto vx     = create_dataset<double>(file, "vx", {});
+            auto vy     = create_dataset<double>(file, "vy", {});
+            auto vz     = create_dataset<double>(file, "vz", {});
+            auto time   = create_dataset<double>(file, "time", {});
+            auto offset = create_dataset<unsigned long long>(file, "offset", {});
+            it          = m_particles
+                     .emplace(name, ParticleDatasets{file, x, vx, vy, vz, time, offset})
+                     .first;
+        }
+        return it->second;
+    }
+
+    std::shared_ptr<GridLayout<dimension>> m_layout;
+    std::size_t m_every;
+    std::string m_suffix;
+    std::optional<double> m_resume_time;
+
+    HighFive::File m_fields;
+    HighFive::DataSet m_time;
+    std::map<std::string, Dataset> m_datasets;
+    std::map<std::string, ParticleDatasets> m_particles;
+
+    std::size_t m_nbr_snapshots = 0;
+    double m_current_time       = 0.;
+    std::vector<double> m_scratch;
+};
 
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "vecfield.hpp"
 #include "gridlayout.hpp"
+#include "tiling.hpp"
 #include "utils.hpp"
 
 #include <cstddef>
@@ -22,7 +23,10 @@ public:
             throw std::runtime_error("GridLayout is null");
     }
 
-    void operator()(VecField<dimension> const& E, VecField<dimension>& B, VecField<dimension>& Bnew)
+    // E is a VecField or a BlendedVecField, anything with components read
+    // as E.x(ix...)
+    template<typename EField>
+    void operator()(EField const& E, VecField<dimension>& B, VecField<dimension>& Bnew)
     {
         auto const dx = m_grid->cell_size(Direction::X);
 
@@ -52,13 +56,88 @@ public:
                 Bz(ix) = B.z(ix) - (Ey(ix + 1) - Ey(ix))*m_dt/dx;
             }
         }
+        else if constexpr (dimension == 2)
+        {
+            // Bx (primal, dual), By (dual, primal), Bz (dual, dual). Inner
+            // loops run along y, contiguous in memory.
+            auto const dy    = m_grid->cell_size(Direction::Y);
+            auto const dt_dx = m_dt / dx;
+            auto const dt_dy = m_dt / dy;
+
+            for (auto ix = m_grid->dom_start(Quantity::Bx, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Bx, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Bx, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Bx, Direction::Y); iy <= iy_end; ++iy)
+                    Bnew.x(ix, iy) = B.x(ix, iy) - (E.z(ix, iy + 1) - E.z(ix, iy)) * dt_dy;
+            }
+
+            for (auto ix = m_grid->dom_start(Quantity::By, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::By, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::By, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::By, Direction::Y); iy <= iy_end; ++iy)
+                    Bnew.y(ix, iy) = B.y(ix, iy) + (E.z(ix + 1, iy) - E.z(ix, iy)) * dt_dx;
+            }
+
+            for (auto ix = m_grid->dom_start(Quantity::Bz, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Bz, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Bz, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Bz, Direction::Y); iy <= iy_end; ++iy)
+                    Bnew.z(ix, iy) = B.z(ix, iy) - (E.y(ix + 1, iy) - E.y(ix, iy)) * dt_dx
+                                     + (E.x(ix, iy + 1) - E.x(ix, iy)) * dt_dy;
+            }
+        }
+        else if constexpr (dimension == 3)
+        {
+            // Bx (primal, dual, dual), By (dual, primal, dual), Bz (dual, dual,
+            // primal), the three updated tile by tile
+            auto const dt_dx = m_dt / dx;
+            auto const dt_dy = m_dt / m_grid->cell_size(Direction::Y);
+            auto const dt_dz = m_dt / m_grid->cell_size(Direction::Z);
+
+            auto const bx = dom_box<Quantity::Bx>(*m_grid);
+            auto const by = dom_box<Quantity::By>(*m_grid);
+            auto const bz = dom_box<Quantity::Bz>(*m_grid);
+
+            for_each_tile(hull(hull(bx, by), bz), m_tiles, [&](IndexBox const& tile) {
+                sweep(bx, tile, [&](auto ix, auto iy, auto iz) {
+                    Bnew.x(ix, iy, iz) = B.x(ix, iy, iz)
+                                         - (E.z(ix, iy + 1, iz) - E.z(ix, iy, iz)) * dt_dy
+                                         + (E.y(ix, iy, iz + 1) - E.y(ix, iy, iz)) * dt_dz;
+                });
+                sweep(by, tile, [&](auto ix, auto iy, auto iz) {
+                    Bnew.y(ix, iy, iz) = B.y(ix, iy, iz)
+                                         - (E.x(ix, iy, iz + 1) - E.x(ix, iy, iz)) * dt_dz
+                                         + (E.z(ix + 1, iy, iz) - E.z(ix, iy, iz)) * dt_dx;
+                });
+                sweep(bz, tile, [&](auto ix, auto iy, auto iz) {
+                    Bnew.z(ix, iy, iz) = B.z(ix, iy, iz)
+                                         - (E.y(ix + 1, iy, iz) - E.y(ix, iy, iz)) * dt_dx
+                                         + (E.x(ix, iy + 1, iz) - E.x(ix, iy, iz)) * dt_dy;
+                });
+            });
+        }
         else
             throw std::runtime_error("Faraday not implemented for this dimension");
     }
 
+    // field subcycling advances B over a fraction of the particle time step
+    double dt() const { return m_dt; }
+    void dt(double dt) { m_dt = dt; }
+
+    // cache blocking of the 3D sweeps
+    Tiles const& tiles() const { return m_tiles; }
+    void tiles(Tiles tiles) { m_tiles = tiles; }
+
 private:
     std::shared_ptr<GridLayout<dimension>> m_grid;
     double m_dt;
+    Tiles m_tiles;
 };
 
 #endif // HYBRIDIR_FARADAY_HPP
@@ -2,6 +2,7 @@
 #define HYBRIDIR_FIELD_HPP
 
 #include "gridlayout.hpp"
+#include "field_view.hpp"
 
 #include <cstddef>
 #include <vector>
@@ -21,28 +22,27 @@ public:
     }
 
 
+    // row-major: the last index is the fastest varying, with unit stride,
+    // so loops over it run over contiguous memory
     template<typename... Indexes>
     double& operator()(Indexes... ijk)
     {
-        auto indexes = std::forward_as_tuple(ijk...);
-
-        if constexpr (dimension == 1)
-        {
-            auto index = std::get<0>(indexes);
-            return m_data[index];
-        }
+        return m_data[linear(ijk...)];
     }
 
     template<typename... Indexes>
     double const& operator()(Indexes... ijk) const
     {
-        auto indexes = std::forward_as_tuple(ijk...);
+        return m_data[linear(ijk...)];
+    }
 
-        if constexpr (dimension == 1)
-        {
-            auto index = std::get<0>(indexes);
-            return m_data[index];
-        }
+    // distance in memory between two nodes one index apart in direction dir
+    std::size_t stride(std::size_t dir) const
+    {
+        std::size_t s = 1;
+        for (auto d = dir + 1; d < dimension; ++d)
+            s *= m_size[d];
+        return s;
     }
 
 
@@ -53,10 +53,30 @@ public:
 
     auto quantity() const { return m_qty; }
 
-    auto data() { return m_data; }
-    auto data() const { return m_data; }
+    auto& data() { return m_data; }
+    auto const& data() const { return m_data; }
+
+    auto size() const { return m_data.size(); }
+    auto const& shape() const { return m_size; }
+
+    FieldView<dimension, double> view() { return {m_data.data(), m_size}; }
+    FieldView<dimension, double const> view() const { return {m_data.data(), m_size}; }
 
 private:
+    template<typename... Indexes>
+    std::size_t linear(Indexes... ijk) const
+    {
+        static_assert(sizeof...(Indexes) == dimension, "wrong number of indexes");
+        auto const idx = std::array<std::size_t, dimension>{static_cast<std::size_t>(ijk)...};
+
+        if constexpr (dimension == 1)
+            return idx[0];
+        else if constexpr (dimension == 2)
+            return idx[0] * m_size[1] + idx[1];
+        else
+            return (idx[0] * m_size[1] + idx[1]) * m_size[2] + idx[2];
+    }
+
     std::array<std::size_t, dimension> m_size;
     std::vector<double> m_data;
     Quantity m_qty;
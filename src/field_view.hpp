@@ -0,0 +1,72 @@
+#ifndef HYBIRT_FIELD_VIEW_HPP
+#define HYBIRT_FIELD_VIEW_HPP
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+
+// Non-owning view over the contiguous storage of a Field.
+// T is double for a mutable view and double const for a read-only one.
+// Storage is row-major: the last index is the fastest varying.
+template<std::size_t dimension, typename T>
+class FieldView
+{
+public:
+    using value_type = std::remove_const_t<T>;
+
+    FieldView(T* data, std::array<std::size_t, dimension> shape)
+        : m_data{data}
+        , m_shape{shape}
+    {
+    }
+
+    // a mutable view converts to a read-only one
+    operator FieldView<dimension, value_type const>() const { return {m_data, m_shape}; }
+
+    template<typename... Indexes>
+    T& operator()(Indexes... ijk) const
+    {
+        static_assert(sizeof...(Indexes) == dimension, "wrong number of indexes");
+        auto const idx = std::array<std::size_t, dimension>{static_cast<std::size_t>(ijk)...};
+
+        std::size_t linear = idx[0];
+        for (std::size_t d = 1; d < dimension; ++d)
+            linear = linear * m_shape[d] + idx[d];
+        return m_data[linear];
+    }
+
+    // flat access, ignores the multi-dimensional shape
+    T& operator[](std::size_t i) const { return m_data[i]; }
+
+    T* data() const { return m_data; }
+    auto const& shape() const { return m_shape; }
+    auto extent(std::size_t dir) const { return m_shape[dir]; }
+
+    std::size_t size() const
+    {
+        std::size_t s = 1;
+        for (auto n : m_shape)
+            s *= n;
+        return s;
+    }
+
+    T* begin() const { return m_data; }
+    T* end() const { return m_data + size(); }
+
+private:
+    T* m_data;
+    std::array<std::size_t, dimension> m_shape;
+};
+
+
+template<std::size_t dimension, typename T>
+struct VecFieldView
+{
+    FieldView<dimension, T> x;
+    FieldView<dimension, T> y;
+    FieldView<dimension, T> z;
+};
+
+
+#endif // HYBIRT_FIELD_VIEW_HPP
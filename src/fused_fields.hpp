@@ -0,0 +1,156 @@
+#ifndef HYBIRT_FUSED_FIELDS_HPP
+#define HYBIRT_FUSED_FIELDS_HPP
+
+#include "field.hpp"
+#include "gridlayout.hpp"
+#include "utils.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+
+// Faraday, Ampere and Ohm in a single sweep. The grid is cut into blocks
+// small enough to stay in cache; in each block Bnew is computed, then J one
+// node behind it, then Enew one more node behind, so the stencil neighbours
+// each step reads were just written by the previous one.
+//
+// Bnew is computed on every node, ghosts included, from the ghosts of E and
+// B, and J on every node the ghosts of Bnew give. These are the numbers a
+// ghost fill would copy, so only Enew needs its ghosts filled afterwards,
+// where Faraday, Ampere and Ohm called in turn need a fill after each. The
+// outermost ghost node of Jy and Jz is left as is.
+template<std::size_t dimension>
+class FusedFieldSolver
+{
+public:
+    static constexpr std::size_t default_block = 512;
+
+    FusedFieldSolver(std::shared_ptr<GridLayout<dimension>> grid, double dt)
+        : m_grid{grid}
+        , m_dt{dt}
+    {
+        if (!m_grid)
+            throw std::runtime_error("GridLayout is null");
+        if (m_grid->nbr_ghosts() < 1)
+            throw std::runtime_error("FusedFieldSolver needs at least one ghost node");
+    }
+
+    // E is a VecField or a BlendedVecField, which may blend in Enew itself:
+    // every node of Enew is read by Faraday before Ohm overwrites it
+    template<typename EField>
+    void operator()(EField const& E, VecField<dimension> const& B,
+                    Field<dimension> const& N, VecField<dimension> const& V,
+                    VecField<dimension>& Bnew, VecField<dimension>& J, VecField<dimension>& Enew)
+    {
+        if constexpr (dimension == 1)
+        {
+            auto const dx     = m_grid->cell_size(Direction::X);
+            auto const nbr_d  = Bnew.y.size(); // dual nodes, ghosts included
+            auto const nbr_p  = Bnew.x.size(); // primal nodes
+            auto const d_from = m_grid->dual_dom_start(Direction::X);
+            auto const d_to   = m_grid->dual_dom_end(Direction::X) + 1;
+            auto const p_from = m_grid->primal_dom_start(Direction::X);
+            auto const p_to   = m_grid->primal_dom_end(Direction::X) + 1;
+
+            for (std::size_t first = 0; first < nbr_p; first += m_block)
+            {
+                auto const last      = std::min(first + m_block, nbr_p);
+                auto const last_dual = std::min(last, nbr_d);
+
+                // Faraday, Bx primal, By and Bz dual
+                for (auto ix = first; ix < last; ++ix)
+                    Bnew.x(ix) = B.x(ix);
+                HYBIRT_IVDEP
+                for (auto ix = first; ix < last_dual; ++ix)
+                {
+                    Bnew.y(ix) = B.y(ix) + (E.z(ix + 1) - E.z(ix)) * m_dt / dx;
+                    Bnew.z(ix) = B.z(ix) - (E.y(ix + 1) - E.y(ix)) * m_dt / dx;
+                }
+
+                // Ampere, Jx dual, Jy and Jz primal from the dual Bnew on
+                // either side
+                for (auto ix = first; ix < last_dual; ++ix)
+                    J.x(ix) = 0.0;
+                HYBIRT_IVDEP
+                for (auto ix = std::max<std::size_t>(first, 1); ix < last_dual; ++ix)
+                {
+                    J.y(ix) = -(Bnew.z(ix) - Bnew.z(ix - 1)) / dx;
+                    J.z(ix) = (Bnew.y(ix) - Bnew.y(ix - 1)) / dx;
+                }
+
+                // Ohm on the domain nodes, Ey and Ez primal, Ex dual one
+                // node behind since it needs J on its right
+                auto const p_last = std::min(last, p_to);
+                HYBIRT_IVDEP
+                for (auto ix = std::max(first, p_from); ix < p_last; ++ix)
+                    ohm_primal(J, N, V, Bnew, Enew, ix);
+                auto const d_last = std::min(last - 1, d_to);
+                HYBIRT_IVDEP
+                for (auto ix = std::max(first, d_from + 1) - 1; ix < d_last; ++ix)
+                    ohm_dual(J, N, V, Bnew, Enew, ix);
+            }
+        }
+        else
+            throw std::runtime_error("FusedFieldSolver not implemented for this dimension");
+    }
+
+    // time step of the Faraday part, field subcycling shortens it
+    double dt() const { return m_dt; }
+    void dt(double dt) { m_dt = dt; }
+
+    // nodes per block, the fields of a block should fit in cache
+    std::size_t block() const { return m_block; }
+    void block(std::size_t nodes)
+    {
+        if (nodes == 0)
+            throw std::runtime_error("FusedFieldSolver blocks need at least one node");
+        m_block = nodes;
+    }
+
+private:
+    // same arithmetic as Ohm, so that the fused and the separate solvers
+    // give the same fields
+    static void ohm_dual(VecField<dimension> const& J, Field<dimension> const& N,
+                         VecField<dimension> const& V, VecField<dimension> const& B,
+                         VecField<dimension>& Enew, std::size_t ix)
+    {
+        auto const Vy_dual = 0.5 * (V.y(ix + 1) + V.y(ix));
+        auto const Vz_dual = 0.5 * (V.z(ix + 1) + V.z(ix));
+        auto const N_dual  = 0.5 * (N(ix + 1) + N(ix));
+        auto const Jy_dual = 0.5 * (J.y(ix + 1) + J.y(ix));
+        auto const Jz_dual = 0.5 * (J.z(ix + 1) + J.z(ix));
+
+        auto const ideal_x = -(Vy_dual * B.z(ix) - Vz_dual * B.y(ix));
+        auto const hall_x  = (Jy_dual * B.z(ix) - Jz_dual * B.y(ix)) / N_dual;
+
+        Enew.x(ix) = ideal_x + 1 * hall_x + 0.000 * J.x(ix);
+    }
+
+    static void ohm_primal(VecField<dimension> const& J, Field<dimension> const& N,
+                           VecField<dimension> const& V, VecField<dimension> const& B,
+                           VecField<dimension>& Enew, std::size_t ix)
+    {
+        auto const Jx_primal = 0.5 * (J.x(ix) + J.x(ix - 1));
+        auto const Bz_primal = 0.5 * (B.z(ix) + B.z(ix - 1));
+        auto const By_primal = 0.5 * (B.y(ix) + B.y(ix - 1));
+
+        auto const ideal_y = -(V.z(ix) * B.x(ix) - V.x(ix) * Bz_primal);
+        auto const hall_y  = (J.z(ix) * B.x(ix) - Jx_primal * Bz_primal) / N(ix);
+
+        auto const ideal_z = -(V.x(ix) * By_primal - V.y(ix) * B.x(ix));
+        auto const hall_z  = (Jx_primal * By_primal - J.y(ix) * B.x(ix)) / N(ix);
+
+        Enew.y(ix) = ideal_y + 1 * hall_y + 0.000 * J.y(ix);
+        Enew.z(ix) = ideal_z + 1 * hall_z + 0.000 * J.z(ix);
+    }
+
+    std::shared_ptr<GridLayout<dimension>> m_grid;
+    double m_dt;
+    std::size_t m_block = default_block;
+};
+
+
+#endif // HYBIRT_FUSED_FIELDS_HPP
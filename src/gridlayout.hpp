@@ -17,18 +17,29 @@ template<std::size_t dimension>
 class GridLayout
 {
 public:
-    static constexpr auto dual   = 0;
-    static constexpr auto primal = 1;
+    // a primal direction has one more node than a dual one, which the
+    // sizes and bounds below add as is
+    static constexpr std::size_t dual   = 0;
+    static constexpr std::size_t primal = 1;
+
+    // origin is the coordinate of the first domain node, non zero for the
+    // layout of a patch that does not start at the left of the domain
     GridLayout(std::array<std::size_t, dimension> nbr_cells,
-               std::array<double, dimension> cell_size, std::size_t nbr_ghosts)
+               std::array<double, dimension> cell_size, std::size_t nbr_ghosts,
+               std::array<double, dimension> origin = {})
         : m_nbr_cells{nbr_cells}
         , m_cell_size{cell_size}
         , m_nbr_ghosts{nbr_ghosts}
+        , m_origin{origin}
     {
     }
 
     auto nbr_cells(Direction dir_idx) const { return m_nbr_cells[dir_idx]; }
 
+    auto nbr_ghosts() const { return m_nbr_ghosts; }
+
+    auto origin(Direction dir_idx) const { return m_origin[dir_idx]; }
+
     auto nbr_dom_nodes(Quantity qty, Direction dir_idx) const
     {
         return m_nbr_cells[dir_idx] + ((centerings(qty)[dir_idx] == primal) ? 1 : 0);
@@ -55,18 +66,12 @@ public:
     auto dom_start(Quantity qty, Direction dir_idx) const
     {
         auto const centering = centerings(qty);
-        if constexpr (dimension == 1)
-        {
-            return centering[0] == dual ? dual_dom_start(dir_idx) : primal_dom_start(dir_idx);
-        }
+        return centering[dir_idx] == dual ? dual_dom_start(dir_idx) : primal_dom_start(dir_idx);
     }
     auto dom_end(Quantity qty, Direction dir_idx) const
     {
         auto const centering = centerings(qty);
-        if constexpr (dimension == 1)
-        {
-            return centering[0] == dual ? dual_dom_end(dir_idx) : primal_dom_end(dir_idx);
-        }
+        return centering[dir_idx] == dual ? dual_dom_end(dir_idx) : primal_dom_end(dir_idx);
     }
 
     auto cell_size(Direction dir_idx) const { return m_cell_size[dir_idx]; }
@@ -75,9 +80,9 @@ public:
     auto coordinate(Direction dir, Quantity qty, Index... index) const
     {
         auto idx  = std::array<std::size_t, dimension>{index...};
-        auto xmin = 0. - m_nbr_ghosts * m_cell_size[dir];
-        auto x    = xmin + idx[0] * m_cell_size[dir];
-        x += (centerings(qty)[0] == dual ? 0.5 : 0.0) * m_cell_size[dir];
+        auto xmin = m_origin[dir] - m_nbr_ghosts * m_cell_size[dir];
+        auto x    = xmin + idx[dir] * m_cell_size[dir];
+        x += (centerings(qty)[dir] == dual ? 0.5 : 0.0) * m_cell_size[dir];
         return x;
     }
 
@@ -85,109 +90,92 @@ public:
     auto cell_coordinate(Direction dir, Index... index) const
     {
         auto idx  = std::array<std::size_t, dimension>{index...};
-        auto xmin = 0. - m_nbr_ghosts * m_cell_size[dir];
-        auto x    = xmin + idx[0] * m_cell_size[dir];
+        auto xmin = m_origin[dir] - m_nbr_ghosts * m_cell_size[dir];
+        auto x    = xmin + idx[dir] * m_cell_size[dir];
         x += 0.5 * m_cell_size[dir];
         return x;
     }
 
     auto allocate(Quantity qty) const
     {
-        // Placeholder for allocation logic
-        // This would typically allocate memory for the field based on the quantity and direction
-        auto centering = centerings(qty);
-        if constexpr (dimension == 1)
-            return std::array<std::size_t, dimension>{m_nbr_cells[0] + 2 * m_nbr_ghosts
-                                                      + centering[0]};
-        else if constexpr (dimension == 2)
-            return std::array<std::size_t, dimension>{
-                m_nbr_cells[0] + 2 * m_nbr_ghosts + centering[0],
-                m_nbr_cells[1] + 2 * m_nbr_ghosts + centering[1]};
-
-        else if constexpr (dimension == 3)
-            return std::array<std::size_t, dimension>{
-                m_nbr_cells[0] + 2 * m_nbr_ghosts + centering[0],
-                m_nbr_cells[1] + 2 * m_nbr_ghosts + centering[1],
-                m_nbr_cells[2] + 2 * m_nbr_ghosts + centering[2]};
-        else
-            throw std::runtime_error("Unsupported dimension");
+        auto const centering = centerings(qty);
+        std::array<std::size_t, dimension> size;
+        for (std::size_t d = 0; d < dimension; ++d)
+            size[d] = m_nbr_cells[d] + 2 * m_nbr_ghosts + centering[d];
+        return size;
     }
 
-    std::array<std::size_t, dimension> centerings(Quantity qty) const
+    // centering of qty in each direction, usable in constant expressions.
+    // The 1D and 2D staggerings are the first directions of the 3D Yee one.
+    static constexpr std::array<std::size_t, dimension> centerings(Quantity qty)
     {
+        std::array<std::size_t, 3> yee{};
         switch (qty)
         {
             case Quantity::Jx:
-            case Quantity::Ex:
-                if constexpr (dimension == 1)
-                    return {dual};
-                else if constexpr (dimension == 2)
-                    return {dual, primal};
-                else if constexpr (dimension == 3)
-                    return {dual, primal, primal};
+            case Quantity::Ex: yee = {dual, primal, primal}; break;
 
             case Quantity::Jy:
-            case Quantity::Ey:
-                if constexpr (dimension == 1)
-                    return {primal};
-                else if constexpr (dimension == 2)
-                    return {primal, dual};
-                else if constexpr (dimension == 3)
-                    return {primal, dual, primal};
+            case Quantity::Ey: yee = {primal, dual, primal}; break;
 
             case Quantity::Jz:
-            case Quantity::Ez:
-                if constexpr (dimension == 1)
-                    return {primal};
-                else if constexpr (dimension == 2)
-                    return {primal, primal};
-                else if constexpr (dimension == 3)
-                    return {primal, primal, dual};
-
-            case Quantity::Bx:
-                if constexpr (dimension == 1)
-                    return {primal};
-                else if constexpr (dimension == 2)
-                    return {primal, dual};
-                else if constexpr (dimension == 3)
-                    return {primal, dual, dual};
-
-            case Quantity::By:
-                if constexpr (dimension == 1)
-                    return {dual};
-                else if constexpr (dimension == 2)
-                    return {dual, primal};
-                else if constexpr (dimension == 3)
-                    return {dual, primal, dual};
-
-            case Quantity::Bz:
-                if constexpr (dimension == 1)
-                    return {dual};
-                else if constexpr (dimension == 2)
-                    return {dual, dual};
-                else if constexpr (dimension == 3)
-                    return {dual, dual, primal};
+            case Quantity::Ez: yee = {primal, primal, dual}; break;
+
+            case Quantity::Bx: yee = {primal, dual, dual}; break;
+            case Quantity::By: yee = {dual, primal, dual}; break;
+            case Quantity::Bz: yee = {dual, dual, primal}; break;
 
             case Quantity::N:
             case Quantity::V:
             case Quantity::Vx:
             case Quantity::Vy:
-            case Quantity::Vz:
-                if constexpr (dimension == 1)
-                    return {primal};
-                else if constexpr (dimension == 2)
-                    return {primal};
-                else if constexpr (dimension == 3)
-                    return {primal, primal, primal};
+            case Quantity::Vz: yee = {primal, primal, primal}; break;
 
             default: throw std::runtime_error{"Unknown quantity"};
         }
+
+        std::array<std::size_t, dimension> centering{};
+        for (std::size_t d = 0; d < dimension; ++d)
+            centering[d] = yee[d];
+        return centering;
+    }
+
+    // the same as a compile time constant, e.g. centering<Quantity::Ex>[Direction::X]
+    template<Quantity qty>
+    static constexpr std::array<std::size_t, dimension> centering = centerings(qty);
+
+    // bounds and sizes of a quantity known at compile time, with no lookup
+    // of its centering. The domain starts at the same node in every direction
+    // and for every centering.
+    template<Quantity qty>
+    std::size_t dom_start() const
+    {
+        return m_nbr_ghosts;
+    }
+    template<Quantity qty>
+    std::size_t dom_end(Direction dir_idx) const
+    {
+        return m_nbr_cells[dir_idx] + m_nbr_ghosts - 1 + centering<qty>[dir_idx];
+    }
+    template<Quantity qty>
+    std::size_t ghost_end(Direction dir_idx) const
+    {
+        return m_nbr_cells[dir_idx] + 2 * m_nbr_ghosts - 1 + centering<qty>[dir_idx];
+    }
+    template<Quantity qty>
+    std::array<std::size_t, dimension> allocate() const
+    {
+        std::array<std::size_t, dimension> size;
+        for (std::size_t d = 0; d < dimension; ++d)
+            size[d] = m_nbr_cells[d] + 2 * m_nbr_ghosts + centering<qty>[d];
+        return size;
     }
 
 private:
     std::array<std::size_t, dimension> m_nbr_cells;
     std::array<double, dimension> m_cell_size;
     std::size_t m_nbr_ghosts;
+    std::array<double, dimension> m_origin;
 };
 
 #endif // HYBIRT_GRIDLAYOUT_HPP
@@ -6,11 +6,21 @@
 #include "ohm.hpp"
 #include "utils.hpp"
 #include "gridlayout.hpp"
-#include "boundary_condition.hpp"
 #include "moments.hpp"
 #include "pusher.hpp"
 #include "diagnostics.hpp"
+#include "async_diagnostics.hpp"
+#include "checkpoint.hpp"
+#include "patches.hpp"
+#include "simulation.hpp"
 #include "population.hpp"
+#include "thread_pool.hpp"
+#include "timers.hpp"
+#include "trace.hpp"
+
+#if HYBIRT_HAVE_MPI
+#include "mpi_decomposition.hpp"
+#endif
 
 #include "highfive/highfive.hpp"
 
@@ -20,33 +30,15 @@
 #include <cstdint>
 #include <memory>
 #include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 
 
 
-template<std::size_t dimension>
-void average(Field<dimension> const& F1, Field<dimension> const& F2, Field<dimension>& Favg)
-{
-    // use std::transform to do an average of F1 and F2
-    std::transform(F1.begin(), F1.end(),    // range 1
-                   F2.begin(),              // range 2
-                   Favg.begin(),            // output
-                   [](auto const& a, auto const& b) {
-                       return 0.5 * (a + b);
-                   });
-}
-
-
-template<std::size_t dimension>
-void average(VecField<dimension> const& V1, VecField<dimension> const& V2,
-             VecField<dimension>& Vavg)
-{
-    average(V1.x, V2.x, Vavg.x);
-    average(V1.y, V2.y, Vavg.y);
-    average(V1.z, V2.z, Vavg.z);
-}
-
-
 double bx(double x)
 {
     // Placeholder for a function that returns Bx based on x
@@ -96,141 +88,325 @@ void magnetic_init(VecField<1>& B, GridLayout<1> const& layout)
 
 
 
-int main()
+int main(int argc, char** argv)
 {
-    double time                     = 0.;
     double final_time               = 10.0000;
     double dt                       = 0.001;
     std::size_t constexpr dimension = 1;
 
+    if (auto const* env = std::getenv("HYBIRT_DT"))
+        dt = std::stod(env);
+
     std::array<std::size_t, dimension> grid_size = {100};
     std::array<double, dimension> cell_size      = {0.2};
     auto constexpr nbr_ghosts                    = 1;
     auto constexpr nppc                          = 100;
 
-    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
-
-    VecField<dimension> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
-    VecField<dimension> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
-    VecField<dimension> Enew{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
-    VecField<dimension> Bnew{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
-    VecField<dimension> Eavg{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
-    VecField<dimension> Bavg{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
-    VecField<dimension> J{layout, {Quantity::Jx, Quantity::Jy, Quantity::Jz}};
-    VecField<dimension> V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}};
-    Field<dimension> N{layout->allocate(Quantity::N), Quantity::N};
-
-    auto boundary_condition = BoundaryConditionFactory<dimension>::create("periodic", layout);
-
-    std::vector<Population<1>> populations;
-    populations.emplace_back("main", layout);
-    for (auto& pop : populations)
-        pop.load_particles(nppc, density);
-
-
-    magnetic_init(B, *layout);
-    boundary_condition->fill(B);
-
-    Faraday<dimension> faraday{layout, dt};  // TODO uncomment when Faraday is implemented
-    Ampere<dimension> ampere{layout};
-    Ohm<dimension> ohm{layout};
-    Boris<dimension> push{layout, dt};
-
-
-
-    ampere(B, J);
-    boundary_condition->fill(J);
-    for (auto& pop : populations)
+#if HYBIRT_HAVE_MPI
+    // each rank runs the subdomain MpiDecomposition assigns it
+    MpiSession mpi{argc, argv};
+    MpiDecomposition ranks;
+    int const rank      = ranks.rank();
+    int const nbr_ranks = ranks.size();
+    auto const layout   = ranks.subdomain(grid_size, cell_size, nbr_ghosts);
+#else
+    int const rank      = 0;
+    int const nbr_ranks = 1;
+    auto const layout   = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+#endif
+
+    ThreadPool pool{default_nbr_threads()};
+    if (rank == 0)
+        std::cout << "Running on " << nbr_ranks << " rank(s) of " << pool.size()
+                  << " thread(s)\n";
+
+    // one patch per thread unless HYBIRT_NUM_PATCHES says otherwise
+    std::size_t nbr_patches = pool.size();
+    if (auto const* env = std::getenv("HYBIRT_NUM_PATCHES"))
+        nbr_patches = std::stoul(env);
+
+    using PatchT = Patch<dimension>;
+    Simulation<dimension> sim{layout, nbr_patches, dt, pool};
+    auto& domain = sim.domain();
+#if HYBIRT_HAVE_MPI
+    if (nbr_ranks > 1)
+        domain.set_remote(std::make_shared<RemoteBoundaryCondition<dimension>>(layout, ranks));
+#endif
+    if (rank == 0)
+        std::cout << "Subdomains split into " << domain.size() << " patch(es)\n";
+
+    domain.add_population("main");
+    // HYBIRT_POSITIONS=cell_relative stores particle positions as a cell
+    // index plus an offset in the cell
+    auto const* positions_env = std::getenv("HYBIRT_POSITIONS");
+    bool const cell_relative  = positions_env and std::string{positions_env} == "cell_relative";
+
+    // diagnostics and checkpoints go to one file per rank when there are
+    // several
+    auto const suffix = nbr_ranks > 1 ? "_rank" + std::to_string(rank) : std::string{};
+
+    // HYBIRT_RESTART=1 resumes from the checkpoint files of a previous run,
+    // written every HYBIRT_CHECKPOINT_EVERY steps and, with
+    // HYBIRT_CHECKPOINT_ON_SIGTERM=1, when the run is terminated
+    auto const checkpoint_file = "checkpoint" + suffix + ".bin";
+    std::size_t checkpoint_every = 0;
+    if (auto const* env = std::getenv("HYBIRT_CHECKPOINT_EVERY"))
+        checkpoint_every = std::stoul(env);
+    auto const* sigterm_env = std::getenv("HYBIRT_CHECKPOINT_ON_SIGTERM");
+    bool const on_sigterm   = sigterm_env and std::string{sigterm_env} == "1";
+    if (on_sigterm)
+        checkpoint_on_sigterm();
+    auto const* restart_env = std::getenv("HYBIRT_RESTART");
+    bool const restart      = restart_env and std::string{restart_env} == "1";
+
+    if (restart)
     {
-        pop.deposit();
-        boundary_condition->fill(pop.flux());
-        boundary_condition->fill(pop.density());
+        auto const state = read_checkpoint(checkpoint_file, domain);
+        if (state.dt != dt)
+            throw std::runtime_error("Checkpoint time step differs from the simulation one");
+        sim.resume(state.time, state.step);
+        if (rank == 0)
+            std::cout << "Restarting at time " << sim.time() << ", step " << sim.steps() << "\n";
     }
-
-    total_density(populations, N);
-    bulk_velocity<dimension>(populations, N, V);
-    ohm(B, J, N, V, E);
-    boundary_condition->fill(E);
-
-    diags_write_fields(B, E, V, N, time, HighFive::File::Truncate);
-    diags_write_particles(populations, time, HighFive::File::Truncate);
-
-    while (time < final_time)
+    else
     {
-        std::cout << "Time: " << time << " / " << final_time << "\n";
-
-        // TODO implement ICN temporal integration
-
-        // Prediction 1 
-
-        faraday(E, B, Bnew);
-        boundary_condition->fill(Bnew);
-
-        ampere(Bnew, J);
-        boundary_condition->fill(J);
-        
-        ohm(Bnew, J, N, V, Enew);
-        boundary_condition->fill(Enew);
-        
-        average(E, Enew, Eavg);
-        average(B, Bnew, Bavg);
-
-        for (auto& pop : populations)
+        for (std::size_t ip = 0; ip < domain.size(); ++ip)
+        {
+            auto& patch = domain[ip];
+            for (auto& pop : patch.populations)
             {
-                push(pop.particles(), Eavg, Bavg);
-                boundary_condition->particles(pop.particles());
-                pop.deposit();
-                boundary_condition->fill(pop.flux());
-                boundary_condition->fill(pop.density());
+                pop.load_particles(nppc, density);
+                if (cell_relative)
+                    pop.use_cell_relative_positions();
             }
-        total_density(populations, N);
-        bulk_velocity<dimension>(populations, N, V);
+            magnetic_init(patch.B, *patch.layout);
+        }
+        domain.fill(&PatchT::B);
+    }
 
-        // Prediction 2
+    // HYBIRT_GATHER_GRID=1 packs E and B node by node before each push, the
+    // pusher then reads the fields of a particle from two cache lines
+    auto const* gather_env = std::getenv("HYBIRT_GATHER_GRID");
+    if (gather_env and std::string{gather_env} == "1")
+        domain.for_each_patch([](PatchT& patch) { patch.push.gather_grid(true); });
+
+    // HYBIRT_PUSH_DEPOSIT=fused pushes and deposits each population in a
+    // single pass, for runs on a single patch and a single rank
+    auto const* push_deposit_env = std::getenv("HYBIRT_PUSH_DEPOSIT");
+    sim.push_deposit(push_deposit_env and std::string{push_deposit_env} == "fused");
+
+    // HYBIRT_FUSED_FIELDS=1 computes Bnew, J and Enew in a single sweep,
+    // with one ghost fill instead of three
+    auto const* fused_env = std::getenv("HYBIRT_FUSED_FIELDS");
+    sim.fused_fields(fused_env and std::string{fused_env} == "1");
+
+    // HYBIRT_FIELD_SUBCYCLING=1 advances the fields in as many substeps per
+    // step as the whistlers need, at HYBIRT_WHISTLER_CFL times their time
+    // step limit, so that HYBIRT_DT can grow past the field CFL limit. A
+    // step that would need more than 64 substeps takes 64 and says so.
+    auto const* subcycling_env = std::getenv("HYBIRT_FIELD_SUBCYCLING");
+    sim.subcycle_fields(subcycling_env and std::string{subcycling_env} == "1");
+    if (auto const* env = std::getenv("HYBIRT_WHISTLER_CFL"))
+        sim.whistler_cfl(std::stod(env));
+
+    // HYBIRT_INTEGRATOR=single_push pushes the particles once per step
+    // instead of the two pushes of ICN, still second order in time
+    if (auto const* env = std::getenv("HYBIRT_INTEGRATOR"))
+    {
+        auto const name = std::string{env};
+        if (name == "single_push")
+            sim.integrator(std::make_unique<SinglePush<dimension>>());
+        else if (name != "icn")
+            throw std::runtime_error("Unknown integrator " + name);
+    }
 
-        faraday(Eavg, B, Bnew);
-        boundary_condition->fill(Bnew);
+#if HYBIRT_TRACING
+    // HYBIRT_TRACE=1 records the timeline of the time loop, per thread, and
+    // writes it to trace.json at the end of the run. Each thread keeps its
+    // last HYBIRT_TRACE_EVENTS events.
+    auto const* trace_env = std::getenv("HYBIRT_TRACE");
+    bool const tracing    = trace_env and std::string{trace_env} == "1";
+    if (tracing)
+    {
+        std::size_t trace_events = Tracer::default_capacity;
+        if (auto const* env = std::getenv("HYBIRT_TRACE_EVENTS"))
+            trace_events = std::stoul(env);
+        std::vector<std::string> names;
+        for (auto const& pop : domain[0].populations)
+            names.push_back(pop.name());
+        auto& tracer = Tracer::instance();
+        tracer.population_names(names);
+        tracer.enable(trace_events);
+        tracer.name_this_thread("time loop");
+    }
+#endif
+
+    // diagnostics are written for the whole subdomain every
+    // HYBIRT_DIAGS_EVERY steps. A background thread writes copies rotating
+    // through HYBIRT_DIAGS_BUFFERS buffers, with no buffer the time loop
+    // writes itself, straight from the patches. A restart appends to the
+    // files of the previous run.
+    std::size_t diags_every   = 1;
+    std::size_t diags_buffers = 2;
+    if (auto const* env = std::getenv("HYBIRT_DIAGS_EVERY"))
+        diags_every = std::stoul(env);
+    if (auto const* env = std::getenv("HYBIRT_DIAGS_BUFFERS"))
+        diags_buffers = std::stoul(env);
+
+    std::optional<DiagnosticsWriter<dimension>> diagnostics;
+    std::optional<AsyncDiagnostics<dimension>> async_diagnostics;
+    auto const resume_time = restart ? std::optional<double>{sim.time()} : std::nullopt;
+    if (diags_buffers == 0)
+        diagnostics.emplace(layout, diags_every, suffix, resume_time);
+    else
+        async_diagnostics.emplace(layout, diags_every, suffix, diags_buffers, resume_time);
+
+    // each patch writes the nodes it owns straight from its own fields
+    auto write_field = [&](std::string const& name, auto&& select) {
+        for (std::size_t ip = 0; ip < domain.size(); ++ip)
+        {
+            auto const& field        = std::invoke(select, domain[ip]);
+            auto const [first, last] = domain.owned_nodes(ip, field.quantity());
+            diagnostics->write_field(name, field, first, last, first + domain.first_cell(ip));
+        }
+    };
+
+    auto write_diagnostics = [&]() {
+        if (async_diagnostics)
+        {
+            if (!async_diagnostics->due(sim.steps()))
+                return;
+            HYBIRT_TIME_SCOPE(Stage::Diagnostics);
+            async_diagnostics->snapshot(sim.time(), [&](Snapshot<dimension>& snapshot) {
+                domain.gather(&PatchT::B, snapshot.B);
+                domain.gather(&PatchT::E, snapshot.E);
+                domain.gather(&PatchT::V, snapshot.V);
+                domain.gather(&PatchT::N, snapshot.N);
+                for (std::size_t ipop = 0; ipop < domain.nbr_populations(); ++ipop)
+                    domain.gather_particles(
+                        ipop, snapshot.particles(ipop, domain[0].populations[ipop].name()));
+            });
+            return;
+        }
+
+        if (!diagnostics->due(sim.steps()))
+            return;
+        HYBIRT_TIME_SCOPE(Stage::Diagnostics);
+        diagnostics->begin_snapshot(sim.time());
+        write_field("Bx", [](PatchT const& patch) -> auto& { return patch.B.x; });
+        write_field("By", [](PatchT const& patch) -> auto& { return patch.B.y; });
+        write_field("Bz", [](PatchT const& patch) -> auto& { return patch.B.z; });
+        write_field("Ex", [](PatchT const& patch) -> auto& { return patch.E.x; });
+        write_field("Ey", [](PatchT const& patch) -> auto& { return patch.E.y; });
+        write_field("Ez", [](PatchT const& patch) -> auto& { return patch.E.z; });
+        write_field("Vx", [](PatchT const& patch) -> auto& { return patch.V.x; });
+        write_field("Vy", [](PatchT const& patch) -> auto& { return patch.V.y; });
+        write_field("Vz", [](PatchT const& patch) -> auto& { return patch.V.z; });
+        write_field("N", &PatchT::N);
+
+        auto const dx = layout->cell_size(Direction::X);
+        for (std::size_t ip = 0; ip < domain.size(); ++ip)
+            for (auto const& pop : domain[ip].populations)
+                diagnostics->write_particles(pop.name(), pop.particles(),
+                                             domain.first_cell(ip) * dx);
+        diagnostics->end_snapshot();
+    };
+
+
+
+#if HYBIRT_TIMERS
+    std::size_t report_every = 0;
+    if (auto const* env = std::getenv("HYBIRT_REPORT_EVERY"))
+        report_every = std::stoul(env);
+
+    // HYBIRT_PERF_COUNTERS=1 adds cycles, instructions, LLC and branch misses
+    // per stage to the report, summed over the threads of the pool, where
+    // perf_event_open allows it
+    auto const* perf_env = std::getenv("HYBIRT_PERF_COUNTERS");
+    if (perf_env and std::string{perf_env} == "1")
+        Timers::instance().enable_perf_counters(pool);
+#endif
+
+    // all ranks stop together once one of them was sent SIGTERM
+    auto terminated = [&]() {
+        int flag = sigterm_received;
+#if HYBIRT_HAVE_MPI
+        if (nbr_ranks > 1)
+            MPI_Allreduce(MPI_IN_PLACE, &flag, 1, MPI_INT, MPI_MAX, ranks.comm());
+#endif
+        return flag != 0;
+    };
+
+    if (!restart)
+    {
+        sim.initialize();
+        write_diagnostics();
+    }
 
-        ampere(Bnew, J);
-        boundary_condition->fill(J);
-        
-        ohm(Bnew, J, N, V, Enew);
-        boundary_condition->fill(Enew);
-        
-        average(E, Enew, Eavg);
-        average(B, Bnew, Bavg);
+    // counted in steps, the sum of the steps misses final_time by round-off
+    auto const last_step = sim.steps() + sim.steps_to(final_time);
+    while (sim.steps() < last_step)
+    {
+        if (rank == 0)
+            std::cout << "Time: " << sim.time() << " / " << final_time << "\n";
 
-        for (auto& pop : populations)
+        sim.step();
+        if (rank == 0)
+        {
+            if (sim.subcycle_fields())
             {
-                push(pop.particles(), Eavg, Bavg);
-                boundary_condition->particles(pop.particles());
-                pop.deposit();
-                boundary_condition->fill(pop.flux());
-                boundary_condition->fill(pop.density());
+                std::cout << "Field substeps: " << sim.field_substeps();
+                if (sim.field_substeps_capped())
+                    std::cout << " (capped, the field substeps are past the whistler CFL)";
+                std::cout << "\n";
             }
-        total_density(populations, N);
-        bulk_velocity<dimension>(populations, N, V);
-
-        // Correction 
-
-        faraday(Eavg, B, Bnew);
-        boundary_condition->fill(Bnew);
-
-        ampere(Bnew, J);
-        boundary_condition->fill(J);
-        
-        ohm(Bnew, J, N, V, Enew);
-        boundary_condition->fill(Enew);
-
-        B = Bnew;
-        E = Enew;
-        
-        time += dt;
-        diags_write_fields(B, E, V, N, time);
-        std::cout << "**********************************\n";
-        diags_write_particles(populations, time);
+            std::cout << "**********************************\n";
+        }
+        {
+            HYBIRT_TRACE_SCOPE("diagnostics");
+            write_diagnostics();
+        }
+
+        auto const step       = sim.steps();
+        bool const checkpoint = checkpoint_every > 0 and step % checkpoint_every == 0;
+        if (checkpoint)
+            write_checkpoint(checkpoint_file, domain, {sim.time(), dt, step});
+        if (on_sigterm and terminated())
+        {
+            // the cadence may just have written this very step
+            if (!checkpoint)
+                write_checkpoint(checkpoint_file, domain, {sim.time(), dt, step});
+            if (rank == 0)
+                std::cout << "Terminated, checkpoint written at time " << sim.time() << "\n";
+            break;
+        }
+
+#if HYBIRT_TIMERS
+        // HYBIRT_REPORT_EVERY prints the performance report every that many
+        // steps, not only at the end of the run
+        if (rank == 0 and report_every > 0 and step % report_every == 0)
+            Timers::instance().report(std::cout);
+#endif
     }
 
+    if (async_diagnostics)
+    {
+        async_diagnostics->flush();
+        if (rank == 0)
+            std::cout << "Diagnostics waited for the writer " << async_diagnostics->nbr_stalls()
+                      << " time(s)\n";
+    }
+
+#if HYBIRT_TIMERS
+    if (rank == 0)
+        Timers::instance().report(std::cout);
+#endif
+
+#if HYBIRT_TRACING
+    if (tracing)
+        Tracer::instance().write("trace" + suffix + ".json", rank);
+#endif
+
 
     return 0;
 }
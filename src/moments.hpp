@@ -6,20 +6,23 @@
 #include "population.hpp"
 
 #include <vector>
+#include <algorithm>
 
 
 template<std::size_t dimension>
 void total_density(std::vector<Population<dimension>> const& populations, Field<dimension>& N)
 {
-    for (auto ix = 0; ix < N.data().size(); ++ix)
+    auto n = N.view();
+    for (std::size_t ix = 0; ix < n.size(); ++ix)
     {
-        N(ix) = 0;
+        n[ix] = 0;
     }
     for (auto const& pop : populations)
     {
-        for (auto ix = 0; ix < N.data().size(); ++ix)
+        auto const pop_n = pop.density().view();
+        for (std::size_t ix = 0; ix < n.size(); ++ix)
         {
-            N(ix) += pop.density()(ix);
+            n[ix] += pop_n[ix];
         }
     }
 }
@@ -28,28 +31,31 @@ template<std::size_t dimension>
 void bulk_velocity(std::vector<Population<dimension>> const& populations, Field<dimension> const& N,
                    VecField<dimension>& V)
 {
-    for (auto ix = 0; ix < N.data().size(); ++ix)
+    auto const n = N.view();
+    auto v       = V.view();
+    for (std::size_t ix = 0; ix < n.size(); ++ix)
     {
-        V.x(ix) = 0;
-        V.y(ix) = 0;
-        V.z(ix) = 0;
+        v.x[ix] = 0;
+        v.y[ix] = 0;
+        v.z[ix] = 0;
     }
     for (auto& pop : populations)
     {
-        for (auto ix = 0; ix < N.data().size(); ++ix)
+        auto const flux = pop.flux().view();
+        for (std::size_t ix = 0; ix < n.size(); ++ix)
         {
-            V.x(ix) += pop.flux().x(ix);
-            V.y(ix) += pop.flux().y(ix);
-            V.z(ix) += pop.flux().z(ix);
+            v.x[ix] += flux.x[ix];
+            v.y[ix] += flux.y[ix];
+            v.z[ix] += flux.z[ix];
         }
     }
     // TODO calculate bulk velocity by dividing by density N
     constexpr double N_floor = 1e-12;
-    for (std::size_t ix = 0; ix < N.data().size(); ++ix) {
-        double const n = std::max(N(ix), N_floor);
-        V.x(ix) /= n; 
-        V.y(ix) /= n; 
-        V.z(ix) /= n;
+    for (std::size_t ix = 0; ix < n.size(); ++ix) {
+        double const nx = std::max(n[ix], N_floor);
+        v.x[ix] /= nx; 
+        v.y[ix] /= nx; 
+        v.z[ix] /= nx;
     }
 
 }
@@ -0,0 +1,88 @@
+#ifndef HYBIRT_MPI_DECOMPOSITION_HPP
+#define HYBIRT_MPI_DECOMPOSITION_HPP
+
+#include "gridlayout.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <mpi.h>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+
+// Initializes MPI for the lifetime of the object. Only the thread that
+// created it makes MPI calls, the thread pool workers never do.
+class MpiSession
+{
+public:
+    MpiSession(int& argc, char**& argv)
+    {
+        int provided = 0;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+        if (provided < MPI_THREAD_FUNNELED)
+            throw std::runtime_error("MPI does not support MPI_THREAD_FUNNELED");
+    }
+
+    ~MpiSession() { MPI_Finalize(); }
+
+    MpiSession(MpiSession const&)            = delete;
+    MpiSession& operator=(MpiSession const&) = delete;
+};
+
+
+
+// Assigns to each rank of the communicator one contiguous range of the cells
+// of a periodic domain split along x. The first and last ranks are
+// neighbours.
+class MpiDecomposition
+{
+public:
+    explicit MpiDecomposition(MPI_Comm comm = MPI_COMM_WORLD)
+        : m_comm{comm}
+    {
+        MPI_Comm_rank(m_comm, &m_rank);
+        MPI_Comm_size(m_comm, &m_size);
+    }
+
+    MPI_Comm comm() const { return m_comm; }
+    int rank() const { return m_rank; }
+    int size() const { return m_size; }
+
+    int left() const { return (m_rank + m_size - 1) % m_size; }
+    int right() const { return (m_rank + 1) % m_size; }
+
+    // cells [first, second) of a domain of nbr_cells cells belong to this rank
+    std::pair<std::size_t, std::size_t> cells(std::size_t nbr_cells) const
+    {
+        return ThreadPool::chunk_range(nbr_cells, static_cast<std::size_t>(m_size),
+                                       static_cast<std::size_t>(m_rank));
+    }
+
+    // layout of the subdomain of this rank, its origin is the coordinate of
+    // its first cell in the domain
+    template<std::size_t dimension>
+    std::shared_ptr<GridLayout<dimension>>
+    subdomain(std::array<std::size_t, dimension> nbr_cells,
+              std::array<double, dimension> cell_size, std::size_t nbr_ghosts) const
+    {
+        static_assert(dimension == 1, "MpiDecomposition only implemented for 1D");
+        auto const [first, last] = cells(nbr_cells[0]);
+        if (last - first <= nbr_ghosts)
+            throw std::runtime_error("Too many ranks for the number of cells");
+        return std::make_shared<GridLayout<dimension>>(
+            std::array<std::size_t, dimension>{last - first}, cell_size, nbr_ghosts,
+            std::array<double, dimension>{first * cell_size[0]});
+    }
+
+private:
+    MPI_Comm m_comm;
+    int m_rank = 0;
+    int m_size = 1;
+};
+
+
+#endif // HYBIRT_MPI_DECOMPOSITION_HPP
@@ -2,6 +2,8 @@
 #define HYBRIDIR_OHM_HPP
 
 #include "vecfield.hpp"
+#include "tiling.hpp"
+#include "utils.hpp"
 
 #include <cstddef>
 #include <memory>
@@ -21,7 +23,6 @@ public:
                     VecField<dimension> const& V, VecField<dimension>& Enew)
 
     {
-        auto const dx = m_grid->cell_size(Direction::X);
         if constexpr (dimension == 1)
         {
             // Ex is dual in x
@@ -87,14 +88,149 @@ public:
                 Ez(ix) = ideal_z + 1 * hall_z + 0.000 * Jz(ix);
             }
         }
+        else if constexpr (dimension == 2)
+        {
+            // E = -V x B + (J x B) / N, each component computed on its own
+            // nodes from the neighbouring values of the other quantities.
+            // V and N are (primal, primal), B and J are centered as in Yee.
+
+            // Ex (dual, primal): Bz and Jy averaged in y, V, N, Jz in x
+            for (auto ix = m_grid->dom_start(Quantity::Ex, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Ex, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Ex, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Ex, Direction::Y); iy <= iy_end; ++iy)
+                {
+                    auto const Vy = 0.5 * (V.y(ix, iy) + V.y(ix + 1, iy));
+                    auto const Vz = 0.5 * (V.z(ix, iy) + V.z(ix + 1, iy));
+                    auto const n  = 0.5 * (N(ix, iy) + N(ix + 1, iy));
+                    auto const Jz = 0.5 * (J.z(ix, iy) + J.z(ix + 1, iy));
+                    auto const Jy = 0.25
+                                    * (J.y(ix, iy - 1) + J.y(ix, iy) + J.y(ix + 1, iy - 1)
+                                       + J.y(ix + 1, iy));
+                    auto const By = B.y(ix, iy);
+                    auto const Bz = 0.5 * (B.z(ix, iy - 1) + B.z(ix, iy));
+
+                    Enew.x(ix, iy) = -(Vy * Bz - Vz * By) + (Jy * Bz - Jz * By) / n;
+                }
+            }
+
+            // Ey (primal, dual): Bz and Jx averaged in x, V, N, Jz in y
+            for (auto ix = m_grid->dom_start(Quantity::Ey, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Ey, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Ey, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Ey, Direction::Y); iy <= iy_end; ++iy)
+                {
+                    auto const Vx = 0.5 * (V.x(ix, iy) + V.x(ix, iy + 1));
+                    auto const Vz = 0.5 * (V.z(ix, iy) + V.z(ix, iy + 1));
+                    auto const n  = 0.5 * (N(ix, iy) + N(ix, iy + 1));
+                    auto const Jz = 0.5 * (J.z(ix, iy) + J.z(ix, iy + 1));
+                    auto const Jx = 0.25
+                                    * (J.x(ix - 1, iy) + J.x(ix, iy) + J.x(ix - 1, iy + 1)
+                                       + J.x(ix, iy + 1));
+                    auto const Bx = B.x(ix, iy);
+                    auto const Bz = 0.5 * (B.z(ix - 1, iy) + B.z(ix, iy));
+
+                    Enew.y(ix, iy) = -(Vz * Bx - Vx * Bz) + (Jz * Bx - Jx * Bz) / n;
+                }
+            }
+
+            // Ez (primal, primal): Bx, Jy averaged in y, By, Jx in x
+            for (auto ix = m_grid->dom_start(Quantity::Ez, Direction::X);
+                 ix <= m_grid->dom_end(Quantity::Ez, Direction::X); ++ix)
+            {
+                auto const iy_end = m_grid->dom_end(Quantity::Ez, Direction::Y);
+                HYBIRT_IVDEP
+                for (auto iy = m_grid->dom_start(Quantity::Ez, Direction::Y); iy <= iy_end; ++iy)
+                {
+                    auto const Bx = 0.5 * (B.x(ix, iy - 1) + B.x(ix, iy));
+                    auto const By = 0.5 * (B.y(ix - 1, iy) + B.y(ix, iy));
+                    auto const Jx = 0.5 * (J.x(ix - 1, iy) + J.x(ix, iy));
+                    auto const Jy = 0.5 * (J.y(ix, iy - 1) + J.y(ix, iy));
+
+                    Enew.z(ix, iy) = -(V.x(ix, iy) * By - V.y(ix, iy) * Bx)
+                                     + (Jx * By - Jy * Bx) / N(ix, iy);
+                }
+            }
+        }
+        else if constexpr (dimension == 3)
+        {
+            // same as 2D: each component of E on its own nodes, V and N
+            // primal everywhere, averaged onto the edge, B and J averaged
+            // from the faces and edges around it. Computed tile by tile.
+            auto const ex = dom_box<Quantity::Ex>(*m_grid);
+            auto const ey = dom_box<Quantity::Ey>(*m_grid);
+            auto const ez = dom_box<Quantity::Ez>(*m_grid);
+
+            for_each_tile(hull(hull(ex, ey), ez), m_tiles, [&](IndexBox const& tile) {
+                // Ex (dual, primal, primal)
+                sweep(ex, tile, [&](auto ix, auto iy, auto iz) {
+                    auto const Vy = 0.5 * (V.y(ix, iy, iz) + V.y(ix + 1, iy, iz));
+                    auto const Vz = 0.5 * (V.z(ix, iy, iz) + V.z(ix + 1, iy, iz));
+                    auto const n  = 0.5 * (N(ix, iy, iz) + N(ix + 1, iy, iz));
+                    auto const Jy = 0.25
+                                    * (J.y(ix, iy - 1, iz) + J.y(ix, iy, iz)
+                                       + J.y(ix + 1, iy - 1, iz) + J.y(ix + 1, iy, iz));
+                    auto const Jz = 0.25
+                                    * (J.z(ix, iy, iz - 1) + J.z(ix, iy, iz)
+                                       + J.z(ix + 1, iy, iz - 1) + J.z(ix + 1, iy, iz));
+                    auto const By = 0.5 * (B.y(ix, iy, iz - 1) + B.y(ix, iy, iz));
+                    auto const Bz = 0.5 * (B.z(ix, iy - 1, iz) + B.z(ix, iy, iz));
+
+                    Enew.x(ix, iy, iz) = -(Vy * Bz - Vz * By) + (Jy * Bz - Jz * By) / n;
+                });
+
+                // Ey (primal, dual, primal)
+                sweep(ey, tile, [&](auto ix, auto iy, auto iz) {
+                    auto const Vx = 0.5 * (V.x(ix, iy, iz) + V.x(ix, iy + 1, iz));
+                    auto const Vz = 0.5 * (V.z(ix, iy, iz) + V.z(ix, iy + 1, iz));
+                    auto const n  = 0.5 * (N(ix, iy, iz) + N(ix, iy + 1, iz));
+                    auto const Jx = 0.25
+                                    * (J.x(ix - 1, iy, iz) + J.x(ix, iy, iz)
+                                       + J.x(ix - 1, iy + 1, iz) + J.x(ix, iy + 1, iz));
+                    auto const Jz = 0.25
+                                    * (J.z(ix, iy, iz - 1) + J.z(ix, iy, iz)
+                                       + J.z(ix, iy + 1, iz - 1) + J.z(ix, iy + 1, iz));
+                    auto const Bx = 0.5 * (B.x(ix, iy, iz - 1) + B.x(ix, iy, iz));
+                    auto const Bz = 0.5 * (B.z(ix - 1, iy, iz) + B.z(ix, iy, iz));
+
+                    Enew.y(ix, iy, iz) = -(Vz * Bx - Vx * Bz) + (Jz * Bx - Jx * Bz) / n;
+                });
+
+                // Ez (primal, primal, dual)
+                sweep(ez, tile, [&](auto ix, auto iy, auto iz) {
+                    auto const Vx = 0.5 * (V.x(ix, iy, iz) + V.x(ix, iy, iz + 1));
+                    auto const Vy = 0.5 * (V.y(ix, iy, iz) + V.y(ix, iy, iz + 1));
+                    auto const n  = 0.5 * (N(ix, iy, iz) + N(ix, iy, iz + 1));
+                    auto const Jx = 0.25
+                                    * (J.x(ix - 1, iy, iz) + J.x(ix, iy, iz)
+                                       + J.x(ix - 1, iy, iz + 1) + J.x(ix, iy, iz + 1));
+                    auto const Jy = 0.25
+                                    * (J.y(ix, iy - 1, iz) + J.y(ix, iy, iz)
+                                       + J.y(ix, iy - 1, iz + 1) + J.y(ix, iy, iz + 1));
+                    auto const Bx = 0.5 * (B.x(ix, iy - 1, iz) + B.x(ix, iy, iz));
+                    auto const By = 0.5 * (B.y(ix - 1, iy, iz) + B.y(ix, iy, iz));
+
+                    Enew.z(ix, iy, iz) = -(Vx * By - Vy * Bx) + (Jx * By - Jy * Bx) / n;
+                });
+            });
+        }
         else
         {
             throw std::runtime_error("Ohm's law not implemented for this dimension");
         }
     }
 
+    // cache blocking of the 3D sweeps
+    Tiles const& tiles() const { return m_tiles; }
+    void tiles(Tiles tiles) { m_tiles = tiles; }
+
 private:
     std::shared_ptr<GridLayout<dimension>> m_grid;
+    Tiles m_tiles;
 };
 
 #endif // HYBRIDIR_OHM_HPP
@@ -10,7 +10,5 @@ struct Particle
     std::array<double, dimension> position;
     std::array<double, 3> v; // velocity
     double weight;
-    double mass;
-    double charge;
 };
 #endif // HYBIRT_PARTICLE_HPP
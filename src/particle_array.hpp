@@ -0,0 +1,323 @@
+#ifndef HYBIRT_PARTICLE_ARRAY_HPP
+#define HYBIRT_PARTICLE_ARRAY_HPP
+
+#include "particle.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+
+// allocator handing out storage aligned on a cache line so that each
+// particle component array starts on a SIMD register boundary
+template<typename T, std::size_t alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(AlignedAllocator<U, alignment> const&)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{alignment}));
+    }
+
+    void deallocate(T* ptr, std::size_t) { ::operator delete(ptr, std::align_val_t{alignment}); }
+
+    template<typename U>
+    bool operator==(AlignedAllocator<U, alignment> const&) const
+    {
+        return true;
+    }
+};
+
+template<typename T>
+using aligned_vector = std::vector<T, AlignedAllocator<T>>;
+
+
+
+// Structure-of-arrays particle container: one contiguous array per position
+// component, per velocity component and for the weight. Mass and charge are
+// the same for all particles of a species and are stored once.
+//
+// Positions are either absolute coordinates, or cell relative: an integer
+// domain cell index plus the normalized offset in [0,1) within that cell.
+// Only the arrays of the active representation are stored.
+template<std::size_t dimension>
+class ParticleArray
+{
+public:
+    ParticleArray(double mass = 1.0, double charge = 1.0)
+        : m_mass{mass}
+        , m_charge{charge}
+    {
+    }
+
+    std::size_t size() const { return m_weight.size(); }
+    bool empty() const { return m_weight.empty(); }
+
+    void reserve(std::size_t n)
+    {
+        for_each_array([n](auto& array) { array.reserve(n); });
+    }
+
+    void resize(std::size_t n)
+    {
+        for_each_array([n](auto& array) { array.resize(n); });
+    }
+
+    void clear()
+    {
+        for_each_array([](auto& array) { array.clear(); });
+    }
+
+    void push_back(Particle<dimension> const& particle)
+    {
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            if (m_cell_relative)
+            {
+                double delta    = 0.0;
+                auto const cell = split_offset(particle.position[d] / m_cell_size[d], delta);
+                m_icell[d].push_back(cell);
+                m_delta[d].push_back(delta);
+            }
+            else
+                m_position[d].push_back(particle.position[d]);
+        }
+        for (std::size_t c = 0; c < 3; ++c)
+            m_v[c].push_back(particle.v[c]);
+        m_weight.push_back(particle.weight);
+    }
+
+    // appends particle i of other, which stores positions the same way
+    void push_back(ParticleArray const& other, std::size_t i)
+    {
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            if (m_cell_relative)
+            {
+                m_icell[d].push_back(other.m_icell[d][i]);
+                m_delta[d].push_back(other.m_delta[d][i]);
+            }
+            else
+                m_position[d].push_back(other.m_position[d][i]);
+        }
+        for (std::size_t c = 0; c < 3; ++c)
+            m_v[c].push_back(other.m_v[c][i]);
+        m_weight.push_back(other.m_weight[i]);
+    }
+
+    // number of doubles a particle takes once packed
+    std::size_t packed_size() const { return (m_cell_relative ? 2 : 1) * dimension + 4; }
+
+    // writes particle i to buffer, packed_size() values
+    void pack(std::size_t i, double* buffer) const
+    {
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            if (m_cell_relative)
+            {
+                *buffer++ = m_icell[d][i];
+                *buffer++ = m_delta[d][i];
+            }
+            else
+                *buffer++ = m_position[d][i];
+        }
+        for (std::size_t c = 0; c < 3; ++c)
+            *buffer++ = m_v[c][i];
+        *buffer = m_weight[i];
+    }
+
+    // appends a particle written by pack() from an array stored the same way
+    void push_back_packed(double const* buffer)
+    {
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            if (m_cell_relative)
+            {
+                m_icell[d].push_back(static_cast<std::int32_t>(*buffer++));
+                m_delta[d].push_back(*buffer++);
+            }
+            else
+                m_position[d].push_back(*buffer++);
+        }
+        for (std::size_t c = 0; c < 3; ++c)
+            m_v[c].push_back(*buffer++);
+        m_weight.push_back(*buffer);
+    }
+
+    // removes particle i by moving the last particle in its place
+    void swap_remove(std::size_t i)
+    {
+        for_each_array([i](auto& array) {
+            array[i] = array.back();
+            array.pop_back();
+        });
+    }
+
+    // same species, position representation and size as other, reusing the
+    // storage. The values are left for the caller to write, e.g. an out of
+    // place push.
+    void resize_like(ParticleArray const& other)
+    {
+        if (m_cell_relative != other.m_cell_relative)
+        {
+            for_each_array([](auto& array) { array.clear(); });
+            m_cell_relative = other.m_cell_relative;
+        }
+        m_mass      = other.m_mass;
+        m_charge    = other.m_charge;
+        m_cell_size = other.m_cell_size;
+        resize(other.size());
+    }
+
+    // no particle, same species and position representation
+    ParticleArray empty_like() const
+    {
+        ParticleArray empty{m_mass, m_charge};
+        empty.m_cell_relative = m_cell_relative;
+        empty.m_cell_size     = m_cell_size;
+        return empty;
+    }
+
+    // gathers particle i into a struct, meant for tests and diagnostics,
+    // not for hot loops
+    Particle<dimension> operator[](std::size_t i) const
+    {
+        Particle<dimension> particle;
+        for (std::size_t d = 0; d < dimension; ++d)
+            particle.position[d] = absolute_position(static_cast<Direction>(d), i);
+        for (std::size_t c = 0; c < 3; ++c)
+            particle.v[c] = m_v[c][i];
+        particle.weight = m_weight[i];
+        return particle;
+    }
+
+    auto& position(Direction dir) { return m_position[dir]; }
+    auto const& position(Direction dir) const { return m_position[dir]; }
+
+    bool cell_relative() const { return m_cell_relative; }
+
+    // cell relative representation, empty when positions are absolute
+    auto& icell(Direction dir) { return m_icell[dir]; }
+    auto const& icell(Direction dir) const { return m_icell[dir]; }
+    auto& delta(Direction dir) { return m_delta[dir]; }
+    auto const& delta(Direction dir) const { return m_delta[dir]; }
+
+    double absolute_position(Direction dir, std::size_t i) const
+    {
+        if (m_cell_relative)
+            return (m_icell[dir][i] + m_delta[dir][i]) * m_cell_size[dir];
+        return m_position[dir][i];
+    }
+
+    // switches to cell relative positions, cell 0 starting at coordinate 0
+    void to_cell_relative(std::array<double, dimension> const& cell_size)
+    {
+        if (m_cell_relative)
+            return;
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            m_icell[d].resize(size());
+            m_delta[d].resize(size());
+            for (std::size_t i = 0; i < size(); ++i)
+            {
+                m_icell[d][i] = split_offset(m_position[d][i] / cell_size[d], m_delta[d][i]);
+            }
+            m_position[d] = aligned_vector<double>{};
+        }
+        m_cell_size     = cell_size;
+        m_cell_relative = true;
+    }
+
+    void to_absolute()
+    {
+        if (!m_cell_relative)
+            return;
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            m_position[d].resize(size());
+            for (std::size_t i = 0; i < size(); ++i)
+                m_position[d][i] = (m_icell[d][i] + m_delta[d][i]) * m_cell_size[d];
+            m_icell[d] = aligned_vector<std::int32_t>{};
+            m_delta[d] = aligned_vector<double>{};
+        }
+        m_cell_relative = false;
+    }
+
+    auto& v(std::size_t comp) { return m_v[comp]; }
+    auto const& v(std::size_t comp) const { return m_v[comp]; }
+
+    auto& weight() { return m_weight; }
+    auto const& weight() const { return m_weight; }
+
+    double mass() const { return m_mass; }
+    double charge() const { return m_charge; }
+
+    // applies fn to every per-particle array of the active representation
+    template<typename Fn>
+    void for_each_array(Fn&& fn)
+    {
+        if (m_cell_relative)
+        {
+            for (auto& array : m_icell)
+                fn(array);
+            for (auto& array : m_delta)
+                fn(array);
+        }
+        else
+            for (auto& array : m_position)
+                fn(array);
+        for (auto& array : m_v)
+            fn(array);
+        fn(m_weight);
+    }
+
+    template<typename Fn>
+    void for_each_array(Fn&& fn) const
+    {
+        if (m_cell_relative)
+        {
+            for (auto const& array : m_icell)
+                fn(array);
+            for (auto const& array : m_delta)
+                fn(array);
+        }
+        else
+            for (auto const& array : m_position)
+                fn(array);
+        for (auto const& array : m_v)
+            fn(array);
+        fn(m_weight);
+    }
+
+private:
+    std::array<aligned_vector<double>, dimension> m_position;
+    std::array<aligned_vector<double>, 3> m_v;
+    aligned_vector<double> m_weight;
+    double m_mass;
+    double m_charge;
+
+    bool m_cell_relative = false;
+    std::array<aligned_vector<std::int32_t>, dimension> m_icell;
+    std::array<aligned_vector<double>, dimension> m_delta;
+    std::array<double, dimension> m_cell_size{};
+};
+
+
+#endif // HYBIRT_PARTICLE_ARRAY_HPP
@@ -0,0 +1,185 @@
+#ifndef HYBIRT_PARTICLE_BINS_HPP
+#define HYBIRT_PARTICLE_BINS_HPP
+
+#include "gridlayout.hpp"
+#include "particle_array.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+// Keeps the particles of a ParticleArray sorted by domain cell, so that the
+// particles of cell i are stored contiguously in cell_range(i). sort() is a
+// full counting sort, rebin() restores the ordering after a push by moving
+// only the particles that no longer sit inside the range of their cell.
+// Cells are numbered row-major, the last direction varying fastest.
+template<std::size_t dimension>
+class ParticleBins
+{
+public:
+    explicit ParticleBins(std::shared_ptr<GridLayout<dimension>> grid)
+        : m_grid{grid}
+    {
+        static_assert(dimension <= 2, "ParticleBins only implemented for 1D and 2D");
+        if (!m_grid)
+            throw std::runtime_error("GridLayout is null");
+        m_offsets.assign(nbr_cells() + 1, 0);
+    }
+
+    std::size_t nbr_cells() const
+    {
+        std::size_t n = 1;
+        for (std::size_t d = 0; d < dimension; ++d)
+            n *= m_grid->nbr_cells(static_cast<Direction>(d));
+        return n;
+    }
+
+    // particles of domain cell iCell (0 based) are [first, second)
+    std::pair<std::size_t, std::size_t> cell_range(std::size_t iCell) const
+    {
+        return {m_offsets[iCell], m_offsets[iCell + 1]};
+    }
+
+    auto const& offsets() const { return m_offsets; }
+
+    void sort(ParticleArray<dimension>& particles)
+    {
+        auto const n = particles.size();
+        count(particles);
+
+        // destination of each particle, stable within a cell
+        m_destination.resize(n);
+        auto cursor = m_offsets;
+        for (std::size_t ip = 0; ip < n; ++ip)
+            m_destination[ip] = cursor[m_cells[ip]]++;
+
+        particles.for_each_array([&](auto& array) {
+            auto& scratch = scratch_for(array);
+            scratch.resize(n);
+            for (std::size_t ip = 0; ip < n; ++ip)
+                scratch[m_destination[ip]] = array[ip];
+            array.swap(scratch);
+        });
+
+        for (std::size_t iCell = 0; iCell < nbr_cells(); ++iCell)
+            std::fill(m_cells.begin() + m_offsets[iCell], m_cells.begin() + m_offsets[iCell + 1],
+                      static_cast<std::uint32_t>(iCell));
+    }
+
+    // returns the number of particles moved. Particles added or removed since
+    // the last call, e.g. migrated between patches, are simply misplaced ones.
+    std::size_t rebin(ParticleArray<dimension>& particles)
+    {
+        if (m_cells.empty())
+        {
+            sort(particles);
+            return particles.size();
+        }
+
+        count(particles);
+
+        // slots holding a particle of another cell, ascending, hence grouped by
+        // the cell whose range they belong to
+        m_holes.clear();
+        for (std::size_t iCell = 0; iCell < nbr_cells(); ++iCell)
+            for (auto ip = m_offsets[iCell]; ip < m_offsets[iCell + 1]; ++ip)
+                if (m_cells[ip] != iCell)
+                    m_holes.push_back(ip);
+
+        if (m_holes.empty())
+            return 0;
+
+        // the same particles ordered by the cell they must go to, so that the
+        // k-th of them fills the k-th hole
+        m_movers = m_holes;
+        std::stable_sort(m_movers.begin(), m_movers.end(),
+                         [this](auto a, auto b) { return m_cells[a] < m_cells[b]; });
+
+        auto const nbr_moved = m_holes.size();
+        particles.for_each_array([&](auto& array) {
+            auto& scratch = scratch_for(array);
+            scratch.resize(nbr_moved);
+            for (std::size_t k = 0; k < nbr_moved; ++k)
+                scratch[k] = array[m_movers[k]];
+            for (std::size_t k = 0; k < nbr_moved; ++k)
+                array[m_holes[k]] = scratch[k];
+        });
+
+        m_moved_cells.resize(nbr_moved);
+        for (std::size_t k = 0; k < nbr_moved; ++k)
+            m_moved_cells[k] = m_cells[m_movers[k]];
+        for (std::size_t k = 0; k < nbr_moved; ++k)
+            m_cells[m_holes[k]] = m_moved_cells[k];
+
+        return nbr_moved;
+    }
+
+private:
+    aligned_vector<double>& scratch_for(aligned_vector<double> const&) { return m_scratch; }
+    aligned_vector<std::int32_t>& scratch_for(aligned_vector<std::int32_t> const&)
+    {
+        return m_int_scratch;
+    }
+
+    std::uint32_t cell_of(Direction dir, double x) const
+    {
+        auto const iCell = static_cast<long>(std::floor(x / m_grid->cell_size(dir)));
+        return static_cast<std::uint32_t>(
+            std::clamp<long>(iCell, 0, static_cast<long>(m_grid->nbr_cells(dir)) - 1));
+    }
+
+    // computes the cell of each particle and the cell offsets
+    void count(ParticleArray<dimension> const& particles)
+    {
+        m_cells.resize(particles.size());
+        std::fill(m_offsets.begin(), m_offsets.end(), 0);
+
+        // row-major cell index, one direction after the other
+        for (std::size_t d = 0; d < dimension; ++d)
+        {
+            auto const dir = static_cast<Direction>(d);
+            auto const n   = static_cast<std::uint32_t>(m_grid->nbr_cells(dir));
+            if (particles.cell_relative())
+            {
+                auto const& icell = particles.icell(dir);
+                auto const last   = static_cast<std::int32_t>(n) - 1;
+                for (std::size_t ip = 0; ip < icell.size(); ++ip)
+                    m_cells[ip] = (d == 0 ? 0 : m_cells[ip] * n)
+                                  + static_cast<std::uint32_t>(std::clamp(icell[ip], 0, last));
+            }
+            else
+            {
+                auto const& xs = particles.position(dir);
+                for (std::size_t ip = 0; ip < xs.size(); ++ip)
+                    m_cells[ip] = (d == 0 ? 0 : m_cells[ip] * n) + cell_of(dir, xs[ip]);
+            }
+        }
+
+        for (std::size_t ip = 0; ip < m_cells.size(); ++ip)
+            ++m_offsets[m_cells[ip] + 1];
+        for (std::size_t iCell = 0; iCell < nbr_cells(); ++iCell)
+            m_offsets[iCell + 1] += m_offsets[iCell];
+    }
+
+    std::shared_ptr<GridLayout<dimension>> m_grid;
+    std::vector<std::size_t> m_offsets;
+    std::vector<std::uint32_t> m_cells;
+
+    // scratch buffers, kept between calls to avoid reallocations
+    std::vector<std::size_t> m_destination;
+    std::vector<std::size_t> m_holes;
+    std::vector<std::size_t> m_movers;
+    std::vector<std::uint32_t> m_moved_cells;
+    aligned_vector<double> m_scratch;
+    aligned_vector<std::int32_t> m_int_scratch;
+};
+
+
+#endif // HYBIRT_PARTICLE_BINS_HPP
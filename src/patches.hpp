@@ -0,0 +1,488 @@
+#ifndef HYBIRT_PATCHES_HPP
+#define HYBIRT_PATCHES_HPP
+
+#include "ampere.hpp"
+#include "boundary_condition.hpp"
+#include "faraday.hpp"
+#include "field.hpp"
+#include "fused_fields.hpp"
+#include "gridlayout.hpp"
+#include "ohm.hpp"
+#include "particle_array.hpp"
+#include "population.hpp"
+#include "push_deposit.hpp"
+#include "pusher.hpp"
+#include "thread_pool.hpp"
+#include "timers.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Fields, particles and solvers of one patch of the domain. Particle
+// positions are relative to the origin of the patch layout.
+template<std::size_t dimension>
+struct Patch
+{
+    Patch(std::shared_ptr<GridLayout<dimension>> grid, double dt)
+        : layout{grid}
+        , E{grid, {Quantity::Ex, Quantity::Ey, Quantity::Ez}}
+        , B{grid, {Quantity::Bx, Quantity::By, Quantity::Bz}}
+        , Enew{grid, {Quantity::Ex, Quantity::Ey, Quantity::Ez}}
+        , Bnew{grid, {Quantity::Bx, Quantity::By, Quantity::Bz}}
+        , Esub{grid, {Quantity::Ex, Quantity::Ey, Quantity::Ez}}
+        , Bsub{grid, {Quantity::Bx, Quantity::By, Quantity::Bz}}
+        , J{grid, {Quantity::Jx, Quantity::Jy, Quantity::Jz}}
+        , V{grid, {Quantity::Vx, Quantity::Vy, Quantity::Vz}}
+        , N{grid->allocate(Quantity::N), Quantity::N}
+        , faraday{grid, dt}
+        , ampere{grid}
+        , ohm{grid}
+        , fused_fields{grid, dt}
+        , push{grid, dt}
+        , push_deposit{grid, push}
+    {
+    }
+
+    std::shared_ptr<GridLayout<dimension>> layout;
+
+    VecField<dimension> E;
+    VecField<dimension> B;
+    VecField<dimension> Enew;
+    VecField<dimension> Bnew;
+    // fields at the start of a field substep, see Simulation
+    VecField<dimension> Esub;
+    VecField<dimension> Bsub;
+    VecField<dimension> J;
+    VecField<dimension> V;
+    Field<dimension> N;
+
+    std::vector<Population<dimension>> populations;
+
+    Faraday<dimension> faraday;
+    Ampere<dimension> ampere;
+    Ohm<dimension> ohm;
+    FusedFieldSolver<dimension> fused_fields;
+    Boris<dimension> push;
+    PushDeposit<dimension> push_deposit;
+};
+
+
+
+// Periodic domain split along x into patches, each with its own layout,
+// fields and particles. Work on the patches runs in parallel on the thread
+// pool. Ghost nodes are filled from the neighbouring patches, which for a
+// single patch is the periodic boundary condition, and particles leaving a
+// patch migrate to its neighbour. With MPI, the patches split the subdomain
+// of a rank and the exchanges at its two ends go to the neighbouring ranks.
+template<std::size_t dimension>
+class PatchedDomain
+{
+public:
+    PatchedDomain(std::array<std::size_t, dimension> nbr_cells,
+                  std::array<double, dimension> cell_size, std::size_t nbr_ghosts,
+                  std::size_t nbr_patches, double dt, ThreadPool& pool)
+        : PatchedDomain{std::make_shared<GridLayout<dimension>>(nbr_cells, cell_size, nbr_ghosts),
+                        nbr_patches, dt, pool}
+    {
+    }
+
+    // splits the cells of layout, the whole domain or the subdomain of a rank
+    PatchedDomain(std::shared_ptr<GridLayout<dimension>> layout, std::size_t nbr_patches,
+                  double dt, ThreadPool& pool)
+        : m_layout{layout}
+        , m_pool{pool}
+    {
+        static_assert(dimension == 1, "PatchedDomain only implemented for 1D");
+
+        auto const nbr_cells  = m_layout->nbr_cells(Direction::X);
+        auto const cell_size  = m_layout->cell_size(Direction::X);
+        auto const nbr_ghosts = m_layout->nbr_ghosts();
+
+        // ghosts must be filled from the domain of the direct neighbours
+        if (nbr_patches == 0 or nbr_cells / nbr_patches <= nbr_ghosts)
+            throw std::runtime_error("Too many patches for the number of cells");
+
+        for (std::size_t ip = 0; ip < nbr_patches; ++ip)
+        {
+            auto const [first, last] = ThreadPool::chunk_range(nbr_cells, nbr_patches, ip);
+            auto grid                = std::make_shared<GridLayout<dimension>>(
+                std::array<std::size_t, dimension>{last - first},
+                std::array<double, dimension>{cell_size}, nbr_ghosts,
+                std::array<double, dimension>{m_layout->origin(Direction::X) + first * cell_size});
+            m_patches.push_back(std::make_unique<Patch<dimension>>(grid, dt));
+            m_first_cell.push_back(first);
+        }
+    }
+
+#if HYBIRT_HAVE_MPI
+    // from now on, exchanges at the two ends of the patches go through
+    // remote to the neighbouring ranks instead of wrapping around
+    void set_remote(std::shared_ptr<RemoteBoundaryCondition<dimension>> remote)
+    {
+        m_remote = remote;
+    }
+#endif
+
+    // layout split by the patches
+    auto const& layout() const { return m_layout; }
+
+    ThreadPool& pool() { return m_pool; }
+
+    // whether the ends of the domain exchange with other ranks
+    bool has_remote() const
+    {
+#if HYBIRT_HAVE_MPI
+        return m_remote != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // smallest value over the ranks, value itself without MPI
+    double reduce_min(double value) const
+    {
+#if HYBIRT_HAVE_MPI
+        if (m_remote)
+            return m_remote->reduce_min(value);
+#endif
+        return value;
+    }
+
+    std::size_t size() const { return m_patches.size(); }
+
+    auto& operator[](std::size_t ip) { return *m_patches[ip]; }
+    auto const& operator[](std::size_t ip) const { return *m_patches[ip]; }
+
+    // index in the domain layout of the first domain cell of patch ip
+    std::size_t first_cell(std::size_t ip) const { return m_first_cell[ip]; }
+
+    // nodes [first, second] of qty that patch ip contributes to the whole
+    // layout: its domain, plus the outer ghosts for the first and last patches
+    std::pair<std::size_t, std::size_t> owned_nodes(std::size_t ip, Quantity qty) const
+    {
+        auto const& grid = *m_patches[ip]->layout;
+        auto const first = ip == 0 ? grid.ghost_start(qty, Direction::X)
+                                   : grid.dom_start(qty, Direction::X);
+        auto const last  = ip == size() - 1 ? grid.ghost_end(qty, Direction::X)
+                                            : grid.dom_end(qty, Direction::X);
+        return {first, last};
+    }
+
+    std::size_t nbr_populations() const { return m_patches[0]->populations.size(); }
+
+    void add_population(std::string const& name, double mass = 1.0, double charge = 1.0)
+    {
+        for (auto& patch : m_patches)
+            patch->populations.emplace_back(name, patch->layout, mass, charge);
+    }
+
+    // calls fn(patch) for every patch, patches in parallel
+    template<typename Fn>
+    void for_each_patch(Fn&& fn)
+    {
+        m_pool.parallel_for(size(), [&](std::size_t ip) { fn(*m_patches[ip]); });
+    }
+
+    // fills the ghost nodes of select(patch), a Field or a VecField of every
+    // patch, from the neighbouring patches. select may be a pointer to a
+    // Patch member. Moments (N, Vx, Vy, Vz) hold the deposit of each side in
+    // the node shared by two patches, which is summed.
+    template<typename Select>
+    void fill(Select&& select)
+    {
+        HYBIRT_TIME_SCOPE(Stage::Fill);
+        for_each_component(select, [this](auto&& select_field) {
+            auto const quantity = select_field(*m_patches[0]).quantity();
+            bool const moment   = quantity == Quantity::N or quantity == Quantity::Vx
+                                or quantity == Quantity::Vy or quantity == Quantity::Vz;
+
+#if HYBIRT_HAVE_MPI
+            if (m_remote)
+                m_remote->begin_fill(select_field(*m_patches.front()),
+                                     select_field(*m_patches.back()));
+#endif
+            bool const remote = has_remote();
+            auto const last   = size() - 1;
+
+            // patches only write their own first domain node, and only read
+            // the last domain node of their left neighbour
+            if (moment)
+            {
+                m_pool.parallel_for(size(), [&](std::size_t ip) {
+                    if (remote and ip == 0)
+                        return;
+                    auto& field       = select_field(*m_patches[ip]);
+                    auto const& left  = select_field(*m_patches[left_of(ip)]);
+                    auto const& grid  = *m_patches[ip]->layout;
+                    auto const& lgrid = *m_patches[left_of(ip)]->layout;
+                    field(grid.dom_start(quantity, Direction::X))
+                        += left(lgrid.dom_end(quantity, Direction::X));
+                });
+            }
+
+            // ghosts are read from the neighbour domain nodes, which nobody writes
+            m_pool.parallel_for(size(), [&](std::size_t ip) {
+                auto& field       = select_field(*m_patches[ip]);
+                auto const& left  = select_field(*m_patches[left_of(ip)]);
+                auto const& right = select_field(*m_patches[right_of(ip)]);
+                auto const& grid  = *m_patches[ip]->layout;
+
+                std::size_t const gsi = 0;
+                auto const dsi        = grid.dom_start(quantity, Direction::X);
+                auto const dei        = grid.dom_end(quantity, Direction::X);
+                auto const gei        = grid.ghost_end(quantity, Direction::X);
+                auto const nbr_cells  = grid.nbr_cells(Direction::X);
+                auto const left_cells = m_patches[left_of(ip)]->layout->nbr_cells(Direction::X);
+
+                if (!(remote and ip == 0))
+                    for (auto ix = gsi; ix < dsi; ++ix)
+                        field(ix) = left(ix + left_cells);
+                if (!(remote and ip == last))
+                {
+                    for (auto ix = dei + 1; ix <= gei; ++ix)
+                        field(ix) = right(ix - nbr_cells);
+                    if (moment)
+                        field(dei) = right(dsi);
+                }
+            });
+
+#if HYBIRT_HAVE_MPI
+            if (m_remote)
+                m_remote->end_fill();
+#endif
+        });
+    }
+
+    // copies select(patch) of every patch into global, defined on layout().
+    // Ghosts come from the first and last patches.
+    template<typename Select, typename Global>
+    void gather(Select&& select, Global& global)
+    {
+        if constexpr (std::is_same_v<Global, VecField<dimension>>)
+        {
+            gather([&](auto& patch) -> auto& { return std::invoke(select, patch).x; }, global.x);
+            gather([&](auto& patch) -> auto& { return std::invoke(select, patch).y; }, global.y);
+            gather([&](auto& patch) -> auto& { return std::invoke(select, patch).z; }, global.z);
+        }
+        else
+        {
+            for (std::size_t ip = 0; ip < size(); ++ip)
+            {
+                auto const& field        = std::invoke(select, *m_patches[ip]);
+                auto const [first, last] = owned_nodes(ip, field.quantity());
+                for (auto ix = first; ix <= last; ++ix)
+                    global(ix + m_first_cell[ip]) = field(ix);
+            }
+        }
+    }
+
+    // moves the particles that left their patch to the neighbouring patch,
+    // wrapping around the domain
+    void migrate_particles()
+    {
+        HYBIRT_TIME_SCOPE(Stage::Migrate);
+        m_outgoing.resize(size());
+
+        m_pool.parallel_for(size(), [&](std::size_t ip) {
+            auto& patch    = *m_patches[ip];
+            auto& outgoing = m_outgoing[ip];
+            outgoing.resize(patch.populations.size());
+
+            for (std::size_t ipop = 0; ipop < patch.populations.size(); ++ipop)
+            {
+                auto& particles = patch.populations[ipop].particles();
+                auto& [to_left, to_right] = outgoing[ipop];
+                if (to_left.cell_relative() != particles.cell_relative())
+                {
+                    to_left  = particles.empty_like();
+                    to_right = particles.empty_like();
+                }
+                to_left.clear();
+                to_right.clear();
+
+                // backwards, so that the particle swapped in has been checked
+                for (auto i = particles.size(); i-- > 0;)
+                {
+                    auto const side = exit_side(*patch.layout, particles, i);
+                    if (side == 0)
+                        continue;
+                    (side < 0 ? to_left : to_right).push_back(particles, i);
+                    particles.swap_remove(i);
+                }
+            }
+        });
+
+#if HYBIRT_HAVE_MPI
+        if (m_remote)
+            exchange_remote_particles();
+#endif
+        bool const remote = has_remote();
+        auto const last   = size() - 1;
+
+        m_pool.parallel_for(size(), [&](std::size_t ip) {
+            auto& patch = *m_patches[ip];
+            auto const left_cells
+                = static_cast<int>(m_patches[left_of(ip)]->layout->nbr_cells(Direction::X));
+            auto const nbr_cells = static_cast<int>(patch.layout->nbr_cells(Direction::X));
+
+            for (std::size_t ipop = 0; ipop < patch.populations.size(); ++ipop)
+            {
+                auto& particles = patch.populations[ipop].particles();
+                if (remote and ip == 0)
+                    receive(patch, particles, m_incoming[ipop].from_left, 0);
+                else
+                    receive(patch, particles, m_outgoing[left_of(ip)][ipop].to_right, -left_cells);
+                if (remote and ip == last)
+                    receive(patch, particles, m_incoming[ipop].from_right, nbr_cells);
+                else
+                    receive(patch, particles, m_outgoing[right_of(ip)][ipop].to_left, nbr_cells);
+            }
+        });
+    }
+
+    // copies the particles of population ipop of all patches into particles,
+    // with positions relative to the origin of layout()
+    void gather_particles(std::size_t ipop, ParticleArray<dimension>& particles) const
+    {
+        particles.clear();
+        for (std::size_t ip = 0; ip < size(); ++ip)
+        {
+            auto const& patch_particles = m_patches[ip]->populations[ipop].particles();
+            auto const offset = m_first_cell[ip] * m_layout->cell_size(Direction::X);
+            for (std::size_t i = 0; i < patch_particles.size(); ++i)
+            {
+                auto particle = patch_particles[i];
+                particle.position[0] += offset;
+                particles.push_back(particle);
+            }
+        }
+    }
+
+    // adds particles, with positions relative to the origin of layout(), to
+    // population ipop of the patches they sit in
+    void distribute_particles(std::size_t ipop, ParticleArray<dimension> const& particles)
+    {
+        auto const dx = m_layout->cell_size(Direction::X);
+        for (std::size_t i = 0; i < particles.size(); ++i)
+        {
+            auto particle   = particles[i];
+            auto const cell = static_cast<std::size_t>(std::clamp<long>(
+                static_cast<long>(std::floor(particle.position[0] / dx)), 0,
+                static_cast<long>(m_layout->nbr_cells(Direction::X)) - 1));
+            auto const ip = static_cast<std::size_t>(
+                std::upper_bound(m_first_cell.begin(), m_first_cell.end(), cell)
+                - m_first_cell.begin() - 1);
+
+            auto& patch = *m_patches[ip];
+            particle.position[0] -= m_first_cell[ip] * dx;
+            patch.populations[ipop].particles().push_back(particle);
+        }
+        for (auto& patch : m_patches)
+            patch->populations[ipop].rebin();
+    }
+
+private:
+    struct Outgoing
+    {
+        ParticleArray<dimension> to_left;
+        ParticleArray<dimension> to_right;
+    };
+
+    struct Incoming
+    {
+        ParticleArray<dimension> from_left;
+        ParticleArray<dimension> from_right;
+    };
+
+    std::size_t left_of(std::size_t ip) const { return ip == 0 ? size() - 1 : ip - 1; }
+    std::size_t right_of(std::size_t ip) const { return ip + 1 == size() ? 0 : ip + 1; }
+
+    // calls fn(select_field) once for a Field selector, once per component
+    // for a VecField selector
+    template<typename Select, typename Fn>
+    void for_each_component(Select& select, Fn&& fn)
+    {
+        using Selected = std::remove_cvref_t<decltype(std::invoke(select, *m_patches[0]))>;
+        if constexpr (std::is_same_v<Selected, VecField<dimension>>)
+        {
+            fn([&](Patch<dimension>& patch) -> auto& { return std::invoke(select, patch).x; });
+            fn([&](Patch<dimension>& patch) -> auto& { return std::invoke(select, patch).y; });
+            fn([&](Patch<dimension>& patch) -> auto& { return std::invoke(select, patch).z; });
+        }
+        else
+            fn([&](Patch<dimension>& patch) -> auto& { return std::invoke(select, patch); });
+    }
+
+#if HYBIRT_HAVE_MPI
+    // sends the particles leaving the ends of the patches to the
+    // neighbouring ranks, what they send back lands in m_incoming
+    void exchange_remote_particles()
+    {
+        auto& last_patch     = *m_patches.back();
+        auto const nbr_cells = static_cast<int>(last_patch.layout->nbr_cells(Direction::X));
+        m_incoming.resize(nbr_populations());
+
+        for (std::size_t ipop = 0; ipop < nbr_populations(); ++ipop)
+        {
+            auto& to_left  = m_outgoing.front()[ipop].to_left;
+            auto& to_right = m_outgoing.back()[ipop].to_right;
+            for (std::size_t i = 0; i < to_right.size(); ++i)
+                shift_particle(*last_patch.layout, to_right, i, -nbr_cells);
+
+            auto& [from_left, from_right] = m_incoming[ipop];
+            if (from_left.cell_relative() != to_left.cell_relative())
+            {
+                from_left  = to_left.empty_like();
+                from_right = to_left.empty_like();
+            }
+            from_left.clear();
+            from_right.clear();
+            m_remote->exchange_particles(to_left, to_right, from_left, from_right);
+        }
+    }
+#endif
+
+    // appends the incoming particles, shifted by shift cells into the patch frame
+    static void receive(Patch<dimension> const& patch, ParticleArray<dimension>& particles,
+                        ParticleArray<dimension> const& incoming, int shift)
+    {
+        for (std::size_t i = 0; i < incoming.size(); ++i)
+        {
+            particles.push_back(incoming, i);
+            shift_particle(*patch.layout, particles, particles.size() - 1, shift);
+
+            if (exit_side(*patch.layout, particles, particles.size() - 1) != 0)
+                throw std::runtime_error("Particle crossed more than one patch in a step");
+        }
+    }
+
+    std::shared_ptr<GridLayout<dimension>> m_layout;
+    ThreadPool& m_pool;
+    std::vector<std::unique_ptr<Patch<dimension>>> m_patches;
+    std::vector<std::size_t> m_first_cell;
+
+    // per patch and population, particles leaving on each side
+    std::vector<std::vector<Outgoing>> m_outgoing;
+
+    // per population, particles from the neighbouring ranks
+    std::vector<Incoming> m_incoming;
+
+#if HYBIRT_HAVE_MPI
+    std::shared_ptr<RemoteBoundaryCondition<dimension>> m_remote;
+#endif
+};
+
+
+#endif // HYBIRT_PATCHES_HPP
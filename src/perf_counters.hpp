@@ -0,0 +1,139 @@
+#ifndef HYBIRT_PERF_COUNTERS_HPP
+#define HYBIRT_PERF_COUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+enum class PerfEvent : std::size_t { Cycles, Instructions, LlcMisses, BranchMisses, count };
+
+inline char const* perf_event_name(PerfEvent event)
+{
+    constexpr std::array<char const*, static_cast<std::size_t>(PerfEvent::count)> names
+        = {"cycles", "instructions", "LLC misses", "branch misses"};
+    return names[static_cast<std::size_t>(event)];
+}
+
+
+
+// Hardware counters of the calling thread, user space only, read with
+// perf_event_open on Linux. The events that open are read as one group so
+// that they count over the same intervals. Events the kernel, the CPU or a
+// virtual machine do not provide are left out, and read as zero.
+class PerfCounters
+{
+public:
+    static constexpr std::size_t nbr_events = static_cast<std::size_t>(PerfEvent::count);
+    using Values                            = std::array<std::uint64_t, nbr_events>;
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        constexpr std::array<std::uint64_t, nbr_events> configs
+            = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+               PERF_COUNT_HW_BRANCH_MISSES};
+
+        for (std::size_t i = 0; i < nbr_events; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = configs[i];
+            attr.disabled       = m_leader < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                             | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int const fd = static_cast<int>(
+                ::syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+            if (fd < 0)
+            {
+                if (m_error.empty())
+                    m_error = std::string{perf_event_name(static_cast<PerfEvent>(i))} + ": "
+                              + std::strerror(errno);
+                continue;
+            }
+            if (m_leader < 0)
+                m_leader = fd;
+            m_fds[i]   = fd;
+            m_slot[i]  = m_nbr_open++;
+        }
+        if (m_leader >= 0)
+            ::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+        m_error = "perf_event_open needs Linux";
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (auto fd : m_fds)
+            if (fd >= 0)
+                ::close(fd);
+#endif
+    }
+
+    PerfCounters(PerfCounters const&)            = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+
+    bool available() const { return m_leader >= 0; }
+    bool available(PerfEvent event) const { return m_fds[static_cast<std::size_t>(event)] >= 0; }
+
+    // why the first event that failed did not open, empty if all did
+    std::string const& error() const { return m_error; }
+
+    // counts since the counters opened, scaled up when the kernel had to
+    // multiplex them with other events
+    Values read() const
+    {
+        Values values{};
+#if defined(__linux__)
+        if (m_leader < 0)
+            return values;
+
+        // nr, time enabled, time running, then one value per open event
+        std::array<std::uint64_t, 3 + nbr_events> buffer{};
+        if (::read(m_leader, buffer.data(), sizeof(buffer)) <= 0)
+            return values;
+
+        auto const enabled = buffer[1];
+        auto const running = buffer[2];
+        double const scale = running > 0 ? static_cast<double>(enabled) / running : 1.0;
+        for (std::size_t i = 0; i < nbr_events; ++i)
+            if (m_fds[i] >= 0)
+                values[i] = static_cast<std::uint64_t>(buffer[3 + m_slot[i]] * scale);
+#endif
+        return values;
+    }
+
+    // counters of the calling thread, opened on first use
+    static PerfCounters const& this_thread()
+    {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+private:
+    std::array<int, nbr_events> m_fds{-1, -1, -1, -1};
+    std::array<std::size_t, nbr_events> m_slot{};
+    std::size_t m_nbr_open = 0;
+    int m_leader           = -1;
+    std::string m_error;
+};
+
+
+#endif // HYBIRT_PERF_COUNTERS_HPP
@@ -4,12 +4,19 @@
 #include "field.hpp"
 #include "vecfield.hpp"
 #include "particle.hpp"
+#include "particle_array.hpp"
+#include "particle_bins.hpp"
+#include "thread_pool.hpp"
 
 #include <random>
 #include <optional>
 #include <iostream>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
 
 
 std::mt19937_64 getRNG(std::optional<std::size_t> const& seed)
@@ -44,11 +51,18 @@ template<std::size_t dimension>
 class Population
 {
 public:
-    Population(std::string name, std::shared_ptr<GridLayout<dimension>> grid)
+    static constexpr std::size_t default_deposit_slices = 8;
+
+    Population(std::string name, std::shared_ptr<GridLayout<dimension>> grid, double mass = 1.0,
+               double charge = 1.0)
         : m_name{name}
         , m_grid{grid}
         , m_flux{grid, {Quantity::Vx, Quantity::Vy, Quantity::Vz}}
         , m_density(m_grid->allocate(Quantity::N), {Quantity::N})
+        , m_particles{mass, charge}
+        , m_saved_particles{mass, charge}
+        , m_bins{grid}
+        , m_rng{getRNG(std::nullopt)}
     {
         if (!grid)
             throw std::runtime_error("GridLayout is null");
@@ -58,10 +72,10 @@ public:
     void load_particles(int nppc, auto density)
     {
         static_assert(dimension == 1, "Population only implemented for 1D");
-        auto randGen = getRNG(std::nullopt);
         std::array<double, 3> Vth{0.2, 0.2, 0.2}; // thermal velocity in each direction
         std::array<double, 3> V{0.0, 0.0, 0.0};   // bulk velocity
 
+        m_particles.reserve(m_particles.size() + nppc * m_grid->nbr_cells(Direction::X));
         for (auto iCell = m_grid->dual_dom_start(Direction::X);
              iCell <= m_grid->dual_dom_end(Direction::X); ++iCell)
         {
@@ -72,22 +86,21 @@ public:
             for (auto partIdx = 0; partIdx < nppc; ++partIdx)
             {
                 Particle<1> particle;
-                particle.position[0]
-                    = x + 0.0 * m_grid->cell_size(Direction::X); // center of the cell
-                maxwellianVelocity(V, Vth, randGen, particle.v);
+                // positions are relative to the layout origin
+                particle.position[0] = x - m_grid->origin(Direction::X)
+                                       + 0.0 * m_grid->cell_size(Direction::X); // center of the cell
+                maxwellianVelocity(V, Vth, m_rng, particle.v);
                 particle.weight = cell_weight;
-                particle.mass   = 1.0; // hard-coded mass
-                particle.charge = 1.0; // hard-coded charge
 
                 m_particles.push_back(particle);
             }
         }
+        m_bins.sort(m_particles);
         std::cout << "Loaded " << m_particles.size() << " particles.\n";
     }
 
     void deposit()
     {
-        static_assert(dimension == 1, "Population only implemented for 1D");
         for (auto& n : m_density)
         {
             n = 0.0; // Reset the field
@@ -100,36 +113,199 @@ public:
         for (auto& fz : m_flux.z)
             fz = 0.0;
 
-        for (auto const& particle : m_particles)
+        deposit(0, m_particles.size(), m_density.view(), m_flux.view());
+    }
+
+    // The threads of the pool deposit contiguous slices of the particles
+    // into their own buffers, which are then summed node by node in slice
+    // order. The number of slices is deposit_slices(), not the number of
+    // threads, so the result is the same bit for bit whatever the pool size
+    // and the scheduling.
+    void deposit(ThreadPool& pool)
+    {
+        scatter(pool, [this](std::size_t first, std::size_t last, auto density, auto flux) {
+            deposit(first, last, density, flux);
+        });
+    }
+
+    // slices of the threaded deposit, each with its own buffers
+    std::size_t deposit_slices() const { return m_deposit_slices; }
+    void deposit_slices(std::size_t slices)
+    {
+        if (slices == 0)
+            throw std::runtime_error("Deposit needs at least one slice");
+        m_deposit_slices = slices;
+    }
+
+    // Runs kernel(first, last, density, flux) on deposit_slices() slices of
+    // the particles and sums what they scattered into the population
+    // density and flux. Slices get private, zeroed buffers when there is
+    // more than one.
+    template<typename Kernel>
+    void scatter(ThreadPool& pool, Kernel&& kernel)
+    {
+        auto const nbr_slices = m_deposit_slices;
+        if (nbr_slices == 1)
+        {
+            std::fill(m_density.begin(), m_density.end(), 0.0);
+            std::fill(m_flux.x.begin(), m_flux.x.end(), 0.0);
+            std::fill(m_flux.y.begin(), m_flux.y.end(), 0.0);
+            std::fill(m_flux.z.begin(), m_flux.z.end(), 0.0);
+            kernel(std::size_t{0}, m_particles.size(), m_density.view(), m_flux.view());
+            return;
+        }
+
+        auto const shape = m_grid->allocate(Quantity::N);
+        m_deposit_buffers.resize(nbr_slices, DepositBuffer{shape});
+
+        pool.parallel_for(nbr_slices, [&](std::size_t slice) {
+            auto& buffer = m_deposit_buffers[slice];
+            buffer.reset();
+            auto const [first, last] = ThreadPool::chunk_range(m_particles.size(), nbr_slices, slice);
+            kernel(first, last, buffer.density.view(), buffer.flux_view());
+        });
+
+        auto density = m_density.view();
+        auto flux    = m_flux.view();
+        pool.parallel_for(nbr_slices, [&](std::size_t slice) {
+            auto const [first, last] = ThreadPool::chunk_range(density.size(), nbr_slices, slice);
+            for (auto ix = first; ix < last; ++ix)
+            {
+                double n = 0, fx = 0, fy = 0, fz = 0;
+                for (auto const& buffer : m_deposit_buffers)
+                {
+                    n += buffer.density.data()[ix];
+                    fx += buffer.flux[0].data()[ix];
+                    fy += buffer.flux[1].data()[ix];
+                    fz += buffer.flux[2].data()[ix];
+                }
+                density[ix] = n;
+                flux.x[ix]  = fx;
+                flux.y[ix]  = fy;
+                flux.z[ix]  = fz;
+            }
+        });
+    }
+
+    // scatters particles [first, last) into the given density and flux
+    void deposit(std::size_t first, std::size_t last, FieldView<dimension, double> density,
+                 VecFieldView<dimension, double> flux) const
+    {
+        if constexpr (dimension == 2)
+            deposit_2d(first, last, density, flux);
+        else
+            deposit_1d(first, last, density, flux);
+    }
+
+    // linear scatter onto the two primal nodes around each particle
+    void deposit_1d(std::size_t first, std::size_t last, FieldView<dimension, double> density,
+                    VecFieldView<dimension, double> flux) const
+    {
+        auto const& vx = m_particles.v(0);
+        auto const& vy = m_particles.v(1);
+        auto const& vz = m_particles.v(2);
+        auto const& ws = m_particles.weight();
+
+        // left: primal node on the left of the particle, w1: weight to the right
+        auto scatter = [&](std::size_t ip, int left, double w1) {
+            double w0 = 1.0 - w1;
+            // the last domain node is shared with the next patch, or with the
+            // first node when periodic, ghost filling sums them
+            int right = left + 1;
+
+            density(left)  += ws[ip] * w0;
+            density(right) += ws[ip] * w1;
+            
+            flux.x(left)   += ws[ip] * vx[ip] * w0;
+            flux.x(right)  += ws[ip] * vx[ip] * w1;
+            flux.y(left)   += ws[ip] * vy[ip] * w0;
+            flux.y(right)  += ws[ip] * vy[ip] * w1;
+            flux.z(left)   += ws[ip] * vz[ip] * w0;
+            flux.z(right)  += ws[ip] * vz[ip] * w1;
+        };
+
+        if (m_particles.cell_relative())
+        {
+            // cell and offset are stored, no divide nor fmod needed
+            auto const& icell = m_particles.icell(Direction::X);
+            auto const& delta = m_particles.delta(Direction::X);
+            for (std::size_t ip = first; ip < last; ++ip)
+                scatter(ip, icell[ip] + m_grid->dual_dom_start(Direction::X), delta[ip]);
+            return;
+        }
+
+        auto const& xs = m_particles.position(Direction::X);
+        for (std::size_t ip = first; ip < last; ++ip)
         {
             double const dx    = m_grid->cell_size(Direction::X);
-            double const x     = std::fmod(std::fmod(particle.position[0], dx * m_grid->nbr_cells(Direction::X)) + dx * m_grid->nbr_cells(Direction::X),
+            double const x     = std::fmod(std::fmod(xs[ip], dx * m_grid->nbr_cells(Direction::X)) + dx * m_grid->nbr_cells(Direction::X),
                                            dx * m_grid->nbr_cells(Direction::X));
             double       s     = x / dx;                              // in [0, Nx)
             int          i0    = static_cast<int>(std::floor(s));     // left node (primal)
             double       w1    = s - i0;                              // weight to the right
-            double       w0    = 1.0 - w1;
-            
-            int left  = i0 + m_grid->dual_dom_start(Direction::X);
-            int right = left + 1;
             
-            // wrap the right index onto the next cell (periodic)
-            if (right > m_grid->dual_dom_end(Direction::X)) {
-                right = m_grid->dual_dom_start(Direction::X);
+            scatter(ip, i0 + m_grid->dual_dom_start(Direction::X), w1);
+        }
+    }
+
+    // bilinear scatter onto the four primal nodes around each particle
+    void deposit_2d(std::size_t first, std::size_t last, FieldView<dimension, double> density,
+                    VecFieldView<dimension, double> flux) const
+    {
+        auto const& vx   = m_particles.v(0);
+        auto const& vy   = m_particles.v(1);
+        auto const& vz   = m_particles.v(2);
+        auto const& ws   = m_particles.weight();
+        auto const ghost = static_cast<int>(m_grid->dual_dom_start(Direction::X));
+
+        for (std::size_t ip = first; ip < last; ++ip)
+        {
+            // primal node on the lower left of the particle, weight to the
+            // upper right
+            int node[2];
+            double w1[2];
+            for (std::size_t d = 0; d < 2; ++d)
+            {
+                auto const dir = static_cast<Direction>(d);
+                if (m_particles.cell_relative())
+                {
+                    node[d] = m_particles.icell(dir)[ip];
+                    w1[d]   = m_particles.delta(dir)[ip];
+                }
+                else
+                {
+                    double const s = m_particles.position(dir)[ip] / m_grid->cell_size(dir);
+                    node[d]        = static_cast<int>(std::floor(s));
+                    w1[d]          = s - node[d];
+                }
+                node[d] += ghost;
             }
-            
-            m_density(left)  += particle.weight * w0;
-            m_density(right) += particle.weight * w1;
-            
-            m_flux.x(left)   += particle.weight * particle.v[0] * w0;
-            m_flux.x(right)  += particle.weight * particle.v[0] * w1;
-            m_flux.y(left)   += particle.weight * particle.v[1] * w0;
-            m_flux.y(right)  += particle.weight * particle.v[1] * w1;
-            m_flux.z(left)   += particle.weight * particle.v[2] * w0;
-            m_flux.z(right)  += particle.weight * particle.v[2] * w1;
+
+            double const w[2][2] = {{(1.0 - w1[0]) * (1.0 - w1[1]), (1.0 - w1[0]) * w1[1]},
+                                    {w1[0] * (1.0 - w1[1]), w1[0] * w1[1]}};
+            for (int i = 0; i < 2; ++i)
+                for (int j = 0; j < 2; ++j)
+                {
+                    auto const ix = node[0] + i;
+                    auto const iy = node[1] + j;
+                    auto const wn = ws[ip] * w[i][j];
+                    density(ix, iy) += wn;
+                    flux.x(ix, iy) += wn * vx[ip];
+                    flux.y(ix, iy) += wn * vy[ip];
+                    flux.z(ix, iy) += wn * vz[ip];
+                }
         }
     }
 
+    // stores positions as cell index plus in-cell offset from now on
+    void use_cell_relative_positions()
+    {
+        std::array<double, dimension> cell_size;
+        for (std::size_t d = 0; d < dimension; ++d)
+            cell_size[d] = m_grid->cell_size(static_cast<Direction>(d));
+        m_particles.to_cell_relative(cell_size);
+    }
+
     auto& density() { return m_density; }
     auto const& density() const { return m_density; }
 
@@ -139,14 +315,79 @@ public:
     auto& particles() { return m_particles; }
     auto const& particles() const { return m_particles; }
 
+    // Snapshot of the particles in a second buffer, for integrators that push
+    // from the same state more than once. save_particles swaps the two
+    // buffers, the particles are then to be pushed out of place from
+    // saved_particles() into particles(), see Boris. restore_particles swaps
+    // them back: the particles pushed since the save are dropped and the
+    // buffer must be saved again before the next restore. Neither copies a
+    // particle. The bins follow the pushed particles until the next rebin.
+    void save_particles()
+    {
+        std::swap(m_particles, m_saved_particles);
+        m_has_saved = true;
+    }
+
+    void restore_particles()
+    {
+        if (!m_has_saved)
+            throw std::runtime_error("No saved particles to restore for " + m_name);
+        std::swap(m_particles, m_saved_particles);
+        m_has_saved = false;
+    }
+
+    bool has_saved_particles() const { return m_has_saved; }
+    auto const& saved_particles() const { return m_saved_particles; }
+
+    // restores the cell ordering after particles have moved, to be called
+    // once the boundary condition brought them back into the domain
+    std::size_t rebin() { return m_bins.rebin(m_particles); }
+    auto const& bins() const { return m_bins; }
+
     auto name() const { return m_name; }
 
+    // generator of the particle loading, part of the state a restart needs
+    auto& rng() { return m_rng; }
+    auto const& rng() const { return m_rng; }
+
 private:
+    // per-thread accumulation buffers for the threaded deposit
+    struct DepositBuffer
+    {
+        explicit DepositBuffer(std::array<std::size_t, dimension> shape)
+            : density{shape, Quantity::N}
+            , flux{Field<dimension>{shape, Quantity::Vx}, Field<dimension>{shape, Quantity::Vy},
+                   Field<dimension>{shape, Quantity::Vz}}
+        {
+        }
+
+        void reset()
+        {
+            std::fill(density.begin(), density.end(), 0.0);
+            for (auto& f : flux)
+                std::fill(f.begin(), f.end(), 0.0);
+        }
+
+        VecFieldView<dimension, double> flux_view()
+        {
+            return {flux[0].view(), flux[1].view(), flux[2].view()};
+        }
+
+        Field<dimension> density;
+        std::array<Field<dimension>, 3> flux;
+    };
+
     std::string m_name;
     std::shared_ptr<GridLayout<dimension>> m_grid;
     VecField<dimension> m_flux;
     Field<dimension> m_density;
-    std::vector<Particle<dimension>> m_particles;
+    ParticleArray<dimension> m_particles;
+    ParticleArray<dimension> m_saved_particles;
+    bool m_has_saved = false;
+    ParticleBins<dimension> m_bins;
+    std::mt19937_64 m_rng;
+    std::vector<DepositBuffer> m_deposit_buffers;
+    std::size_t m_deposit_slices = default_deposit_slices;
 };
 
 #endif
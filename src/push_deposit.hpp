@@ -0,0 +1,93 @@
+#ifndef HYBIRT_PUSH_DEPOSIT_HPP
+#define HYBIRT_PUSH_DEPOSIT_HPP
+
+#include "gridlayout.hpp"
+#include "population.hpp"
+#include "pusher.hpp"
+#include "thread_pool.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+
+// Single pass over the particles of a population: blocks of particles small
+// enough to stay in L1 are pushed with the Boris kernel, wrapped back into the
+// periodic domain and deposited before moving to the next block. Equivalent
+// to running Boris, then PeriodicBoundaryCondition::particles, then
+// Population::deposit. The push is that of the Boris given, with its
+// settings, e.g. its gather grid and SIMD level.
+template<std::size_t dimension>
+class PushDeposit
+{
+public:
+    PushDeposit(std::shared_ptr<GridLayout<dimension>> layout, Boris<dimension>& push)
+        : m_layout{layout}
+        , m_push{push}
+    {
+        if (!m_layout)
+            throw std::runtime_error("GridLayout is null");
+    }
+
+    static constexpr std::size_t block_size = 256;
+
+    // E and B are VecFields or BlendedVecFields. With from_saved, the
+    // particles are pushed out of place from those Population::save_particles
+    // put aside, which are left unchanged.
+    template<typename EField, typename BField>
+    void operator()(Population<dimension>& pop, EField const& E, BField const& B, ThreadPool& pool,
+                    bool from_saved = false)
+    {
+        static_assert(dimension == 1, "PushDeposit only implemented for 1D");
+
+        auto const args = m_push.gather_grid_args(
+            from_saved ? m_push.kernel_args(pop.saved_particles(), pop.particles(), E, B)
+                       : m_push.kernel_args(pop.particles(), E, B));
+        auto const simd      = m_push.simd();
+        double const length  = m_layout->dom_size(Direction::X);
+        auto const nbr_cells = static_cast<std::int32_t>(m_layout->nbr_cells(Direction::X));
+
+        pop.scatter(pool, [&](std::size_t first, std::size_t last, auto density, auto flux) {
+            for (auto begin = first; begin < last; begin += block_size)
+            {
+                auto const end = std::min(begin + block_size, last);
+                boris_push(boris_slice(args, begin, end), simd);
+
+                if (args.icell)
+                {
+                    for (auto ip = begin; ip < end; ++ip)
+                    {
+                        auto& cell = args.icell[ip];
+                        if (cell >= nbr_cells)
+                            cell -= nbr_cells;
+                        else if (cell < 0)
+                            cell += nbr_cells;
+                    }
+                }
+                else
+                {
+                    for (auto ip = begin; ip < end; ++ip)
+                    {
+                        auto& x = args.x[ip];
+                        if (x >= length)
+                            x -= length;
+                        else if (x < 0.0)
+                            x += length;
+                    }
+                }
+
+                pop.deposit(begin, end, density, flux);
+            }
+        });
+    }
+
+private:
+    std::shared_ptr<GridLayout<dimension>> m_layout;
+    Boris<dimension>& m_push;
+};
+
+
+#endif // HYBIRT_PUSH_DEPOSIT_HPP
@@ -2,12 +2,16 @@
 #define PHARE_CORE_NUMERICS_PUSHER_PUSHER_HPP
 
 
+#include "blended_field.hpp"
 #include "vecfield.hpp"
-#include "particle.hpp"
+#include "particle_array.hpp"
+#include "boris_kernels.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <vector>
 #include <cmath>
+#include <stdexcept>
 
 
 template<std::size_t dimension>
@@ -24,8 +28,14 @@ public:
     {
     }
 
-    virtual void operator()(std::vector<Particle<dimension>>& particles,
-                            VecField<dimension> const& E, VecField<dimension> const& B)
+    virtual void operator()(ParticleArray<dimension>& particles, VecField<dimension> const& E,
+                            VecField<dimension> const& B)
+        = 0;
+
+    // same in fields blended in time between two states
+    virtual void operator()(ParticleArray<dimension>& particles,
+                            BlendedVecField<dimension> const& E,
+                            BlendedVecField<dimension> const& B)
         = 0;
 
     virtual ~Pusher() {}
@@ -39,112 +49,215 @@ class Boris : public Pusher<dimension>
 public:
     Boris(std::shared_ptr<GridLayout<dimension>> layout, double dt)
         : Pusher<dimension>{layout, dt}
+        , m_simd{simd_level()}
     {
     }
 
-    void operator()(std::vector<Particle<dimension>>& particles, VecField<dimension> const& E,
+    void operator()(ParticleArray<dimension>& particles, VecField<dimension> const& E,
                     VecField<dimension> const& B) override
     {
-        for (auto& particle : particles)
+        if constexpr (dimension == 1)
+            boris_push(gather_grid_args(kernel_args(particles, E, B)), m_simd);
+        else if constexpr (dimension == 2)
+            boris_push_2d(kernel_args_2d(particles, E, B));
+        else
+            throw std::runtime_error("Boris not implemented for this dimension");
+    }
+
+    // the kernels blend the two states when gathering, the blended fields are
+    // never stored
+    void operator()(ParticleArray<dimension>& particles, BlendedVecField<dimension> const& E,
+                    BlendedVecField<dimension> const& B) override
+    {
+        if constexpr (dimension == 1)
+            boris_push(gather_grid_args(kernel_args(particles, E, B)), m_simd);
+        else if constexpr (dimension == 2)
+            boris_push_2d(kernel_args_2d(particles, E, B));
+        else
+            throw std::runtime_error("Boris not implemented for this dimension");
+    }
+
+    // pushes the particles of from into to, from is left unchanged and to
+    // takes its size and position representation, reusing its storage
+    void operator()(ParticleArray<dimension> const& from, ParticleArray<dimension>& to,
+                    VecField<dimension> const& E, VecField<dimension> const& B)
+    {
+        if constexpr (dimension == 1)
+            boris_push(gather_grid_args(kernel_args(from, to, E, B)), m_simd);
+        else
+            throw std::runtime_error("Boris out of place only implemented for 1D");
+    }
+
+    void operator()(ParticleArray<dimension> const& from, ParticleArray<dimension>& to,
+                    BlendedVecField<dimension> const& E, BlendedVecField<dimension> const& B)
+    {
+        if constexpr (dimension == 1)
+            boris_push(gather_grid_args(kernel_args(from, to, E, B)), m_simd);
+        else
+            throw std::runtime_error("Boris out of place only implemented for 1D");
+    }
+
+    // raw arrays and constants of a 1D push, for kernels that push particles
+    // one at a time
+    BorisKernelArgs kernel_args(ParticleArray<dimension>& particles, VecField<dimension> const& E,
+                                VecField<dimension> const& B) const
+    {
+        BorisKernelArgs args;
+        if (particles.cell_relative())
+        {
+            args.icell = particles.icell(Direction::X).data();
+            args.delta = particles.delta(Direction::X).data();
+        }
+        args.x    = particles.position(Direction::X).data();
+        args.vx   = particles.v(0).data();
+        args.vy   = particles.v(1).data();
+        args.vz   = particles.v(2).data();
+        args.size = particles.size();
+
+        args.x_from     = args.x;
+        args.vx_from    = args.vx;
+        args.vy_from    = args.vy;
+        args.vz_from    = args.vz;
+        args.icell_from = args.icell;
+        args.delta_from = args.delta;
+
+        Field<dimension> const* fields[6] = {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z};
+        for (int c = 0; c < 6; ++c)
         {
-            // TODO implement the Boris pusher
-            
-            double x;
-            double x_half;
-            
-            double tx;
-            double ty;
-            double tz;
-            
-            double sx;
-            double sy;
-            double sz;
-            
-            double vx;
-            double vx_minus;
-            double vx_prime;
-            double vx_plus;
-            
-            double vy;
-            double vy_minus;
-            double vy_prime;
-            double vy_plus;
-            
-            double vz;
-            double vz_minus;
-            double vz_prime;
-            double vz_plus;
-
-
-            x = particle.position[0];
-            vx = particle.v[0];
-            vy = particle.v[1];
-            vz = particle.v[2];
-
-            x_half = x + vx*this->dt_/2;
-
-            double const iCell_float = x_half / this->layout_->cell_size(Direction::X)
-                                   + this->layout_->dual_dom_start(Direction::X);
-            int const iCell = static_cast<int>(iCell_float);
-            double reminder = iCell_float - iCell;
-
-            double const Lx = this->layout_->nbr_cells(Direction::X) *
-                  this->layout_->cell_size(Direction::X);
-
-            double Ex = interpolate(E.x, iCell, reminder);
-            double Ey = interpolate(E.y, iCell, reminder);
-            double Ez = interpolate(E.z, iCell, reminder);
-            double Bx = interpolate(B.x, iCell, reminder);
-            double By = interpolate(B.y, iCell, reminder);
-            double Bz = interpolate(B.z, iCell, reminder);
-
-            vx_minus = vx + particle.charge*this->dt_*Ex/(2*particle.mass);
-            vy_minus = vy + particle.charge*this->dt_*Ey/(2*particle.mass);
-            vz_minus = vz + particle.charge*this->dt_*Ez/(2*particle.mass);
-
-            tx = particle.charge*this->dt_*Bx/(2*particle.mass);
-            ty = particle.charge*this->dt_*By/(2*particle.mass);
-            tz = particle.charge*this->dt_*Bz/(2*particle.mass);
-
-            vx_prime = vx_minus + vy_minus*tz - vz_minus*ty;
-            vy_prime = vy_minus + vz_minus*tx - vx_minus*tz;
-            vz_prime = vz_minus + vx_minus*ty - vy_minus*tx;
-
-            sx = 2*tx/(1+(tx*tx +ty*ty + tz*tz));
-            sy = 2*ty/(1+(tx*tx +ty*ty + tz*tz));
-            sz = 2*tz/(1+(tx*tx +ty*ty + tz*tz));
-
-            vx_plus = vx_minus + vy_prime*sz - vz_prime*sy;
-            vy_plus = vy_minus + vz_prime*sx - vx_prime*sz;
-            vz_plus = vz_minus + vx_prime*sy - vy_prime*sx;
-
-            vx = vx_plus + particle.charge*this->dt_*Ex/(2*particle.mass);
-            vy = vy_plus + particle.charge*this->dt_*Ey/(2*particle.mass);
-            vz = vz_plus + particle.charge*this->dt_*Ez/(2*particle.mass);
-
-            x = x_half + vx*this->dt_/2;
-
-            particle.position[0] = x;
-            particle.v[0] = vx;
-            particle.v[1] = vy;
-            particle.v[2] = vz;
-            
-            
+            args.fields[c] = fields[c]->data().data();
+            args.dual[c]   = this->layout_->centerings(fields[c]->quantity())[0]
+                           == this->layout_->dual;
         }
+
+        args.half_dt     = this->dt_ / 2;
+        args.dx          = this->layout_->cell_size(Direction::X);
+        args.qdt2m       = particles.charge() * this->dt_ / (2 * particles.mass());
+        args.ghost_start = this->layout_->dual_dom_start(Direction::X);
+
+        args.half_dt_over_dx = args.half_dt / args.dx;
+        return args;
     }
 
-private:
-    double interpolate(Field<dimension> const& field, int iCell, double reminder) const
+    BorisKernelArgs kernel_args(ParticleArray<dimension>& particles,
+                                BlendedVecField<dimension> const& E,
+                                BlendedVecField<dimension> const& B) const
+    {
+        auto args = kernel_args(particles, E.now(), B.now());
+        blend(args, E, B);
+        return args;
+    }
+
+    // arguments of a push from the particles of from into to, which is
+    // resized and takes the weights of from
+    template<typename EField, typename BField>
+    BorisKernelArgs kernel_args(ParticleArray<dimension> const& from, ParticleArray<dimension>& to,
+                                EField const& E, BField const& B) const
     {
-        if (this->layout_->centerings(field.quantity())[0] == this->layout_->dual)
+        to.resize_like(from);
+        std::copy(from.weight().begin(), from.weight().end(), to.weight().begin());
+
+        auto args    = kernel_args(to, E, B);
+        args.x_from  = from.position(Direction::X).data();
+        args.vx_from = from.v(0).data();
+        args.vy_from = from.v(1).data();
+        args.vz_from = from.v(2).data();
+        if (from.cell_relative())
+        {
+            args.icell_from = from.icell(Direction::X).data();
+            args.delta_from = from.delta(Direction::X).data();
+        }
+        return args;
+    }
+
+    // same arguments reading the fields from the gather grid, rebuilt from
+    // them. Unchanged when the gather grid is off.
+    BorisKernelArgs gather_grid_args(BorisKernelArgs args)
+    {
+        if (!m_gather_grid)
+            return args;
+        auto const nbr_nodes = this->layout_->allocate(Quantity::N)[0]; // primal nodes
+        m_nodes.resize(nbr_nodes * boris_node_stride);
+        boris_pack_nodes(args, nbr_nodes, m_nodes.data());
+        args.nodes = m_nodes.data();
+        return args;
+    }
+
+    // same for the 2D kernel, with bilinear interpolation
+    BorisKernelArgs2D kernel_args_2d(ParticleArray<dimension>& particles,
+                                     VecField<dimension> const& E,
+                                     VecField<dimension> const& B) const
+    {
+        BorisKernelArgs2D args;
+        for (std::size_t d = 0; d < 2; ++d)
+        {
+            auto const dir = static_cast<Direction>(d);
+            if (particles.cell_relative())
+            {
+                args.icell[d] = particles.icell(dir).data();
+                args.delta[d] = particles.delta(dir).data();
+            }
+            args.position[d]       = particles.position(dir).data();
+            args.cell_size[d]      = this->layout_->cell_size(dir);
+            args.half_dt_over_d[d] = this->dt_ / (2 * args.cell_size[d]);
+        }
+        args.vx   = particles.v(0).data();
+        args.vy   = particles.v(1).data();
+        args.vz   = particles.v(2).data();
+        args.size = particles.size();
+
+        Field<dimension> const* fields[6] = {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z};
+        for (int c = 0; c < 6; ++c)
         {
-            if (reminder < 0.5)
-                return field(iCell - 1) * (1.0 - reminder) + field(iCell) * reminder;
-            else
-                return field(iCell) * (1.0 - reminder) + field(iCell + 1) * reminder;
+            auto const centering = this->layout_->centerings(fields[c]->quantity());
+            args.fields[c]       = fields[c]->data().data();
+            args.stride[c]       = fields[c]->stride(0);
+            args.dual[c][0]      = centering[0] == this->layout_->dual;
+            args.dual[c][1]      = centering[1] == this->layout_->dual;
         }
-        return field(iCell) * (1.0 - reminder) + field(iCell + 1) * reminder;
+
+        args.half_dt     = this->dt_ / 2;
+        args.qdt2m       = particles.charge() * this->dt_ / (2 * particles.mass());
+        args.ghost_start = this->layout_->dual_dom_start(Direction::X);
+        return args;
+    }
+
+    BorisKernelArgs2D kernel_args_2d(ParticleArray<dimension>& particles,
+                                     BlendedVecField<dimension> const& E,
+                                     BlendedVecField<dimension> const& B) const
+    {
+        auto args = kernel_args_2d(particles, E.now(), B.now());
+        blend(args, E, B);
+        return args;
+    }
+
+    // kernel used for the push, defaults to the best one the CPU supports
+    SimdLevel simd() const { return m_simd; }
+    void simd(SimdLevel level) { m_simd = level; }
+
+    // 1D pushes gather from the packed nodes of boris_pack_nodes, off by
+    // default since dual components are then interpolated differently
+    bool gather_grid() const { return m_gather_grid; }
+    void gather_grid(bool enabled) { m_gather_grid = enabled; }
+
+private:
+    // second state of the kernel arguments, the kernels take a single weight
+    template<typename Args>
+    static void blend(Args& args, BlendedVecField<dimension> const& E,
+                      BlendedVecField<dimension> const& B)
+    {
+        if (E.weight() != B.weight())
+            throw std::runtime_error("E and B must be blended with the same weight");
+
+        Field<dimension> const* next[6]
+            = {&E.next().x, &E.next().y, &E.next().z, &B.next().x, &B.next().y, &B.next().z};
+        for (int c = 0; c < 6; ++c)
+            args.fields_next[c] = next[c]->data().data();
+        args.weight = E.weight();
     }
+
+    SimdLevel m_simd;
+    bool m_gather_grid = false;
+    std::vector<double, AlignedAllocator<double>> m_nodes;
 };
 
 
@@ -0,0 +1,64 @@
+#ifndef HYBIRT_SIMD_HPP
+#define HYBIRT_SIMD_HPP
+
+#include <cstdlib>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HYBIRT_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HYBIRT_X86_SIMD 0
+#endif
+
+
+enum class SimdLevel { scalar, avx2, avx512 };
+
+
+inline std::string to_string(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::avx2: return "avx2";
+        case SimdLevel::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+
+// best instruction set supported by the CPU we run on
+inline SimdLevel detect_simd_level()
+{
+#if HYBIRT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::avx2;
+#endif
+    return SimdLevel::scalar;
+}
+
+
+// level used by the kernels, detected once at startup. HYBIRT_SIMD=scalar|avx2|avx512
+// can lower it, e.g. to compare kernels, but never raises it above what the CPU supports
+inline SimdLevel simd_level()
+{
+    static SimdLevel const level = [] {
+        auto const detected = detect_simd_level();
+        auto const* env     = std::getenv("HYBIRT_SIMD");
+        if (!env)
+            return detected;
+
+        auto const requested = std::string{env};
+        if (requested == "scalar")
+            return SimdLevel::scalar;
+        if (requested == "avx2" and detected != SimdLevel::scalar)
+            return SimdLevel::avx2;
+        return detected;
+    }();
+    return level;
+}
+
+
+#endif // HYBIRT_SIMD_HPP
@@ -0,0 +1,564 @@
+#ifndef HYBIRT_SIMULATION_HPP
+#define HYBIRT_SIMULATION_HPP
+
+#include "blended_field.hpp"
+#include "gridlayout.hpp"
+#include "moments.hpp"
+#include "patches.hpp"
+#include "thread_pool.hpp"
+#include "timers.hpp"
+#include "trace.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+template<std::size_t dimension>
+class Simulation;
+
+
+// Advances a simulation by one time step: the fields and particles of its
+// patches are at time t on entry and at t + dt on return.
+template<std::size_t dimension>
+class Integrator
+{
+public:
+    virtual void step(Simulation<dimension>& sim) = 0;
+
+    virtual ~Integrator() {}
+};
+
+template<std::size_t dimension>
+class ICN;
+
+
+// Patched domain of the hybrid model, and its time stepping. The driver
+// loads the particles and the initial B into domain(), calls initialize(),
+// then step() or advance_to() while it writes diagnostics in between.
+//
+// The stages below are the building blocks of the integrators: each works
+// on every patch and leaves the ghosts of what it computes filled.
+template<std::size_t dimension>
+class Simulation
+{
+public:
+    using PatchT = Patch<dimension>;
+
+    Simulation(std::shared_ptr<GridLayout<dimension>> layout, std::size_t nbr_patches, double dt,
+               ThreadPool& pool)
+        : m_domain{layout, nbr_patches, dt, pool}
+        , m_dt{dt}
+        , m_integrator{std::make_unique<ICN<dimension>>()}
+    {
+    }
+
+    auto& domain() { return m_domain; }
+    auto const& domain() const { return m_domain; }
+
+    double dt() const { return m_dt; }
+    double time() const { return m_time; }
+    std::size_t steps() const { return m_steps; }
+
+    // continues from a checkpoint, read into domain() beforehand
+    void resume(double time, std::size_t steps)
+    {
+        m_time  = time;
+        m_steps = steps;
+    }
+
+    Integrator<dimension>& integrator() { return *m_integrator; }
+    void integrator(std::unique_ptr<Integrator<dimension>> integrator)
+    {
+        if (!integrator)
+            throw std::runtime_error("Integrator is null");
+        m_integrator = std::move(integrator);
+    }
+
+    // Bnew, J and Enew in a single sweep, with one ghost fill instead of three
+    bool fused_fields() const { return m_fused_fields; }
+    void fused_fields(bool fused) { m_fused_fields = fused; }
+
+    // Push, wrap and deposit of each population in one pass over its
+    // particles, threaded over the pool, see PushDeposit. The kernel wraps
+    // the particles into the periodic domain itself, which is only right
+    // when a single patch on a single rank covers it. The pass is timed as
+    // Stage::PushDeposit, not as a push.
+    bool push_deposit() const { return m_push_deposit; }
+    void push_deposit(bool fused)
+    {
+        if (fused and (m_domain.size() != 1 or m_domain.has_remote()))
+            throw std::runtime_error("Fused push and deposit needs a single patch on a single rank");
+        m_push_deposit = fused;
+    }
+
+    // Field subcycling: solve_fields() advances the fields over dt in
+    // field_substeps() substeps with the moments fixed, so that dt is no
+    // longer bound by the whistlers. Each step takes as many substeps as
+    // whistler_cfl() times whistler_dt() needs, at most max_field_substeps().
+    bool subcycle_fields() const { return m_subcycle_fields; }
+    void subcycle_fields(bool subcycle) { m_subcycle_fields = subcycle; }
+
+    double whistler_cfl() const { return m_whistler_cfl; }
+    void whistler_cfl(double cfl)
+    {
+        if (!(cfl > 0.0))
+            throw std::runtime_error("Whistler CFL must be positive");
+        m_whistler_cfl = cfl;
+    }
+
+    std::size_t max_field_substeps() const { return m_max_field_substeps; }
+    void max_field_substeps(std::size_t substeps)
+    {
+        if (substeps == 0)
+            throw std::runtime_error("Field subcycling needs at least one substep");
+        m_max_field_substeps = substeps;
+    }
+
+    // substeps of the current step, 1 without subcycling
+    std::size_t field_substeps() const { return m_field_substeps; }
+
+    // whether the current step wanted more than max_field_substeps() and
+    // got that many only, its substeps then past the whistler CFL
+    bool field_substeps_capped() const { return m_field_substeps_capped; }
+
+    // time step limit of the whistlers at the grid scale, k = pi / dx, for
+    // the largest B and the smallest n over all the ranks. Their frequency
+    // is w = k^2 B / n and this returns pi / w = dx^2 n / (pi B), the usual
+    // limit of hybrid codes, rather than 1 / w: whistler_cfl() is a fraction
+    // of that limit.
+    double whistler_dt() const
+    {
+        double n_min = std::numeric_limits<double>::max();
+        std::array<double, 3> b_max{0.0, 0.0, 0.0};
+        for (std::size_t ip = 0; ip < m_domain.size(); ++ip)
+        {
+            auto const& patch = m_domain[ip];
+            for (auto n : patch.N.data())
+                n_min = std::min(n_min, n);
+            std::size_t ic = 0;
+            for (auto const* b : {&patch.B.x, &patch.B.y, &patch.B.z})
+            {
+                for (auto v : b->data())
+                    b_max[ic] = std::max(b_max[ic], std::abs(v));
+                ++ic;
+            }
+        }
+        // each component at its own nodes, an upper bound of |B|^2
+        auto const b2_max = b_max[0] * b_max[0] + b_max[1] * b_max[1] + b_max[2] * b_max[2];
+
+        auto const& layout = *m_domain.layout();
+        double dx_min      = layout.cell_size(Direction::X);
+        if constexpr (dimension > 1)
+            dx_min = std::min(dx_min, layout.cell_size(Direction::Y));
+        if constexpr (dimension > 2)
+            dx_min = std::min(dx_min, layout.cell_size(Direction::Z));
+
+        auto const local = b2_max > 0.0
+                               ? dx_min * dx_min * std::max(n_min, 0.0) / (M_PI * std::sqrt(b2_max))
+                               : std::numeric_limits<double>::max();
+        return m_domain.reduce_min(local);
+    }
+
+    // J, the moments and E at the initial time, from B and the particles
+    void initialize()
+    {
+        m_domain.for_each_patch([](PatchT& patch) { patch.ampere(patch.B, patch.J); });
+        m_domain.fill(&PatchT::J);
+        m_domain.for_each_patch([](PatchT& patch) {
+            for (auto& pop : patch.populations)
+                pop.deposit();
+        });
+        update_moments();
+
+        m_domain.for_each_patch(
+            [](PatchT& patch) { patch.ohm(patch.B, patch.J, patch.N, patch.V, patch.E); });
+        m_domain.fill(&PatchT::E);
+    }
+
+    void step()
+    {
+        m_field_substeps_capped = false;
+        m_field_substeps        = m_subcycle_fields ? substeps_for(whistler_dt()) : 1;
+        m_integrator->step(*this);
+        m_time += m_dt;
+        ++m_steps;
+    }
+
+    // the number of steps from time() to t, rounded to the nearest, since
+    // a sum of steps such as 0.001 misses t by round-off either way
+    std::size_t steps_to(double t) const
+    {
+        auto const steps = std::llround((t - m_time) / m_dt);
+        return steps > 0 ? static_cast<std::size_t>(steps) : 0;
+    }
+
+    // steps until time() reaches t, returns the number of steps taken
+    std::size_t advance_to(double t)
+    {
+        auto const n = steps_to(t);
+        for (std::size_t i = 0; i < n; ++i)
+            step();
+        return n;
+    }
+
+
+    // sums the deposits of the patches and computes the total moments
+    void update_moments()
+    {
+        for (std::size_t ipop = 0; ipop < m_domain.nbr_populations(); ++ipop)
+        {
+            m_domain.fill(
+                [ipop](PatchT& patch) -> auto& { return patch.populations[ipop].flux(); });
+            m_domain.fill(
+                [ipop](PatchT& patch) -> auto& { return patch.populations[ipop].density(); });
+        }
+        HYBIRT_TIME_SCOPE(Stage::Moments);
+        m_domain.for_each_patch([](PatchT& patch) {
+            total_density(patch.populations, patch.N);
+            bulk_velocity<dimension>(patch.populations, patch.N, patch.V);
+        });
+    }
+
+    // pushes the particles in the fields select_E and select_B return for
+    // each patch, migrates and deposits them, and updates the moments
+    template<typename SelectE, typename SelectB>
+    void move_particles(SelectE&& select_E, SelectB&& select_B)
+    {
+        move_particles(select_E, select_B, false);
+    }
+
+    // same, the particles pushed out of place from those save_particles put
+    // aside, which restore_particles then brings back unchanged
+    template<typename SelectE, typename SelectB>
+    void move_saved_particles(SelectE&& select_E, SelectB&& select_B)
+    {
+        move_particles(select_E, select_B, true);
+    }
+
+    // Bnew from B and the electric field select_E returns for each patch,
+    // then J and Enew from Bnew. With several field substeps, select_E is
+    // not used: the substeps start from B and E and compute E from the
+    // moments in N and V.
+    template<typename SelectE>
+    void solve_fields(SelectE&& select_E)
+    {
+        if (m_field_substeps > 1)
+            subcycle_fields_over_dt();
+        else
+            advance_fields(select_E, B_now);
+    }
+
+    // B and E take the values of Bnew and Enew
+    void commit_fields()
+    {
+        m_domain.for_each_patch([](PatchT& patch) {
+            patch.B = patch.Bnew;
+            patch.E = patch.Enew;
+        });
+    }
+
+    void save_particles()
+    {
+        HYBIRT_TIME_SCOPE(Stage::Snapshot);
+        m_domain.for_each_patch([](PatchT& patch) {
+            for (auto& pop : patch.populations)
+                pop.save_particles();
+        });
+    }
+
+    void restore_particles()
+    {
+        m_domain.for_each_patch([](PatchT& patch) {
+            for (auto& pop : patch.populations)
+                pop.restore_particles();
+        });
+    }
+
+    // field selectors for the stages: the fields at t, and at t + dt/2 read
+    // as the average of those at t and the predicted ones, node by node
+    static VecField<dimension>& E_now(PatchT& patch) { return patch.E; }
+    static VecField<dimension>& B_now(PatchT& patch) { return patch.B; }
+    static BlendedVecField<dimension> E_half(PatchT& patch) { return {patch.E, patch.Enew, 0.5}; }
+    static BlendedVecField<dimension> B_half(PatchT& patch) { return {patch.B, patch.Bnew, 0.5}; }
+
+private:
+    // the push from the saved particles writes the working ones, migration and
+    // deposit then only see those
+    template<typename SelectE, typename SelectB>
+    void move_particles(SelectE& select_E, SelectB& select_B, bool from_saved)
+    {
+        if (m_push_deposit)
+        {
+            {
+                HYBIRT_TIME_SCOPE(Stage::PushDeposit);
+                auto& patch = m_domain[0];
+                for (std::size_t ipop = 0; ipop < patch.populations.size(); ++ipop)
+                {
+                    HYBIRT_TRACE_SCOPE("push deposit", static_cast<std::int32_t>(ipop));
+                    auto& pop = patch.populations[ipop];
+                    patch.push_deposit(pop, select_E(patch), select_B(patch), m_domain.pool(),
+                                       from_saved);
+                    pop.rebin();
+                    HYBIRT_COUNT(Counter::ParticlePushes, pop.particles().size());
+                }
+            }
+            update_moments();
+            return;
+        }
+
+        {
+            HYBIRT_TIME_SCOPE(Stage::Push);
+            m_domain.for_each_patch([&](PatchT& patch) {
+                for (std::size_t ipop = 0; ipop < patch.populations.size(); ++ipop)
+                {
+                    HYBIRT_TRACE_SCOPE("push", static_cast<std::int32_t>(ipop));
+                    auto& pop = patch.populations[ipop];
+                    if (from_saved)
+                        patch.push(pop.saved_particles(), pop.particles(), select_E(patch),
+                                   select_B(patch));
+                    else
+                        patch.push(pop.particles(), select_E(patch), select_B(patch));
+                    HYBIRT_COUNT(Counter::ParticlePushes, pop.particles().size());
+                }
+            });
+        }
+        m_domain.migrate_particles();
+        {
+            HYBIRT_TIME_SCOPE(Stage::Deposit);
+            m_domain.for_each_patch([](PatchT& patch) {
+                for (std::size_t ipop = 0; ipop < patch.populations.size(); ++ipop)
+                {
+                    HYBIRT_TRACE_SCOPE("deposit", static_cast<std::int32_t>(ipop));
+                    auto& pop = patch.populations[ipop];
+                    pop.rebin();
+                    pop.deposit();
+                }
+            });
+        }
+        update_moments();
+    }
+
+    // capped at m_max_field_substeps, which field_substeps_capped() reports
+    std::size_t substeps_for(double whistler_dt)
+    {
+        auto const substeps = std::ceil(m_dt / (m_whistler_cfl * whistler_dt));
+        if (!(substeps <= static_cast<double>(m_max_field_substeps)))
+        {
+            m_field_substeps_capped = true;
+            return m_max_field_substeps;
+        }
+        return std::max(std::size_t{1}, static_cast<std::size_t>(substeps));
+    }
+
+    // Bnew from the fields select_B and select_E return for each patch and
+    // the time step of the solvers, then J and Enew from Bnew
+    template<typename SelectE, typename SelectB>
+    void advance_fields(SelectE&& select_E, SelectB&& select_B)
+    {
+        if (m_fused_fields)
+        {
+            {
+                HYBIRT_TIME_SCOPE(Stage::Fields);
+                m_domain.for_each_patch([&](PatchT& patch) {
+                    patch.fused_fields(select_E(patch), select_B(patch), patch.N, patch.V,
+                                       patch.Bnew, patch.J, patch.Enew);
+                });
+            }
+            m_domain.fill(&PatchT::Enew);
+            return;
+        }
+
+        {
+            HYBIRT_TIME_SCOPE(Stage::Faraday);
+            m_domain.for_each_patch(
+                [&](PatchT& patch) { patch.faraday(select_E(patch), select_B(patch), patch.Bnew); });
+        }
+        m_domain.fill(&PatchT::Bnew);
+
+        {
+            HYBIRT_TIME_SCOPE(Stage::Ampere);
+            m_domain.for_each_patch([](PatchT& patch) { patch.ampere(patch.Bnew, patch.J); });
+        }
+        m_domain.fill(&PatchT::J);
+
+        {
+            HYBIRT_TIME_SCOPE(Stage::Ohm);
+            m_domain.for_each_patch([](PatchT& patch) {
+                patch.ohm(patch.Bnew, patch.J, patch.N, patch.V, patch.Enew);
+            });
+        }
+        m_domain.fill(&PatchT::Enew);
+    }
+
+    // Bnew and Enew at t + dt from B and E at t in m_field_substeps
+    // substeps. Each is the predictor and the two corrections of ICN, from
+    // Bsub and Esub, B and E for the first one.
+    void subcycle_fields_over_dt()
+    {
+        auto const h = m_dt / static_cast<double>(m_field_substeps);
+        m_domain.for_each_patch([h](PatchT& patch) {
+            patch.faraday.dt(h);
+            patch.fused_fields.dt(h);
+        });
+
+        for (std::size_t k = 0; k < m_field_substeps; ++k)
+        {
+            HYBIRT_TRACE_SCOPE("field substep", static_cast<std::int32_t>(k));
+            auto select_E = [k](PatchT& patch) -> auto& { return k == 0 ? patch.E : patch.Esub; };
+            auto select_B = [k](PatchT& patch) -> auto& { return k == 0 ? patch.B : patch.Bsub; };
+            auto E_mid    = [&](PatchT& patch) {
+                return BlendedVecField<dimension>{select_E(patch), patch.Enew, 0.5};
+            };
+
+            advance_fields(select_E, select_B);
+            advance_fields(E_mid, select_B);
+            advance_fields(E_mid, select_B);
+
+            if (k + 1 < m_field_substeps)
+                m_domain.for_each_patch([](PatchT& patch) {
+                    patch.Bsub = patch.Bnew;
+                    patch.Esub = patch.Enew;
+                });
+        }
+
+        m_domain.for_each_patch([dt = m_dt](PatchT& patch) {
+            patch.faraday.dt(dt);
+            patch.fused_fields.dt(dt);
+        });
+    }
+
+    PatchedDomain<dimension> m_domain;
+    double m_dt;
+    double m_time                    = 0.0;
+    std::size_t m_steps              = 0;
+    bool m_fused_fields              = false;
+    bool m_push_deposit              = false;
+    bool m_subcycle_fields           = false;
+    double m_whistler_cfl            = 0.5;
+    std::size_t m_max_field_substeps = 64;
+    std::size_t m_field_substeps     = 1;
+    bool m_field_substeps_capped     = false;
+    std::unique_ptr<Integrator<dimension>> m_integrator;
+};
+
+
+
+// Iterative Crank-Nicolson: two predictions push the particles from their
+// state at t in the fields at t + dt/2, those of the first one only give
+// its moments, then a correction advances the fields with the moments of
+// the second.
+template<std::size_t dimension>
+class ICN : public Integrator<dimension>
+{
+public:
+    void step(Simulation<dimension>& sim) override
+    {
+        using Sim = Simulation<dimension>;
+        {
+            HYBIRT_TRACE_SCOPE("prediction 1");
+            sim.save_particles();
+            sim.solve_fields(Sim::E_now);
+            sim.move_saved_particles(Sim::E_half, Sim::B_half);
+        }
+
+        {
+            HYBIRT_TRACE_SCOPE("prediction 2");
+            sim.solve_fields(Sim::E_half);
+            sim.restore_particles();
+            sim.move_particles(Sim::E_half, Sim::B_half);
+        }
+
+        {
+            HYBIRT_TRACE_SCOPE("correction");
+            sim.solve_fields(Sim::E_half);
+            sim.commit_fields();
+        }
+    }
+};
+
+
+// One push per step: ICN with its first prediction, the push that only
+// gives the moments at t + dt, replaced by their linear extrapolation from
+// those at t - dt and t. The fields at t + dt/2 the particles are pushed in
+// are then off by O(dt^2), and the scheme is second order in time like ICN
+// for half its pushes. The first step, and the first after a resume, have
+// no earlier moments and hold those at t instead.
+template<std::size_t dimension>
+class SinglePush : public Integrator<dimension>
+{
+public:
+    void step(Simulation<dimension>& sim) override
+    {
+        using Sim = Simulation<dimension>;
+        {
+            HYBIRT_TRACE_SCOPE("prediction");
+            sim.solve_fields(Sim::E_now);
+            extrapolate_moments(sim);
+            sim.solve_fields(Sim::E_half);
+        }
+
+        {
+            HYBIRT_TRACE_SCOPE("particles");
+            sim.move_particles(Sim::E_half, Sim::B_half);
+        }
+
+        {
+            HYBIRT_TRACE_SCOPE("correction");
+            sim.solve_fields(Sim::E_half);
+            sim.commit_fields();
+        }
+    }
+
+private:
+    // N and V of each patch take 2 N - N_previous and 2 V - V_previous,
+    // those at t are kept for the next step
+    void extrapolate_moments(Simulation<dimension>& sim)
+    {
+        auto& domain            = sim.domain();
+        bool const has_previous = m_N.size() == domain.size() and m_step + 1 == sim.steps();
+        if (m_N.size() != domain.size())
+        {
+            m_N.clear();
+            m_V.clear();
+            for (std::size_t ip = 0; ip < domain.size(); ++ip)
+            {
+                m_N.push_back(domain[ip].N);
+                m_V.push_back(domain[ip].V);
+            }
+        }
+
+        auto extrapolate = [has_previous](Field<dimension>& now, Field<dimension>& previous) {
+            for (std::size_t i = 0; i < now.size(); ++i)
+            {
+                auto const value   = now.data()[i];
+                now.data()[i]      = has_previous ? 2.0 * value - previous.data()[i] : value;
+                previous.data()[i] = value;
+            }
+        };
+        for (std::size_t ip = 0; ip < domain.size(); ++ip)
+        {
+            auto& patch = domain[ip];
+            extrapolate(patch.N, m_N[ip]);
+            extrapolate(patch.V.x, m_V[ip].x);
+            extrapolate(patch.V.y, m_V[ip].y);
+            extrapolate(patch.V.z, m_V[ip].z);
+        }
+        m_step = sim.steps();
+    }
+
+    std::vector<Field<dimension>> m_N;
+    std::vector<VecField<dimension>> m_V;
+    std::size_t m_step = 0;
+};
+
+
+#endif // HYBIRT_SIMULATION_HPP
@@ -0,0 +1,194 @@
+#ifndef HYBIRT_THREAD_POOL_HPP
+#define HYBIRT_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// number of threads requested with HYBIRT_NUM_THREADS, all cores otherwise
+inline std::size_t default_nbr_threads()
+{
+    if (auto const* env = std::getenv("HYBIRT_NUM_THREADS"))
+    {
+        auto const requested = std::stoul(env);
+        if (requested > 0)
+            return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+// Fixed set of worker threads running the tasks of parallel_for. The
+// calling thread takes part in the work, so a pool of size 1 has no worker
+// and runs everything inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(std::size_t nbr_threads = default_nbr_threads())
+        : m_size{std::max<std::size_t>(1, nbr_threads)}
+    {
+        for (std::size_t i = 1; i < m_size; ++i)
+            m_workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    ThreadPool(ThreadPool const&)            = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    std::size_t size() const { return m_size; }
+
+    // calls task(i) for each i in [0, nbr_tasks) and returns once all are
+    // done. If tasks throw, the others still run and the first exception is
+    // rethrown here, once no worker uses task any more.
+    void parallel_for(std::size_t nbr_tasks, std::function<void(std::size_t)> const& task)
+    {
+        if (m_size == 1 or nbr_tasks == 1)
+        {
+            for (std::size_t i = 0; i < nbr_tasks; ++i)
+                task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_task      = &task;
+            m_nbr_tasks = nbr_tasks;
+            m_error     = nullptr;
+            m_next.store(0);
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        run_tasks(task, nbr_tasks);
+
+        // workers may only pick up a job while it is published, so once
+        // none of them is active the job can be retired
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_done.wait(lock, [this] { return m_active == 0; });
+            m_task = nullptr;
+            std::swap(error, m_error);
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // calls fn once on every thread of the pool, the calling one included,
+    // e.g. to set up thread local state. Each task waits for all the others
+    // to have started, so that no thread runs two of them.
+    void on_each_thread(std::function<void()> const& fn)
+    {
+        std::atomic<std::size_t> started{0};
+        parallel_for(m_size, [&](std::size_t) {
+            std::exception_ptr error;
+            try
+            {
+                fn();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            started.fetch_add(1);
+            while (started.load() < m_size)
+                std::this_thread::yield();
+            if (error)
+                std::rethrow_exception(error);
+        });
+    }
+
+    // splits [0, n) into `nbr_chunks` contiguous ranges, returns range `chunk`
+    static std::pair<std::size_t, std::size_t> chunk_range(std::size_t n, std::size_t nbr_chunks,
+                                                           std::size_t chunk)
+    {
+        auto const base  = n / nbr_chunks;
+        auto const extra = n % nbr_chunks;
+        auto const begin = chunk * base + std::min(chunk, extra);
+        return {begin, begin + base + (chunk < extra ? 1 : 0)};
+    }
+
+private:
+    // keeps the first exception of the job for parallel_for to rethrow
+    void run_tasks(std::function<void(std::size_t)> const& task, std::size_t nbr_tasks)
+    {
+        for (auto i = m_next.fetch_add(1); i < nbr_tasks; i = m_next.fetch_add(1))
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+        }
+    }
+
+    void work()
+    {
+        std::size_t seen = 0;
+        while (true)
+        {
+            std::function<void(std::size_t)> const* task = nullptr;
+            std::size_t nbr_tasks                        = 0;
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_wake.wait(lock, [&] { return m_stop or m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+                if (!m_task)
+                    continue; // woke up after the job was retired
+                task      = m_task;
+                nbr_tasks = m_nbr_tasks;
+                ++m_active;
+            }
+
+            run_tasks(*task, nbr_tasks);
+
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (--m_active == 0)
+                m_done.notify_all();
+        }
+    }
+
+    std::size_t m_size;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::function<void(std::size_t)> const* m_task = nullptr;
+    std::size_t m_nbr_tasks                         = 0;
+    std::exception_ptr m_error;
+    std::atomic<std::size_t> m_next{0};
+    std::size_t m_active     = 0;
+    std::size_t m_generation = 0;
+    bool m_stop              = false;
+};
+
+
+#endif // HYBIRT_THREAD_POOL_HPP
@@ -0,0 +1,114 @@
+#ifndef HYBIRT_TILING_HPP
+#define HYBIRT_TILING_HPP
+
+#include "gridlayout.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+
+// Cache blocking of the 3D field solvers. A sweep over the domain is cut into
+// tiles, and each tile is swept for every component before moving on, so the
+// planes a stencil reads at i and i + 1 are still in cache when reused.
+
+
+// nodes of a tile in each direction. The last direction is contiguous in
+// memory, a long tile there keeps the vectorized inner loop long.
+struct Tiles
+{
+    std::size_t x = 8;
+    std::size_t y = 8;
+    std::size_t z = 256;
+};
+
+
+// inclusive index range in each direction
+struct IndexBox
+{
+    std::array<std::size_t, 3> lower;
+    std::array<std::size_t, 3> upper;
+};
+
+
+// domain nodes of qty
+inline IndexBox dom_box(GridLayout<3> const& layout, Quantity qty)
+{
+    IndexBox box;
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+        box.lower[d] = layout.dom_start(qty, static_cast<Direction>(d));
+        box.upper[d] = layout.dom_end(qty, static_cast<Direction>(d));
+    }
+    return box;
+}
+
+// same, with the centering of qty known at compile time
+template<Quantity qty>
+IndexBox dom_box(GridLayout<3> const& layout)
+{
+    IndexBox box;
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+        box.lower[d] = layout.dom_start<qty>();
+        box.upper[d] = layout.dom_end<qty>(static_cast<Direction>(d));
+    }
+    return box;
+}
+
+
+// smallest box holding a and b
+inline IndexBox hull(IndexBox const& a, IndexBox const& b)
+{
+    IndexBox box;
+    for (std::size_t d = 0; d < 3; ++d)
+    {
+        box.lower[d] = std::min(a.lower[d], b.lower[d]);
+        box.upper[d] = std::max(a.upper[d], b.upper[d]);
+    }
+    return box;
+}
+
+
+// calls fn(tile) for the tiles covering box, z varying fastest
+template<typename Fn>
+void for_each_tile(IndexBox const& box, Tiles const& tiles, Fn&& fn)
+{
+    if (tiles.x == 0 or tiles.y == 0 or tiles.z == 0)
+        throw std::runtime_error("Tile sizes must be positive");
+
+    for (auto x0 = box.lower[0]; x0 <= box.upper[0]; x0 += tiles.x)
+        for (auto y0 = box.lower[1]; y0 <= box.upper[1]; y0 += tiles.y)
+            for (auto z0 = box.lower[2]; z0 <= box.upper[2]; z0 += tiles.z)
+                fn(IndexBox{{x0, y0, z0},
+                            {std::min(x0 + tiles.x - 1, box.upper[0]),
+                             std::min(y0 + tiles.y - 1, box.upper[1]),
+                             std::min(z0 + tiles.z - 1, box.upper[2])}});
+}
+
+
+// calls fn(ix, iy, iz) on the nodes of box that are inside tile. The inner
+// loop runs along z with unit stride, fn must not read what it writes.
+template<typename Fn>
+void sweep(IndexBox const& box, IndexBox const& tile, Fn&& fn)
+{
+    auto const x0 = std::max(box.lower[0], tile.lower[0]);
+    auto const x1 = std::min(box.upper[0], tile.upper[0]);
+    auto const y0 = std::max(box.lower[1], tile.lower[1]);
+    auto const y1 = std::min(box.upper[1], tile.upper[1]);
+    auto const z0 = std::max(box.lower[2], tile.lower[2]);
+    auto const z1 = std::min(box.upper[2], tile.upper[2]);
+
+    for (auto ix = x0; ix <= x1; ++ix)
+        for (auto iy = y0; iy <= y1; ++iy)
+        {
+            HYBIRT_IVDEP
+            for (auto iz = z0; iz <= z1; ++iz)
+                fn(ix, iy, iz);
+        }
+}
+
+
+#endif // HYBIRT_TILING_HPP
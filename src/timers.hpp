@@ -0,0 +1,347 @@
+#ifndef HYBIRT_TIMERS_HPP
+#define HYBIRT_TIMERS_HPP
+
+#include "perf_counters.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Per-stage timers of the time loop. With HYBIRT_TIMERS set to 0 the
+// HYBIRT_TIME_SCOPE and HYBIRT_COUNT macros expand to nothing and no timing
+// code is compiled in. The CMake option of the same name sets it for hybirt,
+// the tests and the bench alike through the hybirt_options target.
+#ifndef HYBIRT_TIMERS
+#define HYBIRT_TIMERS 1
+#endif
+
+
+enum class Stage : std::size_t {
+    Push,
+    Migrate,
+    Deposit,
+    PushDeposit,
+    Snapshot,
+    Fill,
+    Moments,
+    Faraday,
+    Ampere,
+    Ohm,
+    Fields,
+    Diagnostics,
+    Write,
+    Checkpoint,
+    count
+};
+
+enum class Counter : std::size_t { ParticlePushes, BytesWritten, count };
+
+
+inline char const* stage_name(Stage stage)
+{
+    constexpr std::array<char const*, static_cast<std::size_t>(Stage::count)> names
+        = {"push",    "migrate", "deposit", "push deposit", "snapshot", "fill",        "moments",
+           "faraday", "ampere",  "ohm",     "fields",       "diags",    "diags write", "checkpoint"};
+    return names[static_cast<std::size_t>(stage)];
+}
+
+
+
+// Accumulated time and number of calls per stage, plus event counters.
+// Accumulators are atomic so that stages timed on other threads, e.g. the
+// diagnostics writer, can report too.
+//
+// Once enable_perf_counters() is called, the hardware counters of the stages
+// are accumulated too. A counter group is opened on every thread of the pool
+// up front, since perf_event_open counts the thread that opens it, and a
+// stage entered by the thread that enabled them adds up the groups of the
+// whole pool, workers included. A stage entered by any other thread, e.g.
+// the diagnostics writer, counts that thread only.
+class Timers
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static Timers& instance()
+    {
+        static Timers timers;
+        return timers;
+    }
+
+    void add(Stage stage, clock::duration elapsed)
+    {
+        auto& s = m_stages[static_cast<std::size_t>(stage)];
+        s.nanoseconds.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+            std::memory_order_relaxed);
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void count(Counter counter, std::uint64_t amount)
+    {
+        m_counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    // reads PerfCounters around every stage from now on, on the calling
+    // thread and the workers of pool, which must outlive the timed stages.
+    // Returns false, and the report says why, when no counter is available.
+    bool enable_perf_counters(ThreadPool& pool)
+    {
+        std::mutex mutex;
+        pool.on_each_thread([&] {
+            auto const& counters = PerfCounters::this_thread();
+            std::lock_guard<std::mutex> lock{mutex};
+            m_perf_threads.push_back(&counters);
+        });
+
+        auto const& counters = PerfCounters::this_thread();
+        for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+            m_perf_available[i] = counters.available(static_cast<PerfEvent>(i));
+        m_perf_error     = counters.error();
+        m_perf_owner     = &counters;
+        m_perf_requested = true;
+        m_perf_enabled.store(counters.available(), std::memory_order_release);
+        return counters.available();
+    }
+
+    bool perf_counters_enabled() const { return m_perf_enabled.load(std::memory_order_acquire); }
+
+    // counts of the calling thread, summed over the pool when it is the
+    // thread that enabled the counters
+    PerfCounters::Values read_perf_counters() const
+    {
+        auto const& counters = PerfCounters::this_thread();
+        if (&counters != m_perf_owner)
+            return counters.read();
+
+        PerfCounters::Values sum{};
+        for (auto const* thread : m_perf_threads)
+        {
+            auto const counts = thread->read();
+            for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+                sum[i] += counts[i];
+        }
+        return sum;
+    }
+
+    void add(Stage stage, PerfCounters::Values const& counts)
+    {
+        auto& s = m_perf[static_cast<std::size_t>(stage)];
+        for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+            s[i].fetch_add(counts[i], std::memory_order_relaxed);
+    }
+
+    std::uint64_t perf_count(Stage stage, PerfEvent event) const
+    {
+        return m_perf[static_cast<std::size_t>(stage)][static_cast<std::size_t>(event)].load();
+    }
+
+    double seconds(Stage stage) const
+    {
+        return 1e-9 * m_stages[static_cast<std::size_t>(stage)].nanoseconds.load();
+    }
+
+    std::uint64_t calls(Stage stage) const
+    {
+        return m_stages[static_cast<std::size_t>(stage)].calls.load();
+    }
+
+    std::uint64_t total(Counter counter) const
+    {
+        return m_counters[static_cast<std::size_t>(counter)].load();
+    }
+
+    // wall time since the timers were first used
+    double elapsed() const { return std::chrono::duration<double>(clock::now() - m_start).count(); }
+
+    // table of the stages that ran, and derived rates
+    void report(std::ostream& out) const
+    {
+        auto const wall      = elapsed();
+        auto const flags     = out.flags();
+        auto const precision = out.precision();
+
+        out << "\n" << std::left << std::setw(14) << "stage" << std::right << std::setw(10)
+            << "calls" << std::setw(12) << "total (s)" << std::setw(10) << "% wall"
+            << std::setw(14) << "mean (us)" << "\n";
+        for (std::size_t i = 0; i < static_cast<std::size_t>(Stage::count); ++i)
+        {
+            auto const stage = static_cast<Stage>(i);
+            auto const n     = calls(stage);
+            if (n == 0)
+                continue;
+            auto const s = seconds(stage);
+            out << std::left << std::setw(14) << stage_name(stage) << std::right
+                << std::setw(10) << n << std::fixed << std::setprecision(3) << std::setw(12) << s
+                << std::setprecision(1) << std::setw(10) << 100. * s / wall
+                << std::setprecision(2) << std::setw(14) << 1e6 * s / n << "\n";
+            out.flags(flags);
+            out.precision(precision);
+        }
+
+        auto const pushes = total(Counter::ParticlePushes);
+        auto const bytes  = total(Counter::BytesWritten);
+        out << "wall time " << wall << " s\n";
+        if (pushes > 0 and seconds(Stage::Push) > 0)
+            out << "particle pushes/s " << pushes / seconds(Stage::Push) << " in push, "
+                << pushes / wall << " overall\n";
+        else if (pushes > 0 and seconds(Stage::PushDeposit) > 0)
+            out << "particle pushes/s " << pushes / seconds(Stage::PushDeposit)
+                << " in push deposit, " << pushes / wall << " overall\n";
+        auto const io = seconds(Stage::Write) + seconds(Stage::Checkpoint);
+        if (bytes > 0 and io > 0)
+            out << "bytes written/s " << bytes / io << " (" << bytes << " bytes)\n";
+
+        if (perf_counters_enabled())
+        {
+            report_perf_counters(out);
+            if (!m_perf_error.empty())
+                out << "some hardware counters unavailable (" << m_perf_error << ")\n";
+        }
+        else if (m_perf_requested)
+            out << "hardware counters unavailable (" << m_perf_error << ")\n";
+    }
+
+private:
+    struct Accumulator
+    {
+        std::atomic<std::int64_t> nanoseconds{0};
+        std::atomic<std::uint64_t> calls{0};
+    };
+
+    using PerfAccumulator = std::array<std::atomic<std::uint64_t>, PerfCounters::nbr_events>;
+
+    Timers() = default;
+
+    // counts per stage, IPC, and misses per thousand instructions. Events
+    // that could not be opened show as n/a.
+    void report_perf_counters(std::ostream& out) const
+    {
+        auto const flags     = out.flags();
+        auto const precision = out.precision();
+
+        out << "\n" << std::left << std::setw(14) << "stage" << std::right;
+        for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+            out << std::setw(16) << perf_event_name(static_cast<PerfEvent>(i));
+        out << std::setw(8) << "IPC" << std::setw(10) << "LLC/ki" << std::setw(10) << "br/ki"
+            << "\n";
+
+        auto available = [this](PerfEvent event) {
+            return m_perf_available[static_cast<std::size_t>(event)];
+        };
+        auto ratio = [&](Stage stage, PerfEvent num, PerfEvent den, double scale) {
+            auto const d = perf_count(stage, den);
+            if (!available(num) or !available(den) or d == 0)
+                return std::string{"n/a"};
+            std::ostringstream s;
+            s << std::fixed << std::setprecision(2)
+              << scale * static_cast<double>(perf_count(stage, num)) / d;
+            return s.str();
+        };
+        for (std::size_t is = 0; is < static_cast<std::size_t>(Stage::count); ++is)
+        {
+            auto const stage = static_cast<Stage>(is);
+            if (calls(stage) == 0)
+                continue;
+            out << std::left << std::setw(14) << stage_name(stage) << std::right;
+            for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+            {
+                auto const event = static_cast<PerfEvent>(i);
+                if (available(event))
+                    out << std::setw(16) << perf_count(stage, event);
+                else
+                    out << std::setw(16) << "n/a";
+            }
+            out << std::setw(8) << ratio(stage, PerfEvent::Instructions, PerfEvent::Cycles, 1.)
+                << std::setw(10) << ratio(stage, PerfEvent::LlcMisses, PerfEvent::Instructions, 1e3)
+                << std::setw(10)
+                << ratio(stage, PerfEvent::BranchMisses, PerfEvent::Instructions, 1e3) << "\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    std::array<Accumulator, static_cast<std::size_t>(Stage::count)> m_stages;
+    std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::count)> m_counters{};
+    clock::time_point m_start = clock::now();
+
+    std::array<PerfAccumulator, static_cast<std::size_t>(Stage::count)> m_perf{};
+    std::array<bool, PerfCounters::nbr_events> m_perf_available{};
+    std::vector<PerfCounters const*> m_perf_threads;
+    PerfCounters const* m_perf_owner = nullptr;
+    std::atomic<bool> m_perf_enabled{false};
+    bool m_perf_requested = false;
+    std::string m_perf_error;
+};
+
+
+
+// adds the time between its construction and destruction to stage, and the
+// hardware counts of Timers::read_perf_counters() when they are enabled. The
+// stage is traced as well, unless HYBIRT_TRACING is 0.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Stage stage)
+#if HYBIRT_TRACING
+        : m_trace{stage_name(stage)}
+        , m_stage{stage}
+#else
+        : m_stage{stage}
+#endif
+        , m_perf{Timers::instance().perf_counters_enabled()}
+    {
+        if (m_perf)
+            m_counts = Timers::instance().read_perf_counters();
+        m_start = Timers::clock::now();
+    }
+
+    ~ScopedTimer()
+    {
+        auto& timers = Timers::instance();
+        timers.add(m_stage, Timers::clock::now() - m_start);
+        if (m_perf)
+        {
+            auto const counts = timers.read_perf_counters();
+            for (std::size_t i = 0; i < PerfCounters::nbr_events; ++i)
+                m_counts[i] = counts[i] - m_counts[i];
+            timers.add(m_stage, m_counts);
+        }
+    }
+
+    ScopedTimer(ScopedTimer const&)            = delete;
+    ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+private:
+#if HYBIRT_TRACING
+    TraceScope m_trace;
+#endif
+    Stage m_stage;
+    bool m_perf;
+    PerfCounters::Values m_counts{};
+    Timers::clock::time_point m_start;
+};
+
+
+#if HYBIRT_TIMERS
+// times the rest of the enclosing scope
+#define HYBIRT_TIME_SCOPE(stage) ScopedTimer HYBIRT_CONCAT(hybirt_timer_, __LINE__){stage}
+#define HYBIRT_COUNT(counter, amount) Timers::instance().count(counter, amount)
+#else
+#define HYBIRT_TIME_SCOPE(stage)
+#define HYBIRT_COUNT(counter, amount)
+#endif
+
+
+#endif // HYBIRT_TIMERS_HPP
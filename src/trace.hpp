@@ -0,0 +1,258 @@
+#ifndef HYBIRT_TRACE_HPP
+#define HYBIRT_TRACE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Timeline of the time loop in the Chrome trace format, which Perfetto and
+// chrome://tracing open. With HYBIRT_TRACING set to 0 the HYBIRT_TRACE_SCOPE
+// macro expands to nothing; otherwise recording starts with Tracer::enable().
+#ifndef HYBIRT_TRACING
+#define HYBIRT_TRACING 1
+#endif
+
+
+struct TraceEvent
+{
+    char const* name;         // string literal, or a stage name
+    std::int64_t nanoseconds; // since the tracer was enabled
+    std::int32_t population;  // index of the population, -1 for none
+    char phase;               // 'B' begin or 'E' end
+};
+
+
+
+// Events of one thread. Only the owning thread records, so recording is a
+// store and a release of the head, with no lock. Once full, the oldest
+// events are overwritten.
+class TraceBuffer
+{
+public:
+    TraceBuffer(std::size_t capacity, std::uint32_t tid, std::string name)
+        : m_events(std::bit_ceil(std::max<std::size_t>(capacity, 2)))
+        , m_mask{m_events.size() - 1}
+        , m_tid{tid}
+        , m_name{std::move(name)}
+    {
+    }
+
+    void record(TraceEvent const& event)
+    {
+        auto const head         = m_head.load(std::memory_order_relaxed);
+        m_events[head & m_mask] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // recorded events still in the buffer, oldest first. Only meaningful once
+    // the owning thread stopped recording.
+    std::vector<TraceEvent> events() const
+    {
+        auto const head  = m_head.load(std::memory_order_acquire);
+        auto const count = std::min<std::uint64_t>(head, m_events.size());
+        std::vector<TraceEvent> events;
+        events.reserve(count);
+        for (auto i = head - count; i < head; ++i)
+            events.push_back(m_events[i & m_mask]);
+        return events;
+    }
+
+    std::uint32_t tid() const { return m_tid; }
+    std::string const& name() const { return m_name; }
+    void name(std::string name) { m_name = std::move(name); }
+
+private:
+    std::vector<TraceEvent> m_events;
+    std::size_t m_mask;
+    std::atomic<std::uint64_t> m_head{0};
+    std::uint32_t m_tid;
+    std::string m_name;
+};
+
+
+
+// Owns the buffers of all the threads that recorded events. A thread
+// registers its buffer, under a lock, the first time it records.
+class Tracer
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t default_capacity = std::size_t{1} << 18;
+
+    static Tracer& instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // starts recording, keeping the last capacity events of each thread
+    void enable(std::size_t capacity = default_capacity)
+    {
+        m_capacity = capacity;
+        m_start    = clock::now();
+        m_enabled.store(true, std::memory_order_release);
+    }
+
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // names the calling thread in the trace, threads are "thread <tid>"
+    // otherwise
+    void name_this_thread(std::string name)
+    {
+        if (!enabled())
+            return;
+        auto& buffer = this_thread();
+        std::lock_guard<std::mutex> lock{m_mutex};
+        buffer.name(std::move(name));
+    }
+
+    // names reported in the arguments of the events of each population
+    void population_names(std::vector<std::string> names) { m_population_names = std::move(names); }
+
+    void begin(char const* name, std::int32_t population = -1)
+    {
+        this_thread().record({name, now(), population, 'B'});
+    }
+
+    void end(char const* name) { this_thread().record({name, now(), -1, 'E'}); }
+
+    // stops recording and writes the events of all the threads to filename.
+    // Threads must not be inside traced scopes any more. pid tells the MPI
+    // ranks apart.
+    void write(std::string const& filename, int pid = 0)
+    {
+        m_enabled.store(false, std::memory_order_release);
+
+        std::ofstream out{filename};
+        if (!out)
+            throw std::runtime_error("Cannot write trace " + filename);
+
+        std::lock_guard<std::mutex> lock{m_mutex};
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+            << ", \"args\": {\"name\": \"hybirt rank " << pid << "\"}}";
+        for (auto const& buffer : m_buffers)
+        {
+            out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+                << ", \"tid\": " << buffer->tid() << ", \"args\": {\"name\": \""
+                << buffer->name() << "\"}}";
+
+            // a buffer that wrapped around may start with the end of scopes
+            // whose beginning was overwritten
+            std::size_t depth = 0;
+            for (auto const& event : buffer->events())
+            {
+                if (event.phase == 'E' and depth == 0)
+                    continue;
+                depth += event.phase == 'B' ? 1 : -1;
+                write_event(out, event, pid, buffer->tid());
+            }
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    Tracer() = default;
+
+    std::int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - m_start)
+            .count();
+    }
+
+    TraceBuffer& this_thread()
+    {
+        thread_local TraceBuffer* buffer = register_thread();
+        return *buffer;
+    }
+
+    TraceBuffer* register_thread()
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        auto const tid = static_cast<std::uint32_t>(m_buffers.size());
+        m_buffers.push_back(
+            std::make_unique<TraceBuffer>(m_capacity, tid, "thread " + std::to_string(tid)));
+        return m_buffers.back().get();
+    }
+
+    void write_event(std::ostream& out, TraceEvent const& event, int pid, std::uint32_t tid) const
+    {
+        out << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"hybirt\", \"ph\": \""
+            << event.phase << "\", \"ts\": " << event.nanoseconds / 1000 << "."
+            << std::to_string(1000 + event.nanoseconds % 1000).substr(1) << ", \"pid\": " << pid
+            << ", \"tid\": " << tid;
+        if (event.population >= 0)
+        {
+            auto const ipop = static_cast<std::size_t>(event.population);
+            out << ", \"args\": {\"population\": \""
+                << (ipop < m_population_names.size() ? m_population_names[ipop]
+                                                     : std::to_string(ipop))
+                << "\"}";
+        }
+        out << "}";
+    }
+
+    std::atomic<bool> m_enabled{false};
+    std::size_t m_capacity    = default_capacity;
+    clock::time_point m_start = clock::now();
+    std::vector<std::string> m_population_names;
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> m_buffers;
+};
+
+
+
+// records a begin event on construction and the matching end event on
+// destruction, when the tracer is enabled
+class TraceScope
+{
+public:
+    explicit TraceScope(char const* name, std::int32_t population = -1)
+        : m_name{name}
+        , m_enabled{Tracer::instance().enabled()}
+    {
+        if (m_enabled)
+            Tracer::instance().begin(name, population);
+    }
+
+    ~TraceScope()
+    {
+        if (m_enabled)
+            Tracer::instance().end(m_name);
+    }
+
+    TraceScope(TraceScope const&)            = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+
+private:
+    char const* m_name;
+    bool m_enabled;
+};
+
+
+#define HYBIRT_CONCAT_IMPL(a, b) a##b
+#define HYBIRT_CONCAT(a, b) HYBIRT_CONCAT_IMPL(a, b)
+
+#if HYBIRT_TRACING
+// traces the rest of the enclosing scope, optionally for one population
+#define HYBIRT_TRACE_SCOPE(...) TraceScope HYBIRT_CONCAT(hybirt_trace_, __LINE__){__VA_ARGS__}
+#else
+#define HYBIRT_TRACE_SCOPE(...)
+#endif
+
+
+#endif // HYBIRT_TRACE_HPP
@@ -8,6 +8,39 @@ enum Direction { X = 0, Y = 1, Z = 2 };
 enum class Component { X = 0, Y = 1, Z = 2 };
 
 
+// put before a loop whose iterations do not depend on each other through
+// memory, e.g. a field solver writing a field it does not read. The compiler
+// then vectorizes it without run-time checks that the fields overlap.
+#if defined(__clang__)
+#define HYBIRT_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define HYBIRT_IVDEP _Pragma("GCC ivdep")
+#else
+#define HYBIRT_IVDEP
+#endif
+
+
+// floor of a value known to fit in an int, without calling std::floor
+inline int floor_to_int(double value)
+{
+    int const truncated = static_cast<int>(value);
+    return truncated - (value < truncated ? 1 : 0);
+}
+
+// splits a position in cells into the shift of its cell and its offset in
+// that cell, in [0, 1). A tiny negative position minus its floor rounds to
+// exactly 1, the start of the next cell.
+inline int split_offset(double position, double& offset)
+{
+    int shift = floor_to_int(position);
+    offset    = position - shift;
+    if (offset >= 1.0)
+    {
+        ++shift;
+        offset = 0.0;
+    }
+    return shift;
+}
 
 
 #endif // HYBRIDIRT_UTILS_HPP
@@ -18,6 +18,10 @@ struct VecField
     {
         // Initialize the vector field with the grid layout
     }
+
+    VecFieldView<dimension, double> view() { return {x.view(), y.view(), z.view()}; }
+    VecFieldView<dimension, double const> view() const { return {x.view(), y.view(), z.view()}; }
+
     Field<dimension> x;
     Field<dimension> y;
     Field<dimension> z;
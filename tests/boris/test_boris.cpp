@@ -1,8 +1,13 @@
+#include "blended_field.hpp"
 #include "pusher.hpp"
 
 #include "highfive/highfive.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <tuple>
 #include <vector>
 
 void uniform_bz()
@@ -14,9 +19,8 @@ void uniform_bz()
     particle.v[1]        = 2.0;
     particle.v[2]        = 0.0;
     particle.weight      = 1.0;
-    particle.mass        = 1.0;
-    particle.charge      = 1.0;
-    std::vector<Particle<1>> particles{particle};
+    ParticleArray<1> particles{/*mass=*/1.0, /*charge=*/1.0};
+    particles.push_back(particle);
 
     double time                     = 0.;
     double final_time               = 3.141592 * 4;
@@ -49,10 +53,10 @@ void uniform_bz()
 
     while (time < final_time)
     {
-        x.push_back(particles[0].position[0]);
-        vx.push_back(particles[0].v[0]);
-        vy.push_back(particles[0].v[1]);
-        vz.push_back(particles[0].v[2]);
+        x.push_back(particles.position(Direction::X)[0]);
+        vx.push_back(particles.v(0)[0]);
+        vy.push_back(particles.v(1)[0]);
+        vz.push_back(particles.v(2)[0]);
         // Push the particles using the Boris pusher
         push(particles, E, B);
 
@@ -91,9 +95,8 @@ void drift_ey()
     particle.v[1]        = 1.0;
     particle.v[2]        = 0.0;
     particle.weight      = 1.0;
-    particle.mass        = 1.0;
-    particle.charge      = 1.0;
-    std::vector<Particle<1>> particles{particle};
+    ParticleArray<1> particles{/*mass=*/1.0, /*charge=*/1.0};
+    particles.push_back(particle);
 
     double time                     = 0.;
     double final_time               = 3.141592 * 4;
@@ -130,10 +133,10 @@ void drift_ey()
         // Push the particles using the Boris pusher
         push(particles, E, B);
 
-        x.push_back(particles[0].position[0]);
-        vx.push_back(particles[0].v[0]);
-        vy.push_back(particles[0].v[1]);
-        vz.push_back(particles[0].v[2]);
+        x.push_back(particles.position(Direction::X)[0]);
+        vx.push_back(particles.v(0)[0]);
+        vy.push_back(particles.v(1)[0]);
+        vz.push_back(particles.v(2)[0]);
 
         double const iCell_float = particle.position[0] / layout->cell_size(Direction::X)
                                    + layout->dual_dom_start(Direction::X);
@@ -160,8 +163,398 @@ void drift_ey()
     }
 }
 
+// the vectorized kernels must agree with the scalar one to round-off
+int simd_matches_scalar()
+{
+    std::cout << "Running simd_matches_scalar test...\n";
+    std::size_t constexpr dimension = 1;
+    double dt                       = 0.001;
+
+    std::array<std::size_t, dimension> grid_size = {100};
+    std::array<double, dimension> cell_size      = {0.1};
+    auto constexpr nbr_ghosts                    = 1;
+    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+
+    VecField<dimension> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+
+    std::mt19937_64 gen{42};
+    std::uniform_real_distribution<double> uniform{-1.0, 1.0};
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z})
+        for (auto& value : *field)
+            value = uniform(gen);
+
+    // odd count so that the masked tail of both kernels is exercised
+    ParticleArray<dimension> reference{1.0, 1.0};
+    for (int ip = 0; ip < 1003; ++ip)
+    {
+        Particle<dimension> particle;
+        particle.position[0] = 0.5 + 9.0 * (uniform(gen) + 1.0) / 2.0;
+        particle.v           = {uniform(gen), uniform(gen), uniform(gen)};
+        particle.weight      = 1.0;
+        reference.push_back(particle);
+    }
+
+    Boris<dimension> push{layout, dt};
+    push.simd(SimdLevel::scalar);
+    auto scalar = reference;
+    for (int step = 0; step < 10; ++step)
+        push(scalar, E, B);
+
+    int failures = 0;
+    for (auto level : {SimdLevel::avx2, SimdLevel::avx512})
+    {
+        if (static_cast<int>(level) > static_cast<int>(detect_simd_level()))
+        {
+            std::cout << "  " << to_string(level) << " not supported, skipped\n";
+            continue;
+        }
+        push.simd(level);
+        auto vectorized = reference;
+        for (int step = 0; step < 10; ++step)
+            push(vectorized, E, B);
+
+        double max_diff = 0.0;
+        for (std::size_t ip = 0; ip < scalar.size(); ++ip)
+        {
+            max_diff = std::max(max_diff, std::abs(scalar.position(Direction::X)[ip]
+                                                   - vectorized.position(Direction::X)[ip]));
+            for (std::size_t c = 0; c < 3; ++c)
+                max_diff = std::max(max_diff, std::abs(scalar.v(c)[ip] - vectorized.v(c)[ip]));
+        }
+        std::cout << "  " << to_string(level) << " max difference to scalar: " << max_diff << "\n";
+        if (max_diff > 1e-12)
+            ++failures;
+    }
+    return failures;
+}
+
+// a few particles pushed 5 times by the pusher the kernels replaced, whose
+// positions and velocities are hard-coded, anchor every kernel. The values
+// are the original pusher's with its dual weights shifted by half a cell, the
+// original weighted dual nodes as if they were primal.
+int matches_original_pusher()
+{
+    std::cout << "Running matches_original_pusher test...\n";
+    std::size_t constexpr dimension = 1;
+    double dt                       = 0.01;
+
+    std::array<std::size_t, dimension> grid_size = {100};
+    std::array<double, dimension> cell_size      = {0.1};
+    auto constexpr nbr_ghosts                    = 1;
+    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+
+    VecField<dimension> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    int phase = 0;
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z})
+    {
+        std::size_t ix = 0;
+        for (auto& value : *field)
+            value = 0.5 * std::sin(0.37 * ix++ + phase) + (field == &B.x ? 1.0 : 0.0);
+        ++phase;
+    }
+
+    std::array<double, 4> const x0 = {1.234, 3.0, 4.56789, 8.02};
+    std::array<std::array<double, 3>, 4> const v0
+        = {{{0.3, -0.2, 0.1}, {-0.5, 0.4, 0.0}, {0.05, 0.9, -0.7}, {1.0, 0.0, 0.25}}};
+    // x, vx, vy, vz
+    std::array<std::array<double, 4>, 4> const expected = {{
+        {1.2483798056544544, 0.27514466703154389, -0.19654861760411585, 0.1345386115626471},
+        {2.9742806562369601, -0.52870411227924707, 0.38950257434014479, -0.016133486848543478},
+        {4.5700789080658542, 0.037702181819315492, 0.83265930818183354, -0.75341748041098477},
+        {8.0692855499965397, 0.97151220962576834, 0.022231709424115852, 0.27936991020750523},
+    }};
+
+    ParticleArray<dimension> reference{1.0, 1.0};
+    for (std::size_t ip = 0; ip < x0.size(); ++ip)
+    {
+        Particle<dimension> particle;
+        particle.position[0] = x0[ip];
+        particle.v           = v0[ip];
+        particle.weight      = 1.0;
+        reference.push_back(particle);
+    }
+
+    Boris<dimension> push{layout, dt};
+    int failures = 0;
+    for (auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512})
+    {
+        if (static_cast<int>(level) > static_cast<int>(detect_simd_level()))
+            continue;
+        push.simd(level);
+        auto particles = reference;
+        for (int step = 0; step < 5; ++step)
+            push(particles, E, B);
+
+        double max_diff = 0.0;
+        for (std::size_t ip = 0; ip < particles.size(); ++ip)
+        {
+            max_diff = std::max(max_diff,
+                                std::abs(particles.position(Direction::X)[ip] - expected[ip][0]));
+            for (std::size_t c = 0; c < 3; ++c)
+                max_diff = std::max(max_diff, std::abs(particles.v(c)[ip] - expected[ip][c + 1]));
+        }
+        std::cout << "  " << to_string(level) << " max difference to the original pusher = "
+                  << max_diff << " (expected round-off)\n";
+        if (max_diff > 1e-13)
+            ++failures;
+    }
+    return failures;
+}
+
+// positions stored as a cell and an offset push like absolute ones, and
+// the offsets stay in [0, 1)
+int cell_relative_matches_absolute()
+{
+    std::cout << "Running cell_relative_matches_absolute test...\n";
+    std::size_t constexpr dimension = 1;
+    double dt                       = 0.01;
+
+    std::array<std::size_t, dimension> grid_size = {100};
+    std::array<double, dimension> cell_size      = {0.1};
+    auto constexpr nbr_ghosts                    = 1;
+    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+
+    VecField<dimension> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+
+    std::mt19937_64 gen{3};
+    std::uniform_real_distribution<double> uniform{-1.0, 1.0};
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z})
+        for (auto& value : *field)
+            value = uniform(gen);
+
+    ParticleArray<dimension> absolute{1.0, 1.0};
+    for (int ip = 0; ip < 1003; ++ip)
+    {
+        Particle<dimension> particle;
+        particle.position[0] = 2.0 + 6.0 * (uniform(gen) + 1.0) / 2.0;
+        particle.v           = {uniform(gen), uniform(gen), uniform(gen)};
+        particle.weight      = 1.0;
+        absolute.push_back(particle);
+    }
+    auto relative = absolute;
+    relative.to_cell_relative(cell_size);
+
+    Boris<dimension> push{layout, dt};
+    for (int step = 0; step < 20; ++step)
+    {
+        push(absolute, E, B);
+        push(relative, E, B);
+    }
+
+    double max_diff    = 0.0;
+    bool in_unit_range = true;
+    for (std::size_t ip = 0; ip < absolute.size(); ++ip)
+    {
+        auto const delta = relative.delta(Direction::X)[ip];
+        in_unit_range    = in_unit_range and delta >= 0.0 and delta < 1.0;
+        auto const x     = (relative.icell(Direction::X)[ip] + delta) * cell_size[0];
+        max_diff = std::max(max_diff, std::abs(x - absolute.position(Direction::X)[ip]));
+        for (std::size_t c = 0; c < 3; ++c)
+            max_diff = std::max(max_diff, std::abs(relative.v(c)[ip] - absolute.v(c)[ip]));
+    }
+    std::cout << "  max difference to absolute positions = " << max_diff
+              << " (expected round-off)\n";
+    std::cout << "  offsets in [0, 1) = " << std::boolalpha << in_unit_range << " (expected true)\n";
+
+    // a position a hair below a cell boundary whose offset rounds to 1
+    Particle<dimension> edge;
+    edge.position[0] = -1e-18;
+    edge.v           = {0.0, 0.0, 0.0};
+    edge.weight      = 1.0;
+    relative.push_back(edge);
+    auto const edge_cell  = relative.icell(Direction::X).back();
+    auto const edge_delta = relative.delta(Direction::X).back();
+    std::cout << "  offset rounding to 1: cell " << edge_cell << ", offset " << edge_delta
+              << " (expected 0, 0)\n";
+
+    return (max_diff < 1e-12 and in_unit_range and edge_cell == 0 and edge_delta == 0.0) ? 0 : 1;
+}
+
+// pushing in two field states blended in time gives what pushing in their
+// stored average gives, for every kernel
+int blended_matches_averaged()
+{
+    std::cout << "Running blended_matches_averaged test...\n";
+    std::size_t constexpr dimension = 1;
+    double dt                       = 0.001;
+
+    std::array<std::size_t, dimension> grid_size = {100};
+    std::array<double, dimension> cell_size      = {0.1};
+    auto constexpr nbr_ghosts                    = 1;
+    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+
+    VecField<dimension> E0{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B0{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dimension> E1{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B1{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dimension> Eavg{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> Bavg{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+
+    std::mt19937_64 gen{7};
+    std::uniform_real_distribution<double> uniform{-1.0, 1.0};
+    for (auto [f0, f1, avg] : {std::tuple{&E0.x, &E1.x, &Eavg.x}, {&E0.y, &E1.y, &Eavg.y},
+                               {&E0.z, &E1.z, &Eavg.z}, {&B0.x, &B1.x, &Bavg.x},
+                               {&B0.y, &B1.y, &Bavg.y}, {&B0.z, &B1.z, &Bavg.z}})
+        for (std::size_t ix = 0; ix < f0->size(); ++ix)
+        {
+            (*f0)(ix)  = uniform(gen);
+            (*f1)(ix)  = uniform(gen);
+            (*avg)(ix) = 0.5 * ((*f0)(ix) + (*f1)(ix));
+        }
+    BlendedVecField<dimension> const E{E0, E1, 0.5};
+    BlendedVecField<dimension> const B{B0, B1, 0.5};
+
+    ParticleArray<dimension> reference{1.0, 1.0};
+    for (int ip = 0; ip < 1003; ++ip)
+    {
+        Particle<dimension> particle;
+        particle.position[0] = 0.5 + 9.0 * (uniform(gen) + 1.0) / 2.0;
+        particle.v           = {uniform(gen), uniform(gen), uniform(gen)};
+        particle.weight      = 1.0;
+        reference.push_back(particle);
+    }
+
+    Boris<dimension> push{layout, dt};
+    int failures = 0;
+    for (auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512})
+        for (bool cell_relative : {false, true})
+        {
+            if (static_cast<int>(level) > static_cast<int>(detect_simd_level()))
+                continue;
+            push.simd(level);
+            auto averaged = reference;
+            auto blended  = reference;
+            if (cell_relative)
+            {
+                averaged.to_cell_relative(cell_size);
+                blended.to_cell_relative(cell_size);
+            }
+            for (int step = 0; step < 10; ++step)
+            {
+                push(averaged, Eavg, Bavg);
+                push(blended, E, B);
+            }
+
+            double max_diff = 0.0;
+            for (std::size_t ip = 0; ip < averaged.size(); ++ip)
+                for (std::size_t c = 0; c < 3; ++c)
+                    max_diff = std::max(max_diff, std::abs(averaged.v(c)[ip] - blended.v(c)[ip]));
+            std::cout << "  " << to_string(level) << (cell_relative ? ", cell relative" : "")
+                      << " max difference = " << max_diff << " (expected 0)\n";
+            if (max_diff != 0.0)
+                ++failures;
+        }
+    return failures;
+}
+
+// the gather grid gives the direct gather on uniform fields, and both gathers
+// interpolate fields linear in x exactly, dual ones included
+int gather_grid()
+{
+    std::cout << "Running gather_grid test...\n";
+    std::size_t constexpr dimension = 1;
+    double dt                       = 0.001;
+
+    std::array<std::size_t, dimension> grid_size = {100};
+    std::array<double, dimension> cell_size      = {0.1};
+    auto constexpr nbr_ghosts                    = 1;
+    auto layout = std::make_shared<GridLayout<dimension>>(grid_size, cell_size, nbr_ghosts);
+
+    VecField<dimension> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dimension> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+
+    std::mt19937_64 gen{11};
+    std::uniform_real_distribution<double> uniform{-1.0, 1.0};
+    ParticleArray<dimension> reference{1.0, 1.0};
+    for (int ip = 0; ip < 1003; ++ip)
+    {
+        Particle<dimension> particle;
+        particle.position[0] = 0.5 + 9.0 * (uniform(gen) + 1.0) / 2.0;
+        particle.v           = {uniform(gen), uniform(gen), uniform(gen)};
+        particle.weight      = 1.0;
+        reference.push_back(particle);
+    }
+
+    Boris<dimension> push{layout, dt};
+    int failures = 0;
+
+    double const uniform_values[6] = {0.1, -0.2, 0.3, 0.5, -1.0, 2.0};
+    Field<dimension>* fields[6]    = {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z};
+    for (int c = 0; c < 6; ++c)
+        std::fill(fields[c]->begin(), fields[c]->end(), uniform_values[c]);
+    for (auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512})
+    {
+        if (static_cast<int>(level) > static_cast<int>(detect_simd_level()))
+            continue;
+        push.simd(level);
+        auto direct = reference;
+        auto packed = reference;
+        for (int step = 0; step < 10; ++step)
+        {
+            push.gather_grid(false);
+            push(direct, E, B);
+            push.gather_grid(true);
+            push(packed, E, B);
+        }
+        double max_diff = 0.0;
+        for (std::size_t ip = 0; ip < direct.size(); ++ip)
+            for (std::size_t c = 0; c < 3; ++c)
+                max_diff = std::max(max_diff, std::abs(direct.v(c)[ip] - packed.v(c)[ip]));
+        std::cout << "  " << to_string(level) << " uniform fields, max difference = " << max_diff
+                  << " (expected 0)\n";
+        if (max_diff != 0.0)
+            ++failures;
+    }
+
+    // a particle at rest in E alone gains 2 qdt2m E at its position
+    for (int c = 0; c < 6; ++c)
+        for (std::size_t ix = 0; ix < fields[c]->size(); ++ix)
+        {
+            auto const x    = layout->coordinate(Direction::X, fields[c]->quantity(), ix);
+            (*fields[c])(ix) = c < 3 ? 1.0 + (c + 1) * 0.3 * x : 0.0;
+        }
+    for (auto c = 0; c < 3; ++c)
+        std::fill(reference.v(c).begin(), reference.v(c).end(), 0.0);
+    double const qdt2m = dt / 2;
+    for (auto level : {SimdLevel::scalar, SimdLevel::avx2, SimdLevel::avx512})
+    {
+        if (static_cast<int>(level) > static_cast<int>(detect_simd_level()))
+            continue;
+        push.simd(level);
+        auto direct = reference;
+        auto packed = reference;
+        push.gather_grid(false);
+        push(direct, E, B);
+        push.gather_grid(true);
+        push(packed, E, B);
+        double max_error = 0.0;
+        double max_diff  = 0.0;
+        for (std::size_t ip = 0; ip < packed.size(); ++ip)
+            for (std::size_t c = 0; c < 3; ++c)
+            {
+                auto const x     = reference.position(Direction::X)[ip];
+                auto const exact = 1.0 + (c + 1) * 0.3 * x;
+                max_error = std::max({max_error, std::abs(direct.v(c)[ip] / (2 * qdt2m) - exact),
+                                      std::abs(packed.v(c)[ip] / (2 * qdt2m) - exact)});
+                max_diff  = std::max(max_diff, std::abs(direct.v(c)[ip] - packed.v(c)[ip]));
+            }
+        std::cout << "  " << to_string(level) << " linear E, max error = " << max_error
+                  << " (expected 0)\n";
+        std::cout << "  " << to_string(level) << " linear E, direct vs packed max difference = "
+                  << max_diff << " (expected round-off)\n";
+        if (max_error > 1e-10 or max_diff > 1e-12)
+            ++failures;
+    }
+    return failures;
+}
+
 int main()
 {
     uniform_bz();
     drift_ey();
+    return matches_original_pusher() + simd_matches_scalar() + cell_relative_matches_absolute()
+           + blended_matches_averaged() + gather_grid();
 }
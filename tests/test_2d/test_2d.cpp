@@ -0,0 +1,221 @@
+// test_2d.cpp
+#include "ampere.hpp"
+#include "boris_kernels.hpp"
+#include "faraday.hpp"
+#include "field.hpp"
+#include "gridlayout.hpp"
+#include "ohm.hpp"
+#include "population.hpp"
+#include "pusher.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+constexpr std::size_t dim = 2;
+
+// sets every node of field, ghosts included, to fn(x, y)
+template<typename Fn>
+void set(Field<dim>& field, GridLayout<dim> const& layout, Fn&& fn)
+{
+    for (std::size_t ix = 0; ix < field.shape()[0]; ++ix)
+        for (std::size_t iy = 0; iy < field.shape()[1]; ++iy)
+            field(ix, iy) = fn(layout.coordinate(Direction::X, field.quantity(), ix, iy),
+                               layout.coordinate(Direction::Y, field.quantity(), ix, iy));
+}
+
+int main()
+{
+    std::array<std::size_t, dim> grid_size = {16, 12};
+    std::array<double, dim> cell_size = {0.1, 0.2};
+    auto layout = std::make_shared<GridLayout<dim>>(grid_size, cell_size, 1);
+    auto const g = layout->dual_dom_start(Direction::X);
+    auto const nx = grid_size[0];
+    auto const ny = grid_size[1];
+    double const dt = 0.01;
+    bool ok = true;
+
+    // row-major storage, y contiguous
+    Field<dim> f{{4, 5}, Quantity::N};
+    f(2, 3) = 1.0;
+    bool const layout_ok = f.data()[2 * 5 + 3] == 1.0 and f.stride(0) == 5 and f.stride(1) == 1;
+    std::cout << "Row-major indexing = " << std::boolalpha << layout_ok << " (expected true)\n";
+    ok = ok and layout_ok;
+
+    VecField<dim> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> Bnew{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> J{layout, {Quantity::Jx, Quantity::Jy, Quantity::Jz}};
+    VecField<dim> V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}};
+    Field<dim> N{layout->allocate(Quantity::N), Quantity::N};
+
+    set(E.x, *layout, [](double x, double y) { return std::sin(3 * x + y); });
+    set(E.y, *layout, [](double x, double y) { return std::cos(x - 2 * y); });
+    set(E.z, *layout, [](double x, double y) { return std::sin(2 * x) * std::cos(y); });
+    set(B.x, *layout, [](double x, double y) { return std::cos(x * y); });
+    set(B.y, *layout, [](double x, double y) { return std::sin(x + y); });
+    set(B.z, *layout, [](double x, double y) { return x - y; });
+
+    // Faraday changes B by a discrete curl, whose divergence is zero
+    Faraday<dim> faraday{layout, dt};
+    faraday(E, B, Bnew);
+    double div_dB = 0.0;
+    for (auto ix = g; ix < g + nx; ++ix)
+        for (auto iy = g; iy < g + ny; ++iy)
+        {
+            auto const ddx = (Bnew.x(ix + 1, iy) - B.x(ix + 1, iy)) - (Bnew.x(ix, iy) - B.x(ix, iy));
+            auto const ddy = (Bnew.y(ix, iy + 1) - B.y(ix, iy + 1)) - (Bnew.y(ix, iy) - B.y(ix, iy));
+            div_dB = std::max(div_dB, std::abs(ddx / cell_size[0] + ddy / cell_size[1]));
+        }
+    std::cout << "Faraday max |div(Bnew - B)| = " << div_dB << " (expected 0)\n";
+    ok = ok and div_dB < 1e-10;
+
+    // J is a discrete curl, divergence free on the interior primal nodes
+    Ampere<dim> ampere{layout};
+    ampere(B, J);
+    double div_J = 0.0;
+    for (auto ix = g + 1; ix < g + nx; ++ix)
+        for (auto iy = g + 1; iy < g + ny; ++iy)
+            div_J = std::max(div_J, std::abs((J.x(ix, iy) - J.x(ix - 1, iy)) / cell_size[0]
+                                             + (J.y(ix, iy) - J.y(ix, iy - 1)) / cell_size[1]));
+    std::cout << "Ampere max |div J| = " << div_J << " (expected 0)\n";
+    ok = ok and div_J < 1e-10;
+
+    // Jz = dBy/dx - dBx/dy, second order
+    set(B.x, *layout, [](double, double y) { return std::sin(y); });
+    set(B.y, *layout, [](double x, double) { return std::cos(2 * x); });
+    ampere(B, J);
+    double jz_error = 0.0;
+    for (auto ix = g; ix <= g + nx; ++ix)
+        for (auto iy = g; iy <= g + ny; ++iy)
+        {
+            auto const x = layout->coordinate(Direction::X, Quantity::Jz, ix, iy);
+            auto const y = layout->coordinate(Direction::Y, Quantity::Jz, ix, iy);
+            jz_error = std::max(jz_error, std::abs(J.z(ix, iy) - (-2 * std::sin(2 * x) - std::cos(y))));
+        }
+    std::cout << "Ampere max Jz error = " << jz_error << " (expected < 1e-2)\n";
+    ok = ok and jz_error < 1e-2;
+
+    // uniform fields and no current: E = -V x B
+    std::array<double, 3> const b = {0.3, -0.2, 1.0};
+    std::array<double, 3> const v = {0.1, 0.4, -0.5};
+    for (auto [field, value] : {std::pair{&B.x, b[0]}, {&B.y, b[1]}, {&B.z, b[2]}, {&V.x, v[0]},
+                                {&V.y, v[1]}, {&V.z, v[2]}})
+        std::fill(field->begin(), field->end(), value);
+    for (auto* field : {&J.x, &J.y, &J.z})
+        std::fill(field->begin(), field->end(), 0.0);
+    std::fill(N.begin(), N.end(), 2.0);
+    Ohm<dim> ohm{layout};
+    ohm(B, J, N, V, E);
+    std::array<double, 3> const expected = {-(v[1] * b[2] - v[2] * b[1]), -(v[2] * b[0] - v[0] * b[2]),
+                                            -(v[0] * b[1] - v[1] * b[0])};
+    double ohm_error = 0.0;
+    for (std::size_t c = 0; c < 3; ++c)
+    {
+        auto& field = c == 0 ? E.x : c == 1 ? E.y : E.z;
+        for (auto ix = layout->dom_start(field.quantity(), Direction::X);
+             ix <= layout->dom_end(field.quantity(), Direction::X); ++ix)
+            for (auto iy = layout->dom_start(field.quantity(), Direction::Y);
+                 iy <= layout->dom_end(field.quantity(), Direction::Y); ++iy)
+                ohm_error = std::max(ohm_error, std::abs(field(ix, iy) - expected[c]));
+    }
+    std::cout << "Ohm max error on uniform fields = " << ohm_error << " (expected 0)\n";
+    ok = ok and ohm_error < 1e-12;
+
+    // bilinear interpolation is exact on linear fields, whatever the centering
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z})
+        set(*field, *layout, [](double x, double y) { return 1.0 + 2.0 * x - 3.0 * y; });
+    ParticleArray<dim> particles;
+    Boris<dim> boris{layout, dt};
+    auto const args = boris.kernel_args_2d(particles, E, B);
+    std::mt19937_64 gen{7};
+    std::uniform_real_distribution<double> ux{0.0, nx * cell_size[0]};
+    std::uniform_real_distribution<double> uy{0.0, ny * cell_size[1]};
+    double gather_error = 0.0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        double const x = ux(gen);
+        double const y = uy(gen);
+        int const cx   = static_cast<int>(std::floor(x / cell_size[0]));
+        int const cy   = static_cast<int>(std::floor(y / cell_size[1]));
+        for (int c = 0; c < 6; ++c)
+        {
+            auto const value = boris_gather_2d(args.fields[c], args.stride[c], args.dual[c],
+                                               cx + g, cy + g, x / cell_size[0] - cx,
+                                               y / cell_size[1] - cy);
+            gather_error = std::max(gather_error, std::abs(value - (1.0 + 2.0 * x - 3.0 * y)));
+        }
+    }
+    std::cout << "Bilinear gather max error = " << gather_error << " (expected 0)\n";
+    ok = ok and gather_error < 1e-12;
+
+    // gyration in a uniform Bz, no E: the speed is conserved
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y})
+        std::fill(field->begin(), field->end(), 0.0);
+    std::fill(B.z.begin(), B.z.end(), 1.0);
+    Particle<dim> p;
+    p.position = {0.8, 1.2};
+    p.v        = {0.3, 0.0, 0.1};
+    p.weight   = 1.0;
+    particles.push_back(p);
+    for (int step = 0; step < 100; ++step)
+        boris(particles, E, B);
+    auto const speed = std::hypot(particles.v(0)[0], particles.v(1)[0]);
+    std::cout << "Gyration speed = " << speed << " (expected 0.3)\n";
+    ok = ok and std::abs(speed - 0.3) < 1e-12 and particles.v(2)[0] == 0.1;
+
+    // the deposit conserves the weight, a particle on a node only loads it
+    Population<dim> pop{"test_species", layout};
+    double total_vx = 0.0;
+    for (int i = 0; i < 500; ++i)
+    {
+        Particle<dim> q;
+        q.position = {ux(gen), uy(gen)};
+        q.v        = {std::sin(i), 0.0, 0.0};
+        q.weight   = 1.0;
+        total_vx += q.v[0];
+        pop.particles().push_back(q);
+    }
+    pop.rebin();
+    pop.deposit();
+    double total = 0.0;
+    double flux  = 0.0;
+    for (std::size_t i = 0; i < pop.density().size(); ++i)
+    {
+        total += pop.density().data()[i];
+        flux += pop.flux().x.data()[i];
+    }
+    std::cout << "Deposited weight = " << total << " (expected 500)\n";
+    ok = ok and std::abs(total - 500.0) < 1e-9 and std::abs(flux - total_vx) < 1e-9;
+
+    // particles are binned by row-major cell index
+    bool sorted = true;
+    auto const& bins = pop.bins();
+    for (std::size_t cell = 0; cell < bins.nbr_cells(); ++cell)
+    {
+        auto const [first, last] = bins.cell_range(cell);
+        for (auto ip = first; ip < last; ++ip)
+        {
+            auto const cx = static_cast<std::size_t>(pop.particles().position(Direction::X)[ip] / cell_size[0]);
+            auto const cy = static_cast<std::size_t>(pop.particles().position(Direction::Y)[ip] / cell_size[1]);
+            sorted = sorted and cx * ny + cy == cell;
+        }
+    }
+    std::cout << "Particles sorted by cell = " << sorted << " (expected true)\n";
+    ok = ok and sorted;
+
+    Population<dim> single{"single", layout};
+    Particle<dim> q;
+    q.position = {3 * cell_size[0], 5 * cell_size[1]};
+    q.v        = {0.0, 0.0, 0.0};
+    q.weight   = 2.0;
+    single.particles().push_back(q);
+    single.deposit();
+    bool const node_ok = std::abs(single.density()(g + 3, g + 5) - 2.0) < 1e-12;
+    std::cout << "Particle on a node deposits there = " << node_ok << " (expected true)\n";
+    ok = ok and node_ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// test_3d.cpp
+#include "ampere.hpp"
+#include "faraday.hpp"
+#include "field.hpp"
+#include "gridlayout.hpp"
+#include "ohm.hpp"
+#include "tiling.hpp"
+#include "vecfield.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+constexpr std::size_t dim = 3;
+
+// sets every node of field, ghosts included, to fn(x, y, z)
+template<typename Fn>
+void set(Field<dim>& field, GridLayout<dim> const& layout, Fn&& fn)
+{
+    auto const q = field.quantity();
+    for (std::size_t ix = 0; ix < field.shape()[0]; ++ix)
+        for (std::size_t iy = 0; iy < field.shape()[1]; ++iy)
+            for (std::size_t iz = 0; iz < field.shape()[2]; ++iz)
+                field(ix, iy, iz) = fn(layout.coordinate(Direction::X, q, ix, iy, iz),
+                                       layout.coordinate(Direction::Y, q, ix, iy, iz),
+                                       layout.coordinate(Direction::Z, q, ix, iy, iz));
+}
+
+double max_difference(VecField<dim> const& a, VecField<dim> const& b)
+{
+    double diff = 0.0;
+    for (auto [fa, fb] : {std::pair{&a.x, &b.x}, {&a.y, &b.y}, {&a.z, &b.z}})
+        for (std::size_t i = 0; i < fa->size(); ++i)
+            diff = std::max(diff, std::abs(fa->data()[i] - fb->data()[i]));
+    return diff;
+}
+
+int main()
+{
+    std::array<std::size_t, dim> grid_size = {10, 9, 12};
+    std::array<double, dim> cell_size = {0.1, 0.2, 0.15};
+    auto layout = std::make_shared<GridLayout<dim>>(grid_size, cell_size, 1);
+    auto const g = layout->dual_dom_start(Direction::X);
+    double const dt = 0.01;
+    bool ok = true;
+
+    VecField<dim> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> Bnew{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> J{layout, {Quantity::Jx, Quantity::Jy, Quantity::Jz}};
+    VecField<dim> V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}};
+    Field<dim> N{layout->allocate(Quantity::N), Quantity::N};
+
+    set(E.x, *layout, [](double x, double y, double z) { return std::sin(3 * x + y - z); });
+    set(E.y, *layout, [](double x, double y, double z) { return std::cos(x - 2 * y + z); });
+    set(E.z, *layout, [](double x, double y, double z) { return std::sin(2 * x) * std::cos(y * z); });
+    set(B.x, *layout, [](double x, double y, double z) { return std::cos(x * y + z); });
+    set(B.y, *layout, [](double x, double y, double z) { return std::sin(x + y * z); });
+    set(B.z, *layout, [](double x, double y, double z) { return x - y + 2 * z; });
+
+    // Faraday changes B by a discrete curl, whose divergence is zero
+    Faraday<dim> faraday{layout, dt};
+    faraday(E, B, Bnew);
+    double div_dB = 0.0;
+    for (auto ix = g; ix < g + grid_size[0]; ++ix)
+        for (auto iy = g; iy < g + grid_size[1]; ++iy)
+            for (auto iz = g; iz < g + grid_size[2]; ++iz)
+            {
+                auto dB = [&](Field<dim> const& b, Field<dim> const& bnew, auto... ijk) {
+                    return bnew(ijk...) - b(ijk...);
+                };
+                auto const ddx = dB(B.x, Bnew.x, ix + 1, iy, iz) - dB(B.x, Bnew.x, ix, iy, iz);
+                auto const ddy = dB(B.y, Bnew.y, ix, iy + 1, iz) - dB(B.y, Bnew.y, ix, iy, iz);
+                auto const ddz = dB(B.z, Bnew.z, ix, iy, iz + 1) - dB(B.z, Bnew.z, ix, iy, iz);
+                div_dB = std::max(div_dB, std::abs(ddx / cell_size[0] + ddy / cell_size[1]
+                                                   + ddz / cell_size[2]));
+            }
+    std::cout << "Faraday max |div(Bnew - B)| = " << div_dB << " (expected 0)\n";
+    ok = ok and div_dB < 1e-10;
+
+    // J is a discrete curl, divergence free on the interior primal nodes
+    Ampere<dim> ampere{layout};
+    ampere(B, J);
+    double div_J = 0.0;
+    for (auto ix = g + 1; ix < g + grid_size[0]; ++ix)
+        for (auto iy = g + 1; iy < g + grid_size[1]; ++iy)
+            for (auto iz = g + 1; iz < g + grid_size[2]; ++iz)
+                div_J = std::max(div_J,
+                                 std::abs((J.x(ix, iy, iz) - J.x(ix - 1, iy, iz)) / cell_size[0]
+                                          + (J.y(ix, iy, iz) - J.y(ix, iy - 1, iz)) / cell_size[1]
+                                          + (J.z(ix, iy, iz) - J.z(ix, iy, iz - 1)) / cell_size[2]));
+    std::cout << "Ampere max |div J| = " << div_J << " (expected 0)\n";
+    ok = ok and div_J < 1e-10;
+
+    // the tiling changes the order of the sweep, not the result
+    VecField<dim> Bref{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    VecField<dim> Jref{layout, {Quantity::Jx, Quantity::Jy, Quantity::Jz}};
+    VecField<dim> Eref{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    set(V.x, *layout, [](double x, double, double z) { return 0.1 * std::sin(x + z); });
+    set(V.y, *layout, [](double, double y, double) { return 0.2 * std::cos(y); });
+    set(V.z, *layout, [](double x, double y, double) { return 0.1 * x * y; });
+    set(N, *layout, [](double x, double y, double z) { return 1.0 + 0.2 * std::sin(x * y * z); });
+
+    Ohm<dim> ohm{layout};
+    Tiles const whole{1000, 1000, 1000};
+    faraday.tiles(whole);
+    ampere.tiles(whole);
+    ohm.tiles(whole);
+    faraday(E, B, Bref);
+    ampere(B, Jref);
+    ohm(B, Jref, N, V, Eref);
+
+    double tiling_diff = 0.0;
+    VecField<dim> Enew{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    for (auto tiles : {Tiles{}, Tiles{3, 5, 7}, Tiles{1, 1, 1}})
+    {
+        faraday.tiles(tiles);
+        ampere.tiles(tiles);
+        ohm.tiles(tiles);
+        faraday(E, B, Bnew);
+        ampere(B, J);
+        ohm(B, J, N, V, Enew);
+        tiling_diff = std::max({tiling_diff, max_difference(Bnew, Bref), max_difference(J, Jref),
+                                max_difference(Enew, Eref)});
+    }
+    std::cout << "Tiled vs untiled max difference = " << tiling_diff << " (expected 0)\n";
+    ok = ok and tiling_diff == 0.0;
+
+    // uniform fields and no current: E = -V x B
+    std::array<double, 3> const b = {0.3, -0.2, 1.0};
+    std::array<double, 3> const v = {0.1, 0.4, -0.5};
+    for (auto [field, value] : {std::pair{&B.x, b[0]}, {&B.y, b[1]}, {&B.z, b[2]}, {&V.x, v[0]},
+                                {&V.y, v[1]}, {&V.z, v[2]}})
+        std::fill(field->begin(), field->end(), value);
+    for (auto* field : {&J.x, &J.y, &J.z})
+        std::fill(field->begin(), field->end(), 0.0);
+    std::fill(N.begin(), N.end(), 2.0);
+    ohm.tiles(Tiles{3, 5, 7});
+    ohm(B, J, N, V, E);
+    std::array<double, 3> const expected = {-(v[1] * b[2] - v[2] * b[1]), -(v[2] * b[0] - v[0] * b[2]),
+                                            -(v[0] * b[1] - v[1] * b[0])};
+    double ohm_error = 0.0;
+    for (std::size_t c = 0; c < 3; ++c)
+    {
+        auto const& field = c == 0 ? E.x : c == 1 ? E.y : E.z;
+        auto const box    = dom_box(*layout, field.quantity());
+        for (auto ix = box.lower[0]; ix <= box.upper[0]; ++ix)
+            for (auto iy = box.lower[1]; iy <= box.upper[1]; ++iy)
+                for (auto iz = box.lower[2]; iz <= box.upper[2]; ++iz)
+                    ohm_error = std::max(ohm_error, std::abs(field(ix, iy, iz) - expected[c]));
+    }
+    std::cout << "Ohm max error on uniform fields = " << ohm_error << " (expected 0)\n";
+    ok = ok and ohm_error < 1e-12;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// test_async_diagnostics.cpp
+#include "async_diagnostics.hpp"
+#include "diagnostics.hpp"
+#include "gridlayout.hpp"
+
+#include "highfive/highfive.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+constexpr std::size_t dim = 1;
+
+// state of snapshot i, different for every snapshot
+struct State
+{
+    State(std::shared_ptr<GridLayout<dim>> const& layout, std::size_t nbr_particles)
+        : B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}}
+        , E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}}
+        , V{layout, {Quantity::Vx, Quantity::Vy, Quantity::Vz}}
+        , N{layout->allocate(Quantity::N), Quantity::N}
+        , m_nbr_particles{nbr_particles}
+    {
+    }
+
+    void set(int i)
+    {
+        double phase = 0.1 * i;
+        for (auto* field : {&B.x, &B.y, &B.z, &E.x, &E.y, &E.z, &V.x, &V.y, &V.z, &N})
+        {
+            std::size_t ix = 0;
+            for (auto& value : *field)
+                value = std::sin(0.3 * ix++ + phase);
+            phase += 1.0;
+        }
+
+        // a different number of particles in every snapshot
+        std::mt19937_64 gen{static_cast<unsigned long>(i)};
+        std::uniform_real_distribution<double> uniform{0.0, 1.0};
+        particles.clear();
+        for (std::size_t ip = 0; ip < m_nbr_particles + i; ++ip)
+        {
+            Particle<dim> p;
+            p.position[0] = 10.0 * uniform(gen);
+            p.v           = {uniform(gen), uniform(gen), uniform(gen)};
+            p.weight      = 1.0;
+            particles.push_back(p);
+        }
+    }
+
+    VecField<dim> B;
+    VecField<dim> E;
+    VecField<dim> V;
+    Field<dim> N;
+    ParticleArray<dim> particles;
+
+private:
+    std::size_t m_nbr_particles;
+};
+
+std::vector<double> read(std::string const& filename, std::string const& name)
+{
+    HighFive::File file{filename, HighFive::File::ReadOnly};
+    auto const dataset = file.getDataSet(name);
+    std::size_t size   = 1;
+    for (auto extent : dataset.getDimensions())
+        size *= extent;
+    std::vector<double> values(size);
+    if (size > 0)
+        dataset.read_raw(values.data());
+    return values;
+}
+
+// whether the files written with suffix hold the same values as the
+// synchronous ones
+bool same_files(std::string const& suffix)
+{
+    bool same = true;
+    for (std::string name : {"time", "Bx", "By", "Bz", "Ex", "Ey", "Ez", "Vx", "Vy", "Vz", "N"})
+        same = same and read("fields" + suffix + ".h5", name) == read("fields_sync.h5", name);
+    for (std::string name : {"x", "vx", "vy", "vz", "time"})
+        same = same
+               and read("particles_ions" + suffix + ".h5", name)
+                       == read("particles_ions_sync.h5", name);
+    return same;
+}
+
+int main()
+{
+    std::array<std::size_t, dim> grid_size = {20};
+    std::array<double, dim> cell_size      = {0.5};
+    auto const layout = std::make_shared<GridLayout<dim>>(grid_size, cell_size, 1);
+    int const nbr_snapshots = 5;
+    bool ok                 = true;
+
+    // computed beforehand, so that the snapshots come back to back
+    std::vector<State> states;
+    for (int i = 0; i < nbr_snapshots; ++i)
+        states.emplace_back(layout, 200000).set(i);
+    auto fill = [&](State const& state) {
+        return [&](Snapshot<dim>& snapshot) {
+            snapshot.B = state.B;
+            snapshot.E = state.E;
+            snapshot.V = state.V;
+            snapshot.N = state.N;
+            snapshot.particles(0, "ions") = state.particles;
+        };
+    };
+
+    {
+        DiagnosticsWriter<dim> writer{layout, 1, "_sync"};
+        for (int i = 0; i < nbr_snapshots; ++i)
+        {
+            auto const& state = states[i];
+            writer.begin_snapshot(0.1 * i);
+            writer.write_fields(state.B, state.E, state.V, state.N);
+            writer.write_particles("ions", state.particles);
+            writer.end_snapshot();
+        }
+    }
+
+    // a single buffer waits for the writer between back to back snapshots
+    // of that size, as many buffers as snapshots never do
+    for (std::size_t nbr_buffers : {std::size_t{1}, std::size_t{5}})
+    {
+        auto const suffix = "_async" + std::to_string(nbr_buffers);
+        std::size_t stalls = 0;
+        {
+            AsyncDiagnostics<dim> diagnostics{layout, 1, suffix, nbr_buffers};
+            for (int i = 0; i < nbr_snapshots; ++i)
+                diagnostics.snapshot(0.1 * i, fill(states[i]));
+            diagnostics.flush();
+            stalls = diagnostics.nbr_stalls();
+        }
+        bool const same = same_files(suffix);
+        std::cout << nbr_buffers << " buffer(s): same files as the synchronous writer = "
+                  << std::boolalpha << same << " (expected true), stalls = " << stalls
+                  << (nbr_buffers == 1 ? " (expected > 0)\n" : " (expected 0)\n");
+        ok = ok and same and (nbr_buffers == 1 ? stalls > 0 : stalls == 0);
+    }
+
+    // a fill that throws reaches the caller and gives its buffer back, a
+    // writer that throws reaches the next flush
+    {
+        AsyncDiagnostics<dim> diagnostics{layout, 1, "_errors", 1};
+        bool fill_error = false;
+        try
+        {
+            diagnostics.snapshot(0.0, [](Snapshot<dim>&) { throw std::runtime_error("fill"); });
+        }
+        catch (std::runtime_error const&)
+        {
+            fill_error = true;
+        }
+        diagnostics.snapshot(0.0, fill(states[0]));
+        diagnostics.flush();
+        std::cout << "Throwing fill rethrown and buffer reused = " << fill_error
+                  << " (expected true)\n";
+
+        diagnostics.snapshot(0.1, [&](Snapshot<dim>& snapshot) {
+            fill(states[1])(snapshot);
+            snapshot.particles(0, "missing_directory/ions");
+        });
+        bool write_error = false;
+        try
+        {
+            diagnostics.flush();
+        }
+        catch (std::exception const&)
+        {
+            write_error = true;
+        }
+        std::cout << "Writer error rethrown by flush = " << write_error << " (expected true)\n";
+        ok = ok and fill_error and write_error;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+// test_checkpoint.cpp
+#include "checkpoint.hpp"
+#include "patches.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+using PatchT = Patch<1>;
+
+double density(double x)
+{
+    return 1.0 + 0.2 * std::cos(2 * M_PI * x / 20.0);
+}
+
+// pushes, migrates and deposits the particles of every patch
+void move(PatchedDomain<1>& domain)
+{
+    domain.for_each_patch([](PatchT& patch) {
+        patch.push(patch.populations[0].particles(), patch.E, patch.B);
+    });
+    domain.migrate_particles();
+    domain.for_each_patch([](PatchT& patch) {
+        patch.populations[0].rebin();
+        patch.populations[0].deposit();
+    });
+    domain.fill([](PatchT& patch) -> auto& { return patch.populations[0].density(); });
+}
+
+// max difference between the densities and particle velocities of a and b
+double difference(PatchedDomain<1>& a, PatchedDomain<1>& b)
+{
+    double diff = 0.0;
+    for (std::size_t ip = 0; ip < a.size(); ++ip) {
+        auto const& pa = a[ip].populations[0];
+        auto const& pb = b[ip].populations[0];
+        if (pa.particles().size() != pb.particles().size())
+            return 1e30;
+        for (std::size_t ix = 0; ix < pa.density().size(); ++ix)
+            diff = std::max(diff, std::abs(pa.density()(ix) - pb.density()(ix)));
+        for (std::size_t i = 0; i < pa.particles().size(); ++i)
+            diff = std::max(diff, std::abs(pa.particles().v(0)[i] - pb.particles().v(0)[i]));
+    }
+    return diff;
+}
+
+int main()
+{
+    constexpr std::size_t dim = 1;
+    std::array<std::size_t, dim> grid_size = {40};
+    std::array<double, dim> cell_size = {0.5};
+    double const dt = 0.05;
+    std::string const filename = "test_checkpoint.bin";
+
+    ThreadPool pool{2};
+    PatchedDomain<dim> original{grid_size, cell_size, 1, 3, dt, pool};
+    PatchedDomain<dim> restarted{grid_size, cell_size, 1, 3, dt, pool};
+    original.add_population("test_species");
+    restarted.add_population("test_species");
+
+    for (std::size_t ip = 0; ip < original.size(); ++ip) {
+        auto& patch = original[ip];
+        patch.populations[0].load_particles(20, density);
+        patch.populations[0].use_cell_relative_positions();
+        auto const& layout = *patch.layout;
+        for (auto* field : {&patch.E.x, &patch.E.y, &patch.E.z, &patch.B.x, &patch.B.y, &patch.B.z})
+            for (std::size_t ix = 0; ix < field->size(); ++ix) {
+                auto const x = layout.coordinate(Direction::X, field->quantity(), ix);
+                (*field)(ix) = 0.3 * std::sin(2 * M_PI * x / 20.0 + static_cast<int>(field->quantity()));
+            }
+    }
+    original.fill(&PatchT::E);
+    original.fill(&PatchT::B);
+
+    for (int step = 0; step < 10; ++step)
+        move(original);
+    write_checkpoint(filename, original, {0.5, dt, 10});
+    auto const state = read_checkpoint(filename, restarted);
+    std::remove(filename.c_str());
+
+    bool const state_ok = state.time == 0.5 and state.dt == dt and state.step == 10;
+    std::cout << "Time state restored = " << std::boolalpha << state_ok << " (expected true)\n";
+
+    bool const rng_ok = original[1].populations[0].rng() == restarted[1].populations[0].rng();
+    std::cout << "Generator state restored = " << rng_ok << " (expected true)\n";
+
+    // the restarted run must follow the original one exactly
+    for (int step = 0; step < 10; ++step) {
+        move(original);
+        move(restarted);
+    }
+    auto const diff = difference(original, restarted);
+    std::cout << "Restarted run max difference = " << diff << " (expected 0)\n";
+
+    return (state_ok and rng_ok and diff == 0.0) ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// test_gridlayout.cpp
+#include "gridlayout.hpp"
+#include "tiling.hpp"
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+
+// centerings are compile time constants
+static_assert(GridLayout<3>::centering<Quantity::Ex>[Direction::X] == GridLayout<3>::dual);
+static_assert(GridLayout<3>::centering<Quantity::Ex>[Direction::Y] == GridLayout<3>::primal);
+static_assert(GridLayout<1>::centering<Quantity::Bz>[Direction::X] == GridLayout<1>::dual);
+static_assert(GridLayout<2>::centering<Quantity::By>[Direction::Y] == GridLayout<2>::primal);
+static_assert(GridLayout<1>::centering<Quantity::N>[Direction::X] == GridLayout<1>::primal);
+
+
+// the bounds and sizes computed from the compile time centering of qty
+// match the ones looked up at run time, in every direction
+template<Quantity qty, std::size_t dimension>
+bool same_bounds(GridLayout<dimension> const& layout)
+{
+    bool same = layout.template allocate<qty>() == layout.allocate(qty);
+    for (std::size_t d = 0; d < dimension; ++d)
+    {
+        auto const dir = static_cast<Direction>(d);
+        same           = same and layout.template dom_start<qty>() == layout.dom_start(qty, dir)
+               and layout.template dom_end<qty>(dir) == layout.dom_end(qty, dir)
+               and layout.template ghost_end<qty>(dir) == layout.ghost_end(qty, dir);
+    }
+    return same;
+}
+
+template<std::size_t dimension>
+bool same_bounds(GridLayout<dimension> const& layout)
+{
+    return same_bounds<Quantity::Ex>(layout) and same_bounds<Quantity::Ey>(layout)
+           and same_bounds<Quantity::Ez>(layout) and same_bounds<Quantity::Bx>(layout)
+           and same_bounds<Quantity::By>(layout) and same_bounds<Quantity::Bz>(layout)
+           and same_bounds<Quantity::Jx>(layout) and same_bounds<Quantity::Jy>(layout)
+           and same_bounds<Quantity::Jz>(layout) and same_bounds<Quantity::N>(layout)
+           and same_bounds<Quantity::Vx>(layout) and same_bounds<Quantity::Vy>(layout)
+           and same_bounds<Quantity::Vz>(layout);
+}
+
+int main()
+{
+    bool ok = true;
+
+    GridLayout<1> const layout_1d{{20}, {0.5}, 1};
+    GridLayout<2> const layout_2d{{20, 7}, {0.5, 0.25}, 2};
+    GridLayout<3> const layout_3d{{10, 9, 12}, {0.5, 0.4, 0.3}, 1};
+    for (auto [name, same] : {std::pair{"1D", same_bounds(layout_1d)},
+                              {"2D", same_bounds(layout_2d)},
+                              {"3D", same_bounds(layout_3d)}})
+    {
+        std::cout << name << " compile time bounds match = " << std::boolalpha << same
+                  << " (expected true)\n";
+        ok = ok and same;
+    }
+
+    // Ex has nbr_cells domain nodes along its dual x, one more along y
+    auto const nodes = [&](Direction dir) {
+        return layout_3d.dom_end<Quantity::Ex>(dir) - layout_3d.dom_start<Quantity::Ex>() + 1;
+    };
+    bool const node_counts = nodes(Direction::X) == layout_3d.nbr_cells(Direction::X)
+                             and nodes(Direction::Y) == layout_3d.nbr_cells(Direction::Y) + 1;
+    std::cout << "Dual and primal domain nodes counted right = " << node_counts
+              << " (expected true)\n";
+    ok = ok and node_counts;
+
+    auto const bz         = dom_box<Quantity::Bz>(layout_3d);
+    auto const bz_runtime = dom_box(layout_3d, Quantity::Bz);
+    bool const same_box   = bz.lower == bz_runtime.lower and bz.upper == bz_runtime.upper;
+    std::cout << "Compile time domain box matches = " << same_box << " (expected true)\n";
+    ok = ok and same_box;
+
+    return ok ? 0 : 1;
+}
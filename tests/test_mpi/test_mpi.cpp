@@ -0,0 +1,146 @@
+// test_mpi.cpp, run with e.g. mpirun -np 3 ./test_mpi
+#include "patches.hpp"
+#include "boundary_condition.hpp"
+#include "mpi_decomposition.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using PatchT = Patch<1>;
+
+void move(PatchedDomain<1>& domain)
+{
+    domain.for_each_patch([](PatchT& patch) {
+        patch.push(patch.populations[0].particles(), patch.E, patch.B);
+    });
+    domain.migrate_particles();
+    domain.for_each_patch([](PatchT& patch) {
+        patch.populations[0].rebin();
+        patch.populations[0].deposit();
+    });
+    domain.fill([](PatchT& patch) -> auto& { return patch.populations[0].density(); });
+    domain.fill([](PatchT& patch) -> auto& { return patch.populations[0].flux(); });
+}
+
+// the same smooth fields and particles whatever the decomposition
+void init(PatchedDomain<1>& domain, ParticleArray<1> const& particles, double offset)
+{
+    domain.add_population("test_species");
+    ParticleArray<1> mine;
+    auto const length = domain.layout()->dom_size(Direction::X);
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        auto particle = particles[i];
+        particle.position[0] -= offset;
+        if (particle.position[0] >= 0.0 and particle.position[0] < length)
+            mine.push_back(particle);
+    }
+    domain.distribute_particles(0, mine);
+
+    for (std::size_t ip = 0; ip < domain.size(); ++ip) {
+        auto& patch = domain[ip];
+        for (auto* field : {&patch.E.x, &patch.E.y, &patch.E.z, &patch.B.x, &patch.B.y, &patch.B.z})
+            for (std::size_t ix = 0; ix < field->size(); ++ix) {
+                auto const x = patch.layout->coordinate(Direction::X, field->quantity(), ix);
+                (*field)(ix) = 0.3 * std::sin(2 * M_PI * x / 20.0 + static_cast<int>(field->quantity()));
+            }
+    }
+    domain.fill(&PatchT::E);
+    domain.fill(&PatchT::B);
+}
+
+int main(int argc, char** argv)
+{
+    MpiSession mpi{argc, argv};
+    MpiDecomposition ranks;
+
+    constexpr std::size_t dim = 1;
+    std::array<std::size_t, dim> grid_size = {40};
+    std::array<double, dim> cell_size = {0.5};
+    std::size_t const nbr_ghosts = 1;
+    double const dt = 0.05;
+
+    std::mt19937_64 gen{11};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    ParticleArray<dim> particles;
+    for (int i = 0; i < 4000; ++i) {
+        Particle<dim> p;
+        p.position[0] = uniform(gen) * grid_size[0] * cell_size[0];
+        p.v = {4 * uniform(gen) - 2, uniform(gen), uniform(gen)};
+        p.weight = uniform(gen);
+        particles.push_back(p);
+    }
+
+    ThreadPool pool{2};
+    auto subdomain = ranks.subdomain(grid_size, cell_size, nbr_ghosts);
+    auto remote = std::make_shared<RemoteBoundaryCondition<dim>>(subdomain, ranks);
+
+    // each rank also runs the whole domain alone as the reference
+    PatchedDomain<dim> reference{grid_size, cell_size, nbr_ghosts, 1, dt, pool};
+    PatchedDomain<dim> distributed{subdomain, 2, dt, pool};
+    distributed.set_remote(remote);
+    init(reference, particles, 0.0);
+    init(distributed, particles, subdomain->origin(Direction::X));
+
+    // the remote boundary condition on a single field fills it like the
+    // periodic one on the whole domain
+    Field<dim> field{subdomain->allocate(Quantity::By), Quantity::By};
+    Field<dim> whole{reference.layout()->allocate(Quantity::By), Quantity::By};
+    reference.gather([](PatchT& patch) -> auto& { return patch.B.y; }, whole);
+    auto const first = ranks.cells(grid_size[0]).first;
+    for (auto ix = subdomain->dual_dom_start(Direction::X); ix <= subdomain->dual_dom_end(Direction::X); ++ix)
+        field(ix) = whole(ix + first);
+    remote->fill(field);
+    bool fill_ok = true;
+    for (std::size_t ix = 0; ix < field.size(); ++ix)
+        fill_ok = fill_ok and field(ix) == whole(ix + first);
+
+    for (int step = 0; step < 50; ++step) {
+        move(reference);
+        move(distributed);
+    }
+
+    Field<dim> expected{reference.layout()->allocate(Quantity::N), Quantity::N};
+    Field<dim> density{subdomain->allocate(Quantity::N), Quantity::N};
+    reference.gather([](PatchT& patch) -> auto& { return patch.populations[0].density(); }, expected);
+    distributed.gather([](PatchT& patch) -> auto& { return patch.populations[0].density(); }, density);
+
+    double max_diff = 0.0;
+    for (std::size_t ix = 0; ix < density.size(); ++ix)
+        max_diff = std::max(max_diff, std::abs(density(ix) - expected(ix + first)));
+
+    ParticleArray<dim> gathered;
+    distributed.gather_particles(0, gathered);
+    unsigned long count = gathered.size(), total = 0;
+    MPI_Allreduce(&count, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, ranks.comm());
+
+    // the boundary condition alone migrates the particles of a subdomain
+    VecField<dim> E{subdomain, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{subdomain, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    Boris<dim> push{subdomain, dt};
+    auto moved = gathered;
+    for (int step = 0; step < 50; ++step) {
+        push(moved, E, B);
+        remote->particles(moved);
+    }
+    bool inside = true;
+    for (auto x : moved.position(Direction::X))
+        inside = inside and x >= 0.0 and x < subdomain->dom_size(Direction::X);
+    count = moved.size();
+    unsigned long moved_total = 0;
+    MPI_Allreduce(&count, &moved_total, 1, MPI_UNSIGNED_LONG, MPI_SUM, ranks.comm());
+
+    int ok = fill_ok and max_diff < 1e-12 and total == particles.size() and inside
+             and moved_total == particles.size();
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, ranks.comm());
+
+    std::cout << "rank " << ranks.rank() << "/" << ranks.size() << ": remote fill matches periodic = "
+              << std::boolalpha << fill_ok << ", density max difference = " << max_diff
+              << ", particles " << total << "/" << particles.size() << ", migrated "
+              << moved_total << "/" << particles.size() << "\n";
+
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+// test_particle_bins.cpp
+#include "particle_bins.hpp"
+#include "gridlayout.hpp"
+#include "particle_array.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// every particle must lie in the range of its own cell
+bool is_binned(ParticleBins<1> const& bins, ParticleArray<1> const& particles, double dx)
+{
+    for (std::size_t iCell = 0; iCell < bins.nbr_cells(); ++iCell)
+    {
+        auto const [first, last] = bins.cell_range(iCell);
+        for (auto ip = first; ip < last; ++ip)
+            if (static_cast<std::size_t>(std::floor(particles.position(Direction::X)[ip] / dx))
+                != iCell)
+                return false;
+    }
+    return bins.offsets().back() == particles.size();
+}
+
+// weights are unique tags, so the sorted weights tell whether particles were lost
+std::vector<double> tags(ParticleArray<1> const& particles)
+{
+    std::vector<double> w(particles.weight().begin(), particles.weight().end());
+    std::sort(w.begin(), w.end());
+    return w;
+}
+
+int main()
+{
+    constexpr std::size_t dim = 1;
+    std::array<std::size_t, dim> grid_size = {50};
+    std::array<double, dim> cell_size = {0.5};
+    auto layout = std::make_shared<GridLayout<dim>>(grid_size, cell_size, 1);
+    double const L = grid_size[0] * cell_size[0];
+
+    std::mt19937_64 gen{3};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+    ParticleArray<dim> particles;
+    for (int i = 0; i < 5000; ++i)
+    {
+        Particle<dim> p;
+        p.position[0] = uniform(gen) * L;
+        p.v = {uniform(gen), 0.0, 0.0};
+        p.weight = i;
+        particles.push_back(p);
+    }
+    auto const reference_tags = tags(particles);
+
+    ParticleBins<dim> bins{layout};
+    bins.sort(particles);
+    bool ok = is_binned(bins, particles, cell_size[0]);
+    std::cout << "Sorted on load = " << std::boolalpha << ok << " (expected true)\n";
+
+    // small random displacements with periodic wrap, as after a push
+    std::size_t total_moved = 0;
+    for (int step = 0; step < 20; ++step)
+    {
+        for (auto& x : particles.position(Direction::X))
+        {
+            x += (uniform(gen) - 0.5) * 0.2 * cell_size[0];
+            if (x < 0.0)
+                x += L;
+            if (x >= L)
+                x -= L;
+        }
+        total_moved += bins.rebin(particles);
+        ok = ok and is_binned(bins, particles, cell_size[0]);
+    }
+    ok = ok and tags(particles) == reference_tags;
+
+    std::cout << "Sorted after rebin = " << ok << " (expected true)\n";
+    std::cout << "Mean particles moved per rebin = " << total_moved / 20 << " of "
+              << particles.size() << "\n";
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+// test_patches.cpp
+#include "patches.hpp"
+#include "boundary_condition.hpp"
+#include "gridlayout.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+using PatchT = Patch<1>;
+
+// pushes, migrates and deposits the particles of every patch, then fills the
+// moments ghosts
+void move(PatchedDomain<1>& domain)
+{
+    domain.for_each_patch([](PatchT& patch) {
+        patch.push(patch.populations[0].particles(), patch.E, patch.B);
+    });
+    domain.migrate_particles();
+    domain.for_each_patch([](PatchT& patch) {
+        patch.populations[0].rebin();
+        patch.populations[0].deposit();
+    });
+    domain.fill([](PatchT& patch) -> auto& { return patch.populations[0].density(); });
+    domain.fill([](PatchT& patch) -> auto& { return patch.populations[0].flux(); });
+}
+
+int main()
+{
+    constexpr std::size_t dim = 1;
+    std::array<std::size_t, dim> grid_size = {40};
+    std::array<double, dim> cell_size = {0.5};
+    double const dt = 0.05;
+
+    std::mt19937_64 gen{11};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    ParticleArray<dim> particles;
+    for (int i = 0; i < 4000; ++i) {
+        Particle<dim> p;
+        p.position[0] = uniform(gen) * grid_size[0] * cell_size[0];
+        p.v = {4 * uniform(gen) - 2, uniform(gen), uniform(gen)};
+        p.weight = uniform(gen);
+        particles.push_back(p);
+    }
+
+    ThreadPool pool{3};
+    PatchedDomain<dim> single{grid_size, cell_size, 1, 1, dt, pool};
+    PatchedDomain<dim> patched{grid_size, cell_size, 1, 4, dt, pool};
+
+    // the same smooth fields on both domains
+    for (auto* domain : {&single, &patched}) {
+        domain->add_population("test_species");
+        domain->distribute_particles(0, particles);
+        for (std::size_t ip = 0; ip < domain->size(); ++ip) {
+            auto& patch = (*domain)[ip];
+            auto const& layout = *patch.layout;
+            for (auto* field : {&patch.E.x, &patch.E.y, &patch.E.z, &patch.B.x, &patch.B.y, &patch.B.z})
+                for (std::size_t ix = 0; ix < field->size(); ++ix) {
+                    auto const x = layout.coordinate(Direction::X, field->quantity(), ix);
+                    (*field)(ix) = 0.3 * std::sin(2 * M_PI * x / 20.0 + static_cast<int>(field->quantity()));
+                }
+        }
+        domain->fill(&PatchT::E);
+        domain->fill(&PatchT::B);
+    }
+
+    // a single patch fills its ghosts like the periodic boundary condition
+    auto layout = single.layout();
+    PeriodicBoundaryCondition<dim> periodic{layout};
+    auto reference = single[0].B.y;
+    reference(layout->ghost_start(Quantity::By, Direction::X)) = 0.0;
+    reference(layout->ghost_end(Quantity::By, Direction::X))   = 0.0;
+    periodic.fill(reference);
+    bool const periodic_ok = reference.data() == single[0].B.y.data();
+    std::cout << "Single patch ghosts match periodic fill = " << std::boolalpha << periodic_ok
+              << " (expected true)\n";
+
+    for (int step = 0; step < 50; ++step) {
+        move(single);
+        move(patched);
+    }
+
+    Field<dim> single_density{layout->allocate(Quantity::N), Quantity::N};
+    Field<dim> patched_density{layout->allocate(Quantity::N), Quantity::N};
+    single.gather([](PatchT& patch) -> auto& { return patch.populations[0].density(); }, single_density);
+    patched.gather([](PatchT& patch) -> auto& { return patch.populations[0].density(); }, patched_density);
+
+    double max_diff = 0.0;
+    for (std::size_t ix = 0; ix < single_density.size(); ++ix)
+        max_diff = std::max(max_diff, std::abs(single_density(ix) - patched_density(ix)));
+    std::cout << "Patched density max difference = " << max_diff << " (expected round-off)\n";
+
+    ParticleArray<dim> gathered;
+    patched.gather_particles(0, gathered);
+    std::size_t in_patch = 0;
+    for (std::size_t ip = 0; ip < patched.size(); ++ip) {
+        auto const& pop = patched[ip].populations[0];
+        auto const length = patched[ip].layout->dom_size(Direction::X);
+        for (auto x : pop.particles().position(Direction::X))
+            in_patch += (x >= 0.0 and x < length) ? 1 : 0;
+    }
+    bool const conserved = gathered.size() == particles.size() and in_patch == particles.size();
+    std::cout << "Particles conserved and inside their patch = " << conserved << " (expected true)\n";
+
+    // per thread setup, e.g. the hardware counters, reaches every thread once
+    std::mutex mutex;
+    std::set<std::thread::id> ids;
+    std::size_t calls = 0;
+    pool.on_each_thread([&] {
+        std::lock_guard<std::mutex> lock{mutex};
+        ids.insert(std::this_thread::get_id());
+        ++calls;
+    });
+    bool const each_thread = ids.size() == pool.size() and calls == pool.size();
+    std::cout << "Threads reached by on_each_thread = " << ids.size() << " in " << calls
+              << " call(s) (expected " << pool.size() << ")\n";
+
+    return (periodic_ok and max_diff < 1e-12 and conserved and each_thread) ? 0 : 1;
+}
@@ -2,9 +2,16 @@
 #include "population.hpp"
 #include "gridlayout.hpp"
 #include "moments.hpp"
+#include "thread_pool.hpp"
+#include "push_deposit.hpp"
+#include "boundary_condition.hpp"
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
 
 int main() {
     constexpr std::size_t dim = 1;
@@ -15,8 +22,6 @@ int main() {
     Population<dim> pop{"test_species", layout};
 
     Particle<dim> p;
-    p.mass = 1.0;
-    p.charge = 1.0;
     p.weight = 1.0;
 
     for (int i = 0; i < grid_size[0]; ++i) {
@@ -53,4 +58,140 @@ int main() {
 
     std::cout << "Mean bulk Vx = " << mean_vx << " (expected 1.0)\n";
 
+    // threaded deposit: same moments as the serial one up to round-off,
+    // and bitwise reproducible whatever the number of threads
+    std::mt19937_64 gen{7};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    Population<dim> random_pop{"random_species", layout};
+    for (int i = 0; i < 1000; ++i) {
+        p.position[0] = uniform(gen) * grid_size[0] * cell_size[0];
+        p.v[0] = uniform(gen); p.v[1] = uniform(gen); p.v[2] = uniform(gen);
+        p.weight = uniform(gen);
+        random_pop.particles().push_back(p);
+    }
+
+    random_pop.deposit();
+    auto const serial_density = random_pop.density().data();
+    auto const serial_flux_x  = random_pop.flux().x.data();
+
+    ThreadPool pool{4};
+    random_pop.deposit(pool);
+    auto const threaded_density = random_pop.density().data();
+    auto const threaded_flux_x  = random_pop.flux().x.data();
+
+    double max_diff = 0.0;
+    for (std::size_t ix = 0; ix < serial_density.size(); ++ix) {
+        max_diff = std::max(max_diff, std::abs(serial_density[ix] - threaded_density[ix]));
+        max_diff = std::max(max_diff, std::abs(serial_flux_x[ix] - threaded_flux_x[ix]));
+    }
+    std::cout << "Threaded deposit max difference = " << max_diff << " (expected round-off)\n";
+
+    // the same slices on a single thread give the same bits
+    ThreadPool single{1};
+    random_pop.deposit(single);
+    bool const reproducible = random_pop.density().data() == threaded_density
+                              and random_pop.flux().x.data() == threaded_flux_x;
+    std::cout << "Threaded deposit on 1 and 4 threads identical = " << std::boolalpha
+              << reproducible << " (expected true)\n";
+
+    // a task that throws, on the calling thread or a worker, reaches the
+    // caller once every task ran, and leaves the pool usable
+    std::atomic<std::size_t> ran{0};
+    bool caught = false;
+    try {
+        pool.parallel_for(16, [&](std::size_t i) {
+            ++ran;
+            if (i % 2 == 1)
+                throw std::runtime_error("task failed");
+        });
+    } catch (std::runtime_error const&) {
+        caught = true;
+    }
+    pool.parallel_for(4, [&](std::size_t) { ++ran; });
+    bool const rethrown = caught and ran.load() == 20;
+    std::cout << "Task exception rethrown after all tasks ran = " << rethrown
+              << " (expected true)\n";
+
+    // fused push and deposit against push, boundary condition, deposit
+    VecField<dim> E{layout, {Quantity::Ex, Quantity::Ey, Quantity::Ez}};
+    VecField<dim> B{layout, {Quantity::Bx, Quantity::By, Quantity::Bz}};
+    for (auto* field : {&E.x, &E.y, &E.z, &B.x, &B.y, &B.z})
+        for (auto& value : *field)
+            value = uniform(gen);
+
+    // with the settings of the Boris it is given, here its gather grid, it
+    // pushes the particles to the same bits as that Boris
+    double const dt = 0.01;
+    Boris<dim> push{layout, dt};
+    PeriodicBoundaryCondition<dim> boundary_condition{layout};
+    PushDeposit<dim> push_deposit{layout, push};
+    double fused_diff = 0.0;
+    bool same_push    = true;
+    for (bool gather_grid : {false, true}) {
+        push.gather_grid(gather_grid);
+        auto separate_pop = random_pop;
+        push(separate_pop.particles(), E, B);
+        boundary_condition.particles(separate_pop.particles());
+        separate_pop.deposit(pool);
+
+        auto fused_pop = random_pop;
+        push_deposit(fused_pop, E, B, pool);
+
+        for (std::size_t ix = 0; ix < serial_density.size(); ++ix)
+            fused_diff = std::max(fused_diff, std::abs(separate_pop.density().data()[ix]
+                                                       - fused_pop.density().data()[ix]));
+        same_push = same_push and fused_pop.particles().v(0) == separate_pop.particles().v(0)
+                    and fused_pop.particles().position(Direction::X)
+                            == separate_pop.particles().position(Direction::X);
+    }
+    push.gather_grid(false);
+    std::cout << "Fused push-deposit max difference = " << fused_diff
+              << " (expected round-off)\n";
+    std::cout << "Fused push-deposit particles identical = " << same_push
+              << " (expected true)\n";
+
+    // the push out of place from a snapshot gives the particles of a push in
+    // place, the snapshot is restored unchanged and the two buffers are
+    // swapped, never copied nor reallocated
+    auto snapshot_pop = random_pop;
+    auto const initial = snapshot_pop.particles();
+    auto pushed = initial;
+    push(pushed, E, B);
+    auto fused_pushed = random_pop;
+    push_deposit(fused_pushed, E, B, pool);
+    double const* const buffer = snapshot_pop.particles().v(0).data();
+    bool restored = true;
+    for (int cycle = 0; cycle < 4; ++cycle) {
+        snapshot_pop.save_particles();
+        if (cycle % 2 == 0)
+            push(snapshot_pop.saved_particles(), snapshot_pop.particles(), E, B);
+        else
+            push_deposit(snapshot_pop, E, B, pool, true);
+        auto const& expected = cycle % 2 == 0 ? pushed : fused_pushed.particles();
+        restored = restored and snapshot_pop.particles().v(0) == expected.v(0)
+                   and snapshot_pop.particles().position(Direction::X)
+                           == expected.position(Direction::X)
+                   and snapshot_pop.particles().weight() == expected.weight();
+        if (cycle % 2 == 1)
+            restored = restored and snapshot_pop.density().data() == fused_pushed.density().data();
+        restored = restored and snapshot_pop.particles().v(0).data() != buffer
+                   and snapshot_pop.saved_particles().v(0).data() == buffer;
+        snapshot_pop.restore_particles();
+        restored = restored and snapshot_pop.particles().v(0) == initial.v(0)
+                   and snapshot_pop.particles().position(Direction::X) == initial.position(Direction::X)
+                   and snapshot_pop.particles().v(0).data() == buffer;
+    }
+    bool threw = false;
+    try {
+        snapshot_pop.restore_particles();
+    } catch (std::runtime_error const&) {
+        threw = true;
+    }
+    bool const snapshot_ok = restored and threw;
+    std::cout << "Snapshot restored in place = " << std::boolalpha << snapshot_ok
+              << " (expected true)\n";
+
+    bool const ok = max_diff < 1e-12 and reproducible and rethrown and fused_diff < 1e-12
+                    and same_push and snapshot_ok;
+    return ok ? 0 : 1;
 }
@@ -0,0 +1,290 @@
+// test_simulation.cpp
+#include "simulation.hpp"
+#include "gridlayout.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+
+using SimulationT = Simulation<1>;
+using PatchT      = Patch<1>;
+
+// the same particles and a smooth B on every simulation
+void load(SimulationT& sim, ParticleArray<1> const& particles, double amplitude)
+{
+    auto& domain = sim.domain();
+    domain.add_population("test_species");
+    domain.distribute_particles(0, particles);
+    for (std::size_t ip = 0; ip < domain.size(); ++ip)
+    {
+        auto& patch        = domain[ip];
+        auto const& layout = *patch.layout;
+        for (auto* field : {&patch.B.x, &patch.B.y, &patch.B.z})
+            for (std::size_t ix = 0; ix < field->size(); ++ix)
+            {
+                auto const x = layout.coordinate(Direction::X, field->quantity(), ix);
+                (*field)(ix) = (field->quantity() == Quantity::Bx ? 1.0 : 0.0)
+                             + amplitude * std::sin(2 * M_PI * x / 20.0
+                                                    + static_cast<int>(field->quantity()));
+            }
+    }
+    domain.fill(&PatchT::B);
+}
+
+double max_difference(SimulationT& a, SimulationT& b)
+{
+    double diff = 0.0;
+    for (std::size_t ip = 0; ip < a.domain().size(); ++ip)
+    {
+        auto& pa = a.domain()[ip];
+        auto& pb = b.domain()[ip];
+        for (auto [fa, fb] : {std::pair{&pa.B.x, &pb.B.x}, {&pa.B.y, &pb.B.y}, {&pa.B.z, &pb.B.z},
+                              {&pa.E.x, &pb.E.x}, {&pa.E.y, &pb.E.y}, {&pa.E.z, &pb.E.z},
+                              {&pa.N, &pb.N}})
+            for (std::size_t ix = 0; ix < fa->size(); ++ix)
+                diff = std::max(diff, std::abs((*fa)(ix) - (*fb)(ix)));
+    }
+    return diff;
+}
+
+int main()
+{
+    constexpr std::size_t dim = 1;
+    std::array<std::size_t, dim> grid_size = {40};
+    std::array<double, dim> cell_size      = {0.5};
+    double const dt                        = 0.0625;
+    auto const layout = std::make_shared<GridLayout<dim>>(grid_size, cell_size, 1);
+
+    std::mt19937_64 gen{5};
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    ParticleArray<dim> warm;
+    for (int i = 0; i < 4000; ++i)
+    {
+        Particle<dim> p;
+        p.position[0] = uniform(gen) * grid_size[0] * cell_size[0];
+        p.v           = {0.2 * uniform(gen) - 0.1, 0.2 * uniform(gen) - 0.1, 0.2 * uniform(gen) - 0.1};
+        p.weight      = 0.01;
+        warm.push_back(p);
+    }
+
+    // evenly spaced particles at rest, a uniform density
+    std::size_t const nppc = 8;
+    ParticleArray<dim> cold;
+    for (std::size_t i = 0; i < nppc * grid_size[0]; ++i)
+    {
+        Particle<dim> p;
+        p.position[0] = (i + 0.5) * cell_size[0] / nppc;
+        p.v           = {0.0, 0.0, 0.0};
+        p.weight      = 1.0 / nppc;
+        cold.push_back(p);
+    }
+
+    ThreadPool pool{3};
+    bool ok = true;
+
+    // advance_to takes the steps until the time is reached
+    {
+        SimulationT sim{layout, 4, dt, pool};
+        load(sim, warm, 0.1);
+        sim.initialize();
+        auto const taken = sim.advance_to(0.5);
+        bool const counted = taken == 8 and sim.steps() == 8 and sim.time() == 0.5;
+        std::cout << "advance_to(0.5) steps = " << taken << ", time = " << sim.time()
+                  << " (expected 8, 0.5)\n";
+        sim.resume(1.0, 16);
+        bool const resumed = sim.advance_to(1.0) == 0 and sim.steps() == 16;
+        std::cout << "Steps after resuming at the final time = " << sim.steps()
+                  << " (expected 16)\n";
+
+        // 1008 steps of 0.001 add up to slightly less than 1.008, stepping
+        // while the time is short of it takes one step too many
+        SimulationT fine{layout, 4, 0.001, pool};
+        load(fine, cold, 0.0);
+        fine.initialize();
+        auto const fine_taken = fine.advance_to(1.008);
+        bool const rounded    = fine_taken == 1008 and fine.steps() == 1008;
+        std::cout << "advance_to(1.008) steps of 0.001 = " << fine_taken << " (expected 1008)\n";
+
+        bool rejected = false;
+        try
+        {
+            sim.integrator(nullptr);
+        }
+        catch (std::runtime_error const&)
+        {
+            rejected = true;
+        }
+        std::cout << "Null integrator rejected = " << std::boolalpha << rejected
+                  << " (expected true)\n";
+        ok = ok and counted and resumed and rounded and rejected;
+    }
+
+    // the fused field sweep changes how the fields are computed, not what
+    // the integrators make of them
+    for (bool single_push : {false, true})
+    {
+        SimulationT separate{layout, 4, dt, pool};
+        SimulationT fused{layout, 4, dt, pool};
+        fused.fused_fields(true);
+        for (auto* sim : {&separate, &fused})
+        {
+            load(*sim, warm, 0.1);
+            if (single_push)
+                sim->integrator(std::make_unique<SinglePush<dim>>());
+            sim->initialize();
+            sim->advance_to(0.5);
+        }
+        auto const diff = max_difference(separate, fused);
+        std::cout << (single_push ? "SinglePush" : "ICN")
+                  << " fused vs separate fields, max difference = " << diff << " (expected 0)\n";
+        ok = ok and diff == 0.0;
+    }
+
+    // the fused push and deposit moves the particles of a single patch as
+    // the separate passes do, and refuses several patches
+    {
+        SimulationT separate{layout, 1, dt, pool};
+        SimulationT fused{layout, 1, dt, pool};
+        fused.push_deposit(true);
+        for (auto* sim : {&separate, &fused})
+        {
+            load(*sim, warm, 0.1);
+            sim->initialize();
+            sim->advance_to(0.25);
+        }
+        auto const diff = max_difference(separate, fused);
+        std::cout << "Fused vs separate push and deposit, max difference = " << diff
+                  << " (expected round-off)\n";
+
+        SimulationT patched{layout, 4, dt, pool};
+        bool rejected = false;
+        try
+        {
+            patched.push_deposit(true);
+        }
+        catch (std::runtime_error const&)
+        {
+            rejected = true;
+        }
+        std::cout << "Fused push and deposit on 4 patches rejected = " << rejected
+                  << " (expected true)\n";
+        ok = ok and diff < 1e-12 and rejected;
+    }
+
+    // a cold uniform plasma in a uniform B stays at rest
+    {
+        SimulationT sim{layout, 2, dt, pool};
+        load(sim, cold, 0.0);
+        sim.initialize();
+        sim.advance_to(1.0);
+
+        double max_v = 0.0;
+        double max_dB = 0.0;
+        for (std::size_t ip = 0; ip < sim.domain().size(); ++ip)
+        {
+            auto& patch = sim.domain()[ip];
+            for (auto const* v : {&patch.V.x, &patch.V.y, &patch.V.z})
+                for (std::size_t ix = 0; ix < v->size(); ++ix)
+                    max_v = std::max(max_v, std::abs((*v)(ix)));
+            for (auto const* b : {&patch.B.x, &patch.B.y, &patch.B.z})
+                for (std::size_t ix = 0; ix < b->size(); ++ix)
+                    max_dB = std::max(max_dB, std::abs((*b)(ix)
+                                                       - (b == &patch.B.x ? 1.0 : 0.0)));
+        }
+        std::cout << "ICN cold plasma, max |V| = " << max_v << ", max |B - B0| = " << max_dB
+                  << " (expected round-off)\n";
+        ok = ok and max_v < 1e-12 and max_dB < 1e-12;
+    }
+
+    // order in time, from the error of a small whistler against ICN at a 16
+    // times shorter step: halving dt divides it by 4 with both integrators
+    {
+        auto run = [&](SimulationT& sim, bool single_push) {
+            load(sim, cold, 0.01);
+            if (single_push)
+                sim.integrator(std::make_unique<SinglePush<dim>>());
+            sim.initialize();
+            sim.advance_to(1.0);
+        };
+        SimulationT reference{layout, 1, dt / 16, pool};
+        run(reference, false);
+        auto error = [&](double step, bool single_push) {
+            SimulationT sim{layout, 1, step, pool};
+            run(sim, single_push);
+            return max_difference(sim, reference);
+        };
+        for (bool single_push : {false, true})
+        {
+            auto const ratio = error(dt / 2, single_push) / error(dt / 4, single_push);
+            std::cout << (single_push ? "SinglePush" : "ICN") << " error ratio for dt / 2 = "
+                      << ratio << " (expected 4)\n";
+            ok = ok and ratio > 3.5 and ratio < 5.0;
+        }
+    }
+
+    // the whistler limit of a uniform plasma, n = 1 and |B| = 1, is pi over
+    // the frequency at k = pi / dx
+    {
+        SimulationT sim{layout, 2, dt, pool};
+        load(sim, cold, 0.0);
+        sim.initialize();
+        auto const expected = cell_size[0] * cell_size[0] / M_PI;
+        auto const whistler = sim.whistler_dt();
+        std::cout << "Whistler time step = " << whistler << " (expected " << expected << ")\n";
+        ok = ok and std::abs(whistler - expected) < 1e-12;
+    }
+
+    // past the field CFL limit, grid scale noise on B grows by orders of
+    // magnitude in a few steps without subcycling and stays at its level
+    // with it
+    std::uniform_real_distribution<double> noise{-1e-3, 1e-3};
+    for (bool subcycle : {false, true})
+    {
+        double const long_dt = 0.2;
+        SimulationT sim{layout, 2, long_dt, pool};
+        load(sim, cold, 0.0);
+        gen.seed(7);
+        for (std::size_t ip = 0; ip < sim.domain().size(); ++ip)
+            for (auto* b : {&sim.domain()[ip].B.y, &sim.domain()[ip].B.z})
+                for (auto& v : b->data())
+                    v = noise(gen);
+        sim.domain().fill(&PatchT::B);
+        sim.subcycle_fields(subcycle);
+        sim.initialize();
+        for (int step = 0; step < (subcycle ? 20 : 3); ++step)
+            sim.step();
+
+        double max_dB = 0.0;
+        for (std::size_t ip = 0; ip < sim.domain().size(); ++ip)
+        {
+            auto& patch = sim.domain()[ip];
+            for (auto const* b : {&patch.B.y, &patch.B.z})
+                for (auto v : b->data())
+                    max_dB = std::max(max_dB, std::abs(v));
+        }
+        // ceil(0.2 / (0.5 * 0.25 / pi)) substeps, the noise barely changes |B|
+        std::cout << (subcycle ? "Subcycled" : "Single") << " field steps of " << long_dt << ", "
+                  << sim.field_substeps() << " substep(s), max |B - B0| = " << max_dB
+                  << (subcycle ? " (expected 6, < 1e-2)\n" : " (expected 1, > 1e-1)\n");
+        if (subcycle)
+            ok = ok and sim.field_substeps() == 6 and max_dB < 1e-2;
+        else
+            ok = ok and sim.field_substeps() == 1 and max_dB > 1e-1;
+
+        if (subcycle)
+        {
+            bool const uncapped = !sim.field_substeps_capped();
+            sim.max_field_substeps(2);
+            sim.step();
+            std::cout << "Substeps capped at 2 = " << sim.field_substeps() << ", reported "
+                      << sim.field_substeps_capped() << " (expected 2, true)\n";
+            ok = ok and uncapped and sim.field_substeps() == 2 and sim.field_substeps_capped();
+        }
+    }
+
+    return ok ? 0 : 1;
+}